@@ -24,23 +24,48 @@
 #include <stdlib.h>
 #include <string.h>
 #include <float.h>
+#include <math.h>
 #include <errno.h>
+#include <ctype.h>
+#include <stdarg.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
 
 #include "glib.h"
 #include "spicestream.h"
+#include "ss_spc.h"
+#include "sp2sp.h"
+#include "sp2sp_npy.h"
+#include "sp2sp_arrow.h"
 
-#define SWEEP_NONE 0
-#define SWEEP_PREPEND 1
-#define SWEEP_HEAD 2
+#if defined(_POSIX_THREADS) && _POSIX_THREADS > 0 && !defined(__STDC_NO_ATOMICS__)
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#define SP2SP_THREADS 1
+#endif
 
 int g_verbose = 0;
 int sweep_mode = SWEEP_PREPEND;
 char *progname = "sp2sp";
 
-static void ascii_header_output(SpiceStream *sf, int *enab, int nidx);
-static void ascii_data_output(SpiceStream *sf, int *enab, int nidx,
-                              double begin_val, double end_val, int ndigits);
+static void ascii_header_output(OutSink *os, SpiceStream *sf, int *enab, int nidx);
+static void ascii_data_output(OutSink *os, SpiceStream *sf, int *enab, int nidx,
+                              SSIndex *index, double begin_val, double end_val,
+                              int ndigits,
+                              int nthreads);
+static void s3raw_output(OutSink *os, SpiceStream *sf, int *enab, int nidx,
+                         SSIndex *index, double begin_val, double end_val,
+                         int nthreads);
+static void hsbin_output(OutSink *os, SpiceStream *sf, int *enab, int nidx,
+                         SSIndex *index, double begin_val, double end_val,
+                         int nthreads);
+static void spc_output(OutSink *os, SpiceStream *sf, int *enab, int nidx,
+                       SSIndex *index, double begin_val, double end_val,
+                       int nthreads);
+static void set_projection(SpiceStream *sf, int *indices, int nidx);
 static int parse_field_numbers(int **index, int *idxsize, int *nsel,
                                char *list, int nfields);
 static int parse_field_names(int **index, int *idxsize, int *nsel,
@@ -53,17 +78,25 @@ static void usage()
 	char *s;
 
 	fprintf(stderr, "usage: %s [options] file\n", progname);
+	fprintf(stderr, "  file may be - for the standard input\n");
 	fprintf(stderr, " options:\n");
 	fprintf(stderr, "  -b V          begin output after independent-variable value V is reached\n");
 	fprintf(stderr, "                instead of start of input\n");
 	fprintf(stderr, "  -c T          Convert output to type T\n");
-	fprintf(stderr, "  -d N          use N significant digits in output\n");
+	fprintf(stderr, "  -d N          use N significant digits in output;\n");
+	fprintf(stderr, "                0 for the fewest that read back exactly\n");
 	fprintf(stderr, "  -e V          stop after independent-variable value V is reached\n");
 	fprintf(stderr, "                instead of end of input.\n");
 
 	fprintf(stderr, "  -f f1,f2,...  Output only fields named f1, f2, etc.\n");
+	fprintf(stderr, "  -i            with -b or -e, keep a seek index in file.ssidx and\n");
+	fprintf(stderr, "                use it to skip the rows that aren't wanted; set\n");
+	fprintf(stderr, "                SS_INDEX_DIR to keep it in that directory instead\n");
+	fprintf(stderr, "  -j N          with N > 1, read input on a thread of its own, and\n");
+	fprintf(stderr, "                format output and parse ascii or cazm input on N threads\n");
 	fprintf(stderr, "  -n n1,n2,...  Output only fields n1, n2, etc;\n");
 	fprintf(stderr, "                independent variable is field number 0\n");
+	fprintf(stderr, "  -o F          write output to file F instead of stdout\n");
 	fprintf(stderr, "  -u U          Output only variables with units of type; U\n");
 	fprintf(stderr, "                U = volts, amps, etc.\n");
 	fprintf(stderr, "  -s S          Handle sweep parameters as S:\n");
@@ -77,6 +110,13 @@ static void usage()
 	fprintf(stderr, "   ascii - lines of space-seperated numbers, with header\n");
 	fprintf(stderr, "   nohead - lines of space-seperated numbers, no headers\n");
 	fprintf(stderr, "   cazm - CAzM format\n");
+	fprintf(stderr, "   spice3raw - spice3 binary rawfile\n");
+	fprintf(stderr, "   hsbinary - HSPICE binary post format 9601\n");
+	fprintf(stderr, "   spc - columnar cache, quick to read again\n");
+	fprintf(stderr, "   npz - NumPy arrays in a .npz archive\n");
+	fprintf(stderr, "   npy - NumPy .npy files, one for each array, in the\n");
+	fprintf(stderr, "         directory given with -o\n");
+	fprintf(stderr, "   arrow - Apache Arrow IPC stream\n");
 	fprintf(stderr, " input format types:\n");
 
 	i = 0;
@@ -84,6 +124,7 @@ static void usage()
 	{
 		fprintf(stderr, "    %s\n", s);
 	}
+	fprintf(stderr, "    auto - guess from the contents of the file\n");
 }
 
 int
@@ -101,16 +142,21 @@ main(int argc, char **argv)
 	char *outfiletype = "ascii";
 	char *fieldnamelist = NULL;
 	char *fieldnumlist = NULL;
+	char *outfilename = NULL;
+	OutSink *os;
 	int *out_indices = NULL;
 	int outi_size = 0;
 	int nsel = 0;
 	VarType vartype = UNKNOWN;
 	int c;
 	int ndigits = 7;
+	int nthreads = 1;
+	int use_index = 0;
+	SSIndex *index = NULL;
 	double begin_val = -DBL_MAX;
 	double end_val = DBL_MAX;
 
-	while ((c = getopt (argc, argv, "b:c:d:e:f:n:s:t:u:vx")) != EOF)
+	while ((c = getopt (argc, argv, "b:c:d:e:f:ij:n:o:s:t:u:vx")) != EOF)
 	{
 		switch(c)
 		{
@@ -126,7 +172,7 @@ main(int argc, char **argv)
 			break;
 		case 'd':
 			ndigits = atoi(optarg);
-			if(ndigits < 5)
+			if(ndigits < 5 && ndigits != 0)
 				ndigits = 5;
 			break;
 		case 'e':
@@ -135,9 +181,18 @@ main(int argc, char **argv)
 		case 'f':
 			fieldnamelist = optarg;
 			break;
+		case 'i':
+			use_index = 1;
+			break;
+		case 'j':
+			nthreads = atoi(optarg);
+			break;
 		case 'n':
 			fieldnumlist = optarg;
 			break;
+		case 'o':
+			outfilename = optarg;
+			break;
 		case 's':
 			if(strcmp(optarg, "none") == 0)
 				sweep_mode = SWEEP_NONE;
@@ -235,23 +290,63 @@ main(int argc, char **argv)
 		fprintf(stderr, "No fields selected for output\n");
 		exit(0);
 	}
+	set_projection(sf, out_indices, nsel);
+	ss_set_threads(sf, nthreads);
+	if(use_index && (begin_val > -DBL_MAX || end_val < DBL_MAX)
+	   && strcmp(outfiletype, "none") != 0)
+		index = ss_index_open(sf, 0);
 
+	/* -o names a directory for npy */
+	os = out_open(strcmp(outfiletype, "npy") == 0 ? NULL : outfilename);
 	if(strcmp(outfiletype, "cazm") == 0)
 	{
-		printf("* CAZM-format output converted with sp2sp\n");
-		printf("\n");
-		printf("TRANSIENT ANALYSIS\n");
-		ascii_header_output(sf, out_indices, nsel);
-		ascii_data_output(sf, out_indices, nsel, begin_val, end_val, ndigits);
+		out_puts(os, "* CAZM-format output converted with sp2sp\n");
+		out_puts(os, "\n");
+		out_puts(os, "TRANSIENT ANALYSIS\n");
+		ascii_header_output(os, sf, out_indices, nsel);
+		ascii_data_output(os, sf, out_indices, nsel, index, begin_val, end_val,
+		                  ndigits, nthreads);
 	}
 	else if(strcmp(outfiletype, "ascii") == 0)
 	{
-		ascii_header_output(sf, out_indices, nsel);
-		ascii_data_output(sf, out_indices, nsel, begin_val, end_val, ndigits);
+		ascii_header_output(os, sf, out_indices, nsel);
+		ascii_data_output(os, sf, out_indices, nsel, index, begin_val, end_val,
+		                  ndigits, nthreads);
 	}
 	else if(strcmp(outfiletype, "nohead") == 0)
 	{
-		ascii_data_output(sf, out_indices, nsel, begin_val, end_val, ndigits);
+		ascii_data_output(os, sf, out_indices, nsel, index, begin_val, end_val,
+		                  ndigits, nthreads);
+	}
+	else if(strcmp(outfiletype, "spice3raw") == 0)
+	{
+		s3raw_output(os, sf, out_indices, nsel, index, begin_val, end_val,
+		             nthreads);
+	}
+	else if(strcmp(outfiletype, "hsbinary") == 0)
+	{
+		hsbin_output(os, sf, out_indices, nsel, index, begin_val, end_val,
+		             nthreads);
+	}
+	else if(strcmp(outfiletype, "spc") == 0)
+	{
+		spc_output(os, sf, out_indices, nsel, index, begin_val, end_val,
+		           nthreads);
+	}
+	else if(strcmp(outfiletype, "npz") == 0)
+	{
+		npy_output(os, NULL, sf, out_indices, nsel, index, begin_val,
+		           end_val, nthreads);
+	}
+	else if(strcmp(outfiletype, "npy") == 0)
+	{
+		npy_output(NULL, outfilename ? outfilename : ".", sf, out_indices,
+		           nsel, index, begin_val, end_val, nthreads);
+	}
+	else if(strcmp(outfiletype, "arrow") == 0)
+	{
+		arrow_output(os, sf, out_indices, nsel, index, begin_val, end_val,
+		             nthreads);
 	}
 	else if(strcmp(outfiletype, "none") == 0)
 	{
@@ -262,7 +357,10 @@ main(int argc, char **argv)
 		fprintf(stderr, "%s: invalid output type name: %s\n",
 		        progname, outfiletype);
 	}
+	out_close(os);
 
+	if(index)
+		ss_index_free(index);
 	ss_close(sf);
 
 	exit(0);
@@ -274,7 +372,7 @@ main(int argc, char **argv)
  * consisting of the variable name plus a suffix.
  */
 static void
-ascii_header_output(SpiceStream *sf, int *indices, int nidx)
+ascii_header_output(OutSink *os, SpiceStream *sf, int *indices, int nidx)
 {
 	int i, j;
 	char buf[1024];
@@ -283,17 +381,18 @@ ascii_header_output(SpiceStream *sf, int *indices, int nidx)
 	{
 		for(i = 0; i < sf->nsweepparam; i++)
 		{
-			printf("%s ", sf->spar[i].name);
+			out_puts(os, sf->spar[i].name);
+			out_putc(os, ' ');
 		}
 	}
 	for(i = 0; i < nidx; i++)
 	{
 		if(i > 0)
-			putchar(' ');
+			out_putc(os, ' ');
 		if(indices[i] == 0)
 		{
 			ss_var_name(sf->ivar, 0, buf, 1024);
-			printf("%s", buf);
+			out_puts(os, buf);
 		}
 		else
 		{
@@ -301,253 +400,2023 @@ ascii_header_output(SpiceStream *sf, int *indices, int nidx)
 			for(j = 0; j < sf->dvar[varno].ncols; j++)
 			{
 				if(j > 0)
-					putchar(' ');
+					out_putc(os, ' ');
 				ss_var_name(&sf->dvar[varno], j, buf, 1024);
-				printf("%s", buf);
+				out_puts(os, buf);
 			}
 		}
 	}
-	putchar('\n');
+	out_putc(os, '\n');
 }
 
 /*
- * print data as space-seperated columns.
+ * Tell the reader which dependent variables we are going to output,
+ * so that it doesn't have to convert the rest.
  */
 static void
-ascii_data_output(SpiceStream *sf, int *indices, int nidx,
-                  double begin_val, double end_val, int ndigits)
+set_projection(SpiceStream *sf, int *indices, int nidx)
 {
-	int i, j, tab;
-	int rc;
-	double ival;
-	double *dvals;
-	double *spar = NULL;
-	int done;
+	int *dvsel;
+	int i, n;
 
-	dvals = g_new(double, sf->ncols);
-	if(sf->nsweepparam > 0)
-		spar = g_new(double, sf->nsweepparam);
+	dvsel = g_new(int, nidx);
+	n = 0;
+	for(i = 0; i < nidx; i++)
+	{
+		if(indices[i] > 0)
+			dvsel[n++] = indices[i]-1;
+	}
+	ss_set_projection(sf, dvsel, n);
+	g_free(dvsel);
+}
 
-	done = 0;
-	tab = 0;
-	while(!done)
+/*
+ * number of rows to read at a time with ss_readblock:
+ * about a megabyte of data in the columns we want, but at least one row.
+ */
+static int
+block_rows(SpiceStream *sf)
+{
+	int n;
+	int ncols;
+
+	ncols = sf->projcols ? sf->nprojcols + 1 : sf->ncols;
+	n = (1 << 20) / (sizeof(double) * ncols);
+	if(n < 1)
+		n = 1;
+	if(n > 4096)
+		n = 4096;
+	return n;
+}
+
+/*
+ * Reading is done a RowBlock at a time: either a block of rows, the
+ * sweep parameters at the start of a table, or the end of a table or of
+ * the file.  These come from a BlockReader, which can run the reading on
+ * a thread of its own, so that decoding the input overlaps formatting the
+ * output.  The thread passes filled-in RowBlocks through a small ring,
+ * with one atomic index for each side; the events stay in file order.
+ * A side that has to wait for the other polls its index for a while,
+ * and then sleeps on a condition variable until the index moves.
+ * Given a seek index, the BlockReader skips ahead to the rows at or
+ * after begin_val at the start of each table, and once it has gone past
+ * end_val, on to the start of the next table.  Without one, it does the
+ * same with ss_seek_ival for formats with fixed-size rows, and skips the
+ * rest of each table past end_val with ss_skip_table.
+ */
+#define BR_START 0	/* at start of a table */
+#define BR_ROWS 1	/* reading a table */
+#define BR_DONE 2
+
+#define BR_SLOTS 4	/* ring size when reading ahead */
+#define BR_SPINS 64	/* polls of the other side before sleeping */
+#define BR_MINROWS 64	/* first block of a table, with end_val set */
+
+struct _BlockReader {
+	SpiceStream *sf;
+	int maxrows;
+	int blkrows;	/* rows to ask for next, growing to maxrows */
+	int state;
+	SSIndex *index;
+	double begin_val;
+	double end_val;
+	int table;	/* number of the table being read, from 0 */
+	int seekbegin;	/* at start of table, look for begin_val */
+	int pastend;	/* past end_val, look for the next table */
+	RowBlock *ring;
+	int nslots;
+#ifdef SP2SP_THREADS
+	int threaded;
+	int held;	/* consumer has the slot at head */
+	pthread_t thread;
+	atomic_ulong head;	/* next slot for the consumer */
+	atomic_ulong tail;	/* next slot for the reading thread to fill */
+	atomic_int stop;	/* consumer wants no more */
+	pthread_mutex_t lock;
+	pthread_cond_t moved;	/* head or tail moved, or stop was set */
+	atomic_int waiting;	/* threads asleep on moved, or about to be */
+#endif
+};
+
+/*
+ * Do the next step of reading into b.
+ */
+static void
+br_fill(BlockReader *br, RowBlock *b)
+{
+	SpiceStream *sf = br->sf;
+	int rc;
+
+	switch(br->state)
 	{
+	case BR_START:
+		br->state = BR_ROWS;
+		br->seekbegin = (br->index != NULL || br->begin_val > -DBL_MAX);
+		br->pastend = 0;
+		/* start small, so that little is decoded past end_val
+		 * before the rest of the table gets skipped */
+		br->blkrows = br->maxrows;
+		if(br->end_val < DBL_MAX && br->blkrows > BR_MINROWS)
+			br->blkrows = BR_MINROWS;
 		if(sf->nsweepparam > 0)
 		{
-			if(ss_readsweep(sf, spar) <= 0)
-				break;
-		}
-		if(tab > 0 && sweep_mode == SWEEP_HEAD)
-		{
-			printf("# sweep %d;", tab);
-			for(i = 0; i < sf->nsweepparam; i++)
+			if(ss_readsweep(sf, b->spar) <= 0)
 			{
-				printf(" %s=%g", sf->spar[i].name, spar[i]);
+				br->state = BR_DONE;
+				b->type = RB_END;
+				b->rc = 0;
 			}
-			putchar('\n');
+			else
+				b->type = RB_SWEEP;
+			return;
 		}
-		while((rc = ss_readrow(sf, &ival, dvals)) > 0)
+		/* fall through */
+	case BR_ROWS:
+		if(br->seekbegin)
 		{
-			if(ival < begin_val)
-				continue;
-			if(ival > end_val)
-			{
-				/* past end_val, but can only stop reading
-				   early if if there is only one sweep-table
-				   in the file. */
-				if(sf->ntables == 1)
-					break;
-				else
-					continue;
-			}
-
-			if((sf->nsweepparam > 0) && (sweep_mode == SWEEP_PREPEND))
-			{
-				for(i = 0; i < sf->nsweepparam; i++)
-				{
-					printf("%.*g ", ndigits, spar[i]);
-				}
-			}
-			for(i = 0; i < nidx; i++)
+			br->seekbegin = 0;
+			if(br->index)
+				ss_index_seek(br->index, sf, br->table, br->begin_val);
+			else
+				ss_seek_ival(sf, br->begin_val);
+		}
+		if(br->pastend && br->index
+		   && ss_index_next_table(br->index, sf, br->table))
+		{
+			/* now at the start of the next table */
+			rc = -2;
+		}
+		else if(br->pastend && !br->index && sf->ntables > 1)
+		{
+			/* the rest of this table is past end_val too */
+			rc = ss_skip_table(sf);
+		}
+		else
+		{
+			/* with rows in order, the rest of the file is past
+			 * end_val; go to the end of it */
+			if(br->pastend && !br->index)
+				ss_seek_ival(sf, DBL_MAX);
+			rc = ss_readblock(sf, br->blkrows, b->ivals, b->dcols);
+			if(rc > 0)
 			{
-				if(i > 0)
-					putchar(' ');
-				if(indices[i] == 0)
-					printf("%.*g", ndigits, ival);
-				else
+				b->type = RB_ROWS;
+				b->nrows = rc;
+				if(br->blkrows < br->maxrows)
 				{
-					int varno = indices[i]-1;
-					int dcolno = sf->dvar[varno].col - 1;
-					for(j = 0; j < sf->dvar[varno].ncols; j++)
-					{
-						if(j > 0)
-							putchar(' ');
-						printf("%.*g", ndigits,
-						       dvals[dcolno+j]);
-					}
+					br->blkrows *= 2;
+					if(br->blkrows > br->maxrows)
+						br->blkrows = br->maxrows;
 				}
+				if(b->ivals[rc-1] > br->end_val)
+					br->pastend = 1;
+				return;
 			}
-			putchar('\n');
-		}
-		if(rc == -2)    /* end of sweep, more follow */
-		{
-			if(sf->nsweepparam == 0)
-				sweep_mode = SWEEP_HEAD;
-			tab++;
 		}
-		else    	/* EOF or error */
+		if(rc == -2)
 		{
-			done = 1;
+			br->state = BR_START;
+			br->table++;
 		}
+		else
+			br->state = BR_DONE;
+		b->type = RB_END;
+		b->rc = rc;
+		return;
+	default:
+		b->type = RB_END;
+		b->rc = 0;
+		return;
 	}
-	g_free(dvals);
-	if(spar)
-		g_free(spar);
 }
 
-static int parse_field_numbers(int **indices, int *idxsize, int *nidx, char *list, int nfields)
+#ifdef SP2SP_THREADS
+/*
+ * Wait until the index at ip is no longer old, or stop is set.  Returns
+ * 0 if stop is set.  The index and waiting are changed and read in
+ * sequentially consistent order, so either br_moved sees that this
+ * thread is waiting, or this thread sees the new index before it sleeps.
+ */
+static int
+br_wait(BlockReader *br, atomic_ulong *ip, unsigned long old)
 {
-	int n, i;
-	char *fnum;
-	int err = 0;
-	int *idx = 0;
-	if(!*indices || idxsize == 0)
+	int k;
+
+	for(k = 0; k < BR_SPINS; k++)
 	{
-		*idxsize = nfields*2;
-		idx = g_new0(int, *idxsize);
-		*indices = idx;
-		*nidx = 0;
+		if(atomic_load(&br->stop))
+			return 0;
+		if(atomic_load(ip) != old)
+			return 1;
+		sched_yield();
 	}
+	pthread_mutex_lock(&br->lock);
+	atomic_fetch_add(&br->waiting, 1);
+	while(!atomic_load(&br->stop) && atomic_load(ip) == old)
+		pthread_cond_wait(&br->moved, &br->lock);
+	atomic_fetch_sub(&br->waiting, 1);
+	pthread_mutex_unlock(&br->lock);
+	return !atomic_load(&br->stop);
+}
 
-	fnum = strtok(list, ", \t");
-	i = 0;
-	while(fnum)
+/*
+ * Wake the other side if it is asleep in br_wait, after moving an index
+ * or setting stop.
+ */
+static void
+br_moved(BlockReader *br)
+{
+	if(atomic_load(&br->waiting) > 0)
 	{
-		if(*nidx >= *idxsize)
-		{
-			*idxsize *= 2;
-			idx = g_realloc(idx, (*idxsize) * sizeof(int));
-			*indices = idx;
-		}
-		n = atoi(fnum);
-		if(n < 0 || n >= nfields)
+		pthread_mutex_lock(&br->lock);
+		pthread_cond_broadcast(&br->moved);
+		pthread_mutex_unlock(&br->lock);
+	}
+}
+
+static void *
+br_thread(void *arg)
+{
+	BlockReader *br = arg;
+	unsigned long tail;
+	RowBlock *b;
+
+	tail = atomic_load_explicit(&br->tail, memory_order_relaxed);
+	for(;;)
+	{
+		/* wait for a free slot */
+		if(!br_wait(br, &br->head, tail - br->nslots))
+			return NULL;
+		b = &br->ring[tail % br->nslots];
+		br_fill(br, b);
+		atomic_store(&br->tail, ++tail);
+		br_moved(br);
+		if(b->type == RB_END && b->rc != -2)
+			return NULL;
+	}
+}
+#endif
+
+/*
+ * Set up to read sf in blocks, reading ahead on another thread if
+ * threaded is set and that is possible.  index may be NULL.
+ */
+BlockReader *
+br_open(SpiceStream *sf, int threaded, SSIndex *index,
+        double begin_val, double end_val)
+{
+	BlockReader *br;
+	RowBlock *b;
+	int i, k;
+
+	br = g_new0(BlockReader, 1);
+	br->sf = sf;
+	br->maxrows = block_rows(sf);
+	br->state = BR_START;
+	br->index = index;
+	br->begin_val = begin_val;
+	br->end_val = end_val;
+	br->nslots = 1;
+#ifdef SP2SP_THREADS
+	if(threaded)
+		br->nslots = BR_SLOTS;
+#endif
+	br->ring = g_new0(RowBlock, br->nslots);
+	for(k = 0; k < br->nslots; k++)
+	{
+		b = &br->ring[k];
+		b->ivals = g_new(double, br->maxrows);
+		b->dcols = g_new0(double *, sf->ncols);
+		for(i = 0; i < sf->ncols-1; i++)
 		{
-			fprintf(stderr, "bad field number in -n option: %s\n", fnum);
-			err = -1;
+			if(sf->colsel == NULL || sf->colsel[i])
+				b->dcols[i] = g_new(double, br->maxrows);
 		}
+		if(sf->nsweepparam > 0)
+			b->spar = g_new(double, sf->nsweepparam);
+	}
+#ifdef SP2SP_THREADS
+	atomic_init(&br->head, 0);
+	atomic_init(&br->tail, 0);
+	atomic_init(&br->stop, 0);
+	atomic_init(&br->waiting, 0);
+	if(threaded)
+	{
+		pthread_mutex_init(&br->lock, NULL);
+		pthread_cond_init(&br->moved, NULL);
+		if(pthread_create(&br->thread, NULL, br_thread, br) == 0)
+			br->threaded = 1;
 		else
 		{
-			idx[i++] = n;
-			(*nidx)++;
+			pthread_cond_destroy(&br->moved);
+			pthread_mutex_destroy(&br->lock);
 		}
-		fnum = strtok(NULL, ", \t");
 	}
-	return err;
+#endif
+	return br;
 }
 
-
 /*
- * Try looking for named dependent variable.  Try twice,
- * first as-is, then with "v(" prepended the way hspice mangles things.
+ * Return the next RowBlock.  It stays valid until the next call.
  */
-static int find_dv_by_name(char *name, SpiceStream *sf)
+RowBlock *
+br_next(BlockReader *br)
 {
-	int i;
-	for(i = 0; i < sf->ndv; i++)
-	{
-		if(strcasecmp(name, sf->dvar[i].name) == 0)
-			return i;
-	}
-	for(i = 0; i < sf->ndv; i++)
+#ifdef SP2SP_THREADS
+	unsigned long head;
+
+	if(br->threaded)
 	{
-		if(strncasecmp("v(", sf->dvar[i].name, 2) == 0
-		        && strcasecmp(name, &sf->dvar[i].name[2]) == 0)
-			return i;
+		head = atomic_load_explicit(&br->head, memory_order_relaxed);
+		if(br->held)
+		{
+			atomic_store(&br->head, ++head);
+			br_moved(br);
+		}
+		br_wait(br, &br->tail, head);
+		br->held = 1;
+		return &br->ring[head % br->nslots];
 	}
-	return -1;
+#endif
+	br_fill(br, &br->ring[0]);
+	return &br->ring[0];
 }
 
 /*
- * parse comma-seperated list of field names.  Turn on the output-enables
- * for the listed fields.
+ * Stop reading, and free the BlockReader.
  */
-static int parse_field_names(int **indices, int *idxsize, int *nidx, char *list, SpiceStream *sf)
+void
+br_close(BlockReader *br)
 {
-	int err = 0;
-	int n;
-	char *fld;
-	int i;
-	int *idx = 0;
+	RowBlock *b;
+	int i, k;
 
-	if(!*indices || idxsize == 0)
+#ifdef SP2SP_THREADS
+	if(br->threaded)
 	{
-		*idxsize = (sf->ndv+1)*2;
-		idx = g_new0(int, *idxsize);
-		*indices = idx;
-		*nidx = 0;
+		atomic_store(&br->stop, 1);
+		br_moved(br);
+		pthread_join(br->thread, NULL);
+		pthread_cond_destroy(&br->moved);
+		pthread_mutex_destroy(&br->lock);
+	}
+#endif
+	for(k = 0; k < br->nslots; k++)
+	{
+		b = &br->ring[k];
+		for(i = 0; i < br->sf->ncols-1; i++)
+			g_free(b->dcols[i]);
+		g_free(b->dcols);
+		g_free(b->ivals);
+		g_free(b->spar);
 	}
+	g_free(br->ring);
+	g_free(br);
+}
 
-	fld = strtok(list, ", \t");
-	i = 0;
-	while(fld)
+/*
+ * Format one line of output for row r at lp, and return the end of it.
+ * There must be room for linesize bytes, as worked out by ascii_data_output.
+ */
+static char *
+format_row(char *lp, SpiceStream *sf, int *indices, int nidx, int ndigits,
+           double *spar, double ival, double **dcols, int r)
+{
+	int i, j;
+
+	if((sf->nsweepparam > 0) && (sweep_mode == SWEEP_PREPEND))
 	{
-		if(*nidx >= *idxsize)
-		{
-			*idxsize *= 2;
-			idx = g_realloc(idx, (*idxsize) * sizeof(int));
-			*indices = idx;
-		}
-		if(strcasecmp(fld, sf->ivar->name)==0)
-		{
-			idx[i++] = 0;
-			(*nidx)++;
-		}
-		else if((n = find_dv_by_name(fld, sf)) >= 0)
+		for(i = 0; i < sf->nsweepparam; i++)
 		{
-			idx[i++] = n+1;
-			(*nidx)++;
+			lp += ss_fmtg(lp, spar[i], ndigits);
+			*lp++ = ' ';
 		}
+	}
+	for(i = 0; i < nidx; i++)
+	{
+		if(i > 0)
+			*lp++ = ' ';
+		if(indices[i] == 0)
+			lp += ss_fmtg(lp, ival, ndigits);
 		else
 		{
-			fprintf(stderr, "field name in -f option not found in file: %s\n", fld);
-			err = -1;
+			int varno = indices[i]-1;
+			int dcolno = sf->dvar[varno].col - 1;
+			for(j = 0; j < sf->dvar[varno].ncols; j++)
+			{
+				if(j > 0)
+					*lp++ = ' ';
+				lp += ss_fmtg(lp, dcols[dcolno+j][r], ndigits);
+			}
 		}
-		fld = strtok(NULL, ", \t");
 	}
-	return err;
+	*lp++ = '\n';
+	return lp;
 }
 
+#ifdef SP2SP_THREADS
+/*
+ * Parallel formatting: blocks of rows are copied into FmtJobs, which a
+ * pool of worker threads turn into text, each into its own buffer.
+ * The main thread writes the buffers out in the order that the jobs
+ * were queued.
+ */
+#define FJ_FREE 0
+#define FJ_QUEUED 1
+#define FJ_DONE 2
+
+typedef struct {
+	int state;
+	int nrows;
+	double *ivals;
+	double **dcols;
+	double *spar;	/* sweep parameters for these rows */
+	char *out;	/* the formatted text */
+	size_t outlen;
+	size_t outsize;
+} FmtJob;
 
-struct vtlistel
+typedef struct {
+	pthread_mutex_t lock;
+	pthread_cond_t work;	/* a job was queued, or it is time to quit */
+	pthread_cond_t done;	/* a job was finished */
+	pthread_t *threads;
+	int nthreads;
+	FmtJob *jobs;
+	int njobs;
+	long head;	/* oldest job not yet written */
+	long next;	/* next job for a worker to take */
+	long tail;	/* next job to queue */
+	int quit;
+
+	/* what ascii_data_output was asked to do */
+	SpiceStream *sf;
+	int *indices;
+	int nidx;
+	double begin_val;
+	double end_val;
+	int ndigits;
+	int linesize;
+} Formatter;
+
+static void
+fmt_job_run(Formatter *fm, FmtJob *job)
 {
-	VarType t;
-	char *s;
-};
-static struct vtlistel vtlist[] =
+	char *lp;
+	int r;
+
+	job->outlen = 0;
+	for(r = 0; r < job->nrows; r++)
+	{
+		/* rows past end_val were cut off when the job was queued,
+		   unless there are several tables */
+		if(job->ivals[r] < fm->begin_val || job->ivals[r] > fm->end_val)
+			continue;
+		if(job->outsize - job->outlen < fm->linesize)
+		{
+			job->outsize = 2 * job->outsize + fm->linesize;
+			job->out = g_realloc(job->out, job->outsize);
+		}
+		lp = format_row(job->out + job->outlen, fm->sf, fm->indices,
+				fm->nidx, fm->ndigits, job->spar,
+				job->ivals[r], job->dcols, r);
+		job->outlen = lp - job->out;
+	}
+}
+
+static void *
+fmt_thread(void *arg)
 {
-	{TIME, "time"},
-	{VOLTAGE, "volt"},
-	{VOLTAGE, "volts"},
-	{VOLTAGE, "voltage"},
-	{CURRENT, "current"},
-	{CURRENT, "amps"},
-	{FREQUENCY, "freq"},
-	{FREQUENCY, "frequency"},
-	{FREQUENCY, "hertz"},
-	{UNKNOWN, NULL},
-};
+	Formatter *fm = arg;
+	FmtJob *job;
+
+	pthread_mutex_lock(&fm->lock);
+	for(;;)
+	{
+		while(!fm->quit && fm->next == fm->tail)
+			pthread_cond_wait(&fm->work, &fm->lock);
+		if(fm->quit)
+			break;
+		job = &fm->jobs[fm->next++ % fm->njobs];
+		pthread_mutex_unlock(&fm->lock);
+
+		fmt_job_run(fm, job);
+
+		pthread_mutex_lock(&fm->lock);
+		job->state = FJ_DONE;
+		pthread_cond_broadcast(&fm->done);
+	}
+	pthread_mutex_unlock(&fm->lock);
+	return NULL;
+}
 
 /*
- * Given a variable type name, return a numeric VarType.
- * Returns 0 (UNKNOWN) if no match.
+ * Write out finished jobs in order, waiting for them if wait is set,
+ * until there are no more than keep jobs left outstanding.
  */
-static VarType get_vartype_code(char *vartype)
+static void
+fmt_write(Formatter *fm, OutSink *os, int keep)
 {
-	int i;
-	for(i = 0; vtlist[i].s; i++)
+	FmtJob *job;
+
+	pthread_mutex_lock(&fm->lock);
+	while(fm->tail - fm->head > keep)
 	{
-		if(strcasecmp(vartype, vtlist[i].s) == 0)
-			return vtlist[i].t;
+		job = &fm->jobs[fm->head % fm->njobs];
+		while(job->state != FJ_DONE)
+			pthread_cond_wait(&fm->done, &fm->lock);
+		pthread_mutex_unlock(&fm->lock);
+		out_write(os, job->out, job->outlen);
+		pthread_mutex_lock(&fm->lock);
+		job->state = FJ_FREE;
+		fm->head++;
+	}
+	pthread_mutex_unlock(&fm->lock);
+}
+
+/*
+ * Queue the first nrows rows of b, with sweep parameters spar, for
+ * formatting.  Writes out earlier jobs first if they are all in use.
+ */
+static void
+fmt_queue(Formatter *fm, OutSink *os, RowBlock *b, int nrows, double *spar)
+{
+	SpiceStream *sf = fm->sf;
+	FmtJob *job;
+	int i;
+
+	fmt_write(fm, os, fm->njobs - 1);
+	job = &fm->jobs[fm->tail % fm->njobs];
+	job->nrows = nrows;
+	memcpy(job->ivals, b->ivals, nrows * sizeof(double));
+	for(i = 0; i < sf->ncols-1; i++)
+	{
+		if(job->dcols[i])
+			memcpy(job->dcols[i], b->dcols[i], nrows * sizeof(double));
+	}
+	if(sf->nsweepparam > 0)
+		memcpy(job->spar, spar, sf->nsweepparam * sizeof(double));
+
+	pthread_mutex_lock(&fm->lock);
+	job->state = FJ_QUEUED;
+	fm->tail++;
+	pthread_cond_signal(&fm->work);
+	pthread_mutex_unlock(&fm->lock);
+}
+
+/*
+ * Start nthreads formatting threads.  Returns NULL if none could be
+ * started.
+ */
+static Formatter *
+fmt_start(SpiceStream *sf, int *indices, int nidx, double begin_val,
+          double end_val, int ndigits, int linesize, int maxrows, int nthreads)
+{
+	Formatter *fm;
+	FmtJob *job;
+	int i, k;
+
+	fm = g_new0(Formatter, 1);
+	fm->sf = sf;
+	fm->indices = indices;
+	fm->nidx = nidx;
+	fm->begin_val = begin_val;
+	fm->end_val = end_val;
+	fm->ndigits = ndigits;
+	fm->linesize = linesize;
+	fm->njobs = 2 * nthreads;
+	fm->jobs = g_new0(FmtJob, fm->njobs);
+	for(k = 0; k < fm->njobs; k++)
+	{
+		job = &fm->jobs[k];
+		job->ivals = g_new(double, maxrows);
+		job->dcols = g_new0(double *, sf->ncols);
+		for(i = 0; i < sf->ncols-1; i++)
+		{
+			if(sf->colsel == NULL || sf->colsel[i])
+				job->dcols[i] = g_new(double, maxrows);
+		}
+		if(sf->nsweepparam > 0)
+			job->spar = g_new(double, sf->nsweepparam);
+	}
+	pthread_mutex_init(&fm->lock, NULL);
+	pthread_cond_init(&fm->work, NULL);
+	pthread_cond_init(&fm->done, NULL);
+	fm->threads = g_new(pthread_t, nthreads);
+	for(fm->nthreads = 0; fm->nthreads < nthreads; fm->nthreads++)
+	{
+		if(pthread_create(&fm->threads[fm->nthreads], NULL,
+				  fmt_thread, fm) != 0)
+			break;
+	}
+	return fm;
+}
+
+/*
+ * Stop the formatting threads and free everything.  Jobs not yet
+ * written are dropped.
+ */
+static void
+fmt_finish(Formatter *fm)
+{
+	FmtJob *job;
+	int i, k;
+
+	pthread_mutex_lock(&fm->lock);
+	fm->quit = 1;
+	pthread_cond_broadcast(&fm->work);
+	pthread_mutex_unlock(&fm->lock);
+	for(i = 0; i < fm->nthreads; i++)
+		pthread_join(fm->threads[i], NULL);
+	pthread_mutex_destroy(&fm->lock);
+	pthread_cond_destroy(&fm->work);
+	pthread_cond_destroy(&fm->done);
+	for(k = 0; k < fm->njobs; k++)
+	{
+		job = &fm->jobs[k];
+		for(i = 0; i < fm->sf->ncols-1; i++)
+			g_free(job->dcols[i]);
+		g_free(job->dcols);
+		g_free(job->ivals);
+		g_free(job->spar);
+		g_free(job->out);
+	}
+	g_free(fm->jobs);
+	g_free(fm->threads);
+	g_free(fm);
+}
+#endif
+
+/*
+ * print data as space-seperated columns.
+ * With nthreads > 1, the input is read on a separate thread, and
+ * the text is formatted on nthreads more.
+ * If index isn't NULL, it is used to skip over rows outside of
+ * begin_val to end_val instead of reading them.
+ */
+static void
+ascii_data_output(OutSink *os, SpiceStream *sf, int *indices, int nidx,
+                  SSIndex *index, double begin_val, double end_val,
+                  int ndigits, int nthreads)
+{
+	int i, r, tab;
+	double ival;
+	double *spar = NULL;
+	int done;
+	char *lp;
+	int linesize;
+	int nrows;
+	BlockReader *br;
+	RowBlock *b;
+#ifdef SP2SP_THREADS
+	Formatter *fm = NULL;
+#endif
+
+	/* each line is formatted with ss_fmtg straight into the output
+	 * buffer; this is the most room that it can take. */
+	linesize = sf->nsweepparam + 1;
+	for(i = 0; i < nidx; i++)
+		linesize += (indices[i] == 0) ? 1 : sf->dvar[indices[i]-1].ncols;
+	linesize *= ndigits + 32;
+	if(sf->nsweepparam > 0)
+		spar = g_new(double, sf->nsweepparam);
+
+	br = br_open(sf, nthreads > 1, index, begin_val, end_val);
+#ifdef SP2SP_THREADS
+	if(nthreads > 1)
+	{
+		fm = fmt_start(sf, indices, nidx, begin_val, end_val, ndigits,
+			       linesize, br->maxrows, nthreads);
+		if(fm->nthreads == 0)
+		{
+			fmt_finish(fm);
+			fm = NULL;
+		}
+	}
+#endif
+	done = 0;
+	tab = 0;
+	while(!done)
+	{
+		b = br_next(br);
+		switch(b->type)
+		{
+		case RB_SWEEP:
+			memcpy(spar, b->spar, sf->nsweepparam * sizeof(double));
+			if(tab > 0 && sweep_mode == SWEEP_HEAD)
+			{
+#ifdef SP2SP_THREADS
+				if(fm)
+					fmt_write(fm, os, 0);
+#endif
+				out_printf(os, "# sweep %d;", tab);
+				for(i = 0; i < sf->nsweepparam; i++)
+				{
+					out_printf(os, " %s=%g", sf->spar[i].name, spar[i]);
+				}
+				out_putc(os, '\n');
+			}
+			break;
+
+		case RB_END:
+			if(b->rc == -2)    /* end of sweep, more follow */
+			{
+				tab++;
+				if(sf->nsweepparam == 0)
+				{
+#ifdef SP2SP_THREADS
+					if(fm)
+						fmt_write(fm, os, 0);
+#endif
+					sweep_mode = SWEEP_HEAD;
+					out_printf(os, "# sweep %d;\n", tab);
+				}
+			}
+			else    	/* EOF or error */
+			{
+				done = 1;
+			}
+			break;
+
+		case RB_ROWS:
+			nrows = b->nrows;
+			if(sf->ntables == 1)
+			{
+				/* past end_val, but can only stop reading
+				   early if if there is only one sweep-table
+				   in the file. */
+				for(r = 0; r < nrows; r++)
+				{
+					if(b->ivals[r] > end_val)
+					{
+						nrows = r;
+						done = 1;
+						break;
+					}
+				}
+			}
+#ifdef SP2SP_THREADS
+			if(fm)
+			{
+				fmt_queue(fm, os, b, nrows, spar);
+				break;
+			}
+#endif
+			for(r = 0; r < nrows; r++)
+			{
+				ival = b->ivals[r];
+				if(ival < begin_val || ival > end_val)
+					continue;
+				lp = out_room(os, linesize);
+				lp = format_row(lp, sf, indices, nidx, ndigits,
+						spar, ival, b->dcols, r);
+				out_commit(os, lp);
+			}
+			break;
+		}
+	}
+#ifdef SP2SP_THREADS
+	if(fm)
+	{
+		fmt_write(fm, os, 0);
+		fmt_finish(fm);
+	}
+#endif
+	br_close(br);
+	if(spar)
+		g_free(spar);
+}
+
+/*
+ * Spice3 binary rawfile output: a header that lists the variables,
+ * then each row as native doubles, in a single plot.  The independent
+ * variable always comes first, as readers expect, whether or not it was
+ * selected.  If any selected variable has two columns the plot is
+ * complex, and every value is written as a real, imaginary pair.  The
+ * tables of a swept file follow one another in the plot; with -s prepend
+ * the sweep parameters are written as variables after the independent
+ * variable.
+ *
+ * "No. Points:" comes before the data, so the count is filled in
+ * afterwards, with out_patch, or the data is spooled.
+ */
+#define S3RAW_NPOINTS_WIDTH 20
+
+static char *
+s3raw_typename(VarType type)
+{
+	switch(type)
+	{
+	case TIME:
+		return "time";
+	case VOLTAGE:
+		return "voltage";
+	case CURRENT:
+		return "current";
+	case FREQUENCY:
+		return "frequency";
+	default:
+		return "notype";
+	}
+}
+
+/*
+ * Write one line of the "Variables:" section.  Names can't have
+ * whitespace in them, since readers split the line on it.
+ */
+static void
+s3raw_var_output(OutSink *os, int n, char *name, VarType type)
+{
+	char *p;
+
+	out_printf(os, "\t%d\t", n);
+	for(p = name; *p; p++)
+		out_putc(os, isspace((unsigned char) *p) ? '_' : *p);
+	out_printf(os, "\t%s\n", s3raw_typename(type));
+}
+
+/*
+ * Write the header, up to and including "Binary:".  If nposp isn't NULL,
+ * the count of points is left blank, and its file offset is stored in
+ * *nposp.
+ */
+static void
+s3raw_header_output(OutSink *os, SpiceStream *sf, int *indices, int nidx,
+                    int cplx, int nvars, long npoints, off_t *nposp)
+{
+	char buf[1024];
+	char *plotname;
+	int i, j, n;
+
+	if(sf->ivar->type == TIME)
+		plotname = "Transient Analysis";
+	else if(sf->ivar->type == FREQUENCY)
+		plotname = "AC Analysis";
+	else
+		plotname = "DC transfer characteristic";
+	out_printf(os, "Title: converted with sp2sp from %s\n", sf->filename);
+	out_printf(os, "Plotname: %s\n", plotname);
+	out_printf(os, "Flags: %s\n", cplx ? "complex" : "real");
+	out_printf(os, "No. Variables: %d\n", nvars);
+	out_puts(os, "No. Points: ");
+	if(nposp)
+	{
+		*nposp = out_tell(os);
+		out_printf(os, "%-*s\n", S3RAW_NPOINTS_WIDTH, "0");
+	}
+	else
+		out_printf(os, "%-*ld\n", S3RAW_NPOINTS_WIDTH, npoints);
+	out_puts(os, "Variables:\n");
+
+	n = 0;
+	s3raw_var_output(os, n++, sf->ivar->name, sf->ivar->type);
+	if(sf->nsweepparam > 0 && sweep_mode == SWEEP_PREPEND)
+	{
+		for(i = 0; i < sf->nsweepparam; i++)
+			s3raw_var_output(os, n++, sf->spar[i].name, sf->spar[i].type);
+	}
+	for(i = 0; i < nidx; i++)
+	{
+		SpiceVar *dv;
+
+		if(indices[i] == 0)
+			continue;
+		dv = &sf->dvar[indices[i]-1];
+		if(cplx && dv->ncols == 2)
+			s3raw_var_output(os, n++, dv->name, dv->type);
+		else
+		{
+			for(j = 0; j < dv->ncols; j++)
+			{
+				ss_var_name(dv, j, buf, 1024);
+				s3raw_var_output(os, n++, buf, dv->type);
+			}
+		}
+	}
+	out_puts(os, "Binary:\n");
+}
+
+static void
+s3raw_output(OutSink *os, SpiceStream *sf, int *indices, int nidx,
+             SSIndex *index, double begin_val, double end_val, int nthreads)
+{
+	int i, j, k, r;
+	int cplx, nvars, nvals;
+	int nspar;
+	double ival;
+	double *spar = NULL;
+	double *row;
+	long npoints;
+	off_t npos;
+	OutSink *ds;	/* where the data goes */
+	OutSink *ts;
+	int done;
+	int nrows;
+	BlockReader *br;
+	RowBlock *b;
+	char buf[S3RAW_NPOINTS_WIDTH + 1];
+
+	nspar = (sweep_mode == SWEEP_PREPEND) ? sf->nsweepparam : 0;
+	cplx = 0;
+	nvars = 1 + nspar;
+	for(i = 0; i < nidx; i++)
+	{
+		if(indices[i] > 0 && sf->dvar[indices[i]-1].ncols == 2)
+			cplx = 1;
+	}
+	for(i = 0; i < nidx; i++)
+	{
+		if(indices[i] == 0)
+			continue;
+		j = sf->dvar[indices[i]-1].ncols;
+		nvars += (cplx && j == 2) ? 1 : j;
+	}
+	nvals = cplx ? 2 * nvars : nvars;
+	row = g_new0(double, nvals);
+	if(sf->nsweepparam > 0)
+		spar = g_new0(double, sf->nsweepparam);
+
+	ts = out_spool_open(os);
+	ds = ts ? ts : os;
+	if(!ts)
+		s3raw_header_output(os, sf, indices, nidx, cplx, nvars, 0, &npos);
+
+	br = br_open(sf, nthreads > 1, index, begin_val, end_val);
+	npoints = 0;
+	done = 0;
+	while(!done)
+	{
+		b = br_next(br);
+		switch(b->type)
+		{
+		case RB_SWEEP:
+			memcpy(spar, b->spar, sf->nsweepparam * sizeof(double));
+			break;
+
+		case RB_END:
+			if(b->rc != -2)
+				done = 1;
+			break;
+
+		case RB_ROWS:
+			nrows = b->nrows;
+			for(r = 0; r < nrows; r++)
+			{
+				ival = b->ivals[r];
+				if(ival > end_val && sf->ntables == 1)
+				{
+					done = 1;
+					break;
+				}
+				if(ival < begin_val || ival > end_val)
+					continue;
+				k = 0;
+				row[k] = ival;
+				k += cplx ? 2 : 1;
+				for(i = 0; i < nspar; i++)
+				{
+					row[k] = spar[i];
+					k += cplx ? 2 : 1;
+				}
+				for(i = 0; i < nidx; i++)
+				{
+					SpiceVar *dv;
+					int dcolno;
+
+					if(indices[i] == 0)
+						continue;
+					dv = &sf->dvar[indices[i]-1];
+					dcolno = dv->col - 1;
+					if(cplx && dv->ncols == 2)
+					{
+						row[k++] = b->dcols[dcolno][r];
+						row[k++] = b->dcols[dcolno+1][r];
+						continue;
+					}
+					for(j = 0; j < dv->ncols; j++)
+					{
+						row[k] = b->dcols[dcolno+j][r];
+						k += cplx ? 2 : 1;
+					}
+				}
+				out_write(ds, (char *) row, nvals * sizeof(double));
+				npoints++;
+			}
+			break;
+		}
+	}
+	br_close(br);
+
+	if(ts)
+	{
+		s3raw_header_output(os, sf, indices, nidx, cplx, nvars, npoints, NULL);
+		out_spool_copy(os, ts);
+	}
+	else
+	{
+		snprintf(buf, sizeof(buf), "%-*ld", S3RAW_NPOINTS_WIDTH, npoints);
+		out_patch(os, npos, buf, S3RAW_NPOINTS_WIDTH);
+	}
+	g_free(row);
+	if(spar)
+		g_free(spar);
+}
+
+/*
+ * HSPICE binary output, post format 9601: a block holding an ascii
+ * header with the types and names of the variables, then blocks of
+ * 32-bit floats.  Each table is its sweep parameter values, its rows,
+ * and 1.0e30 to end it.  A block is framed by four int32s, the last of
+ * them the size of the body in bytes, and by that size again after it.
+ *
+ * Only frequency-domain files have complex variables, and they must be
+ * the first after the independent variable, so they are moved there.
+ * In other files, a variable with two columns becomes a variable for
+ * each.  The header gives the number of tables, which is filled in at
+ * the end, as for spice3raw.  Sweep parameters are left out with -s none.
+ */
+#define HSB_BLOCKVALS 65536	/* floats in each data block */
+#define HSB_TABLES_POS 176	/* header offsets read by sf_rdhdr_hsbin */
+#define HSB_NAMES_POS 256
+#define HSB_TABLES_WIDTH 10
+
+typedef struct {
+	OutSink *os;
+	float *vals;
+	int n;
+} HsbOut;
+
+static void
+hsb_block_output(OutSink *os, const char *body, int nbytes)
+{
+	gint32 hdr[4];
+
+	hdr[0] = 4;
+	hdr[1] = nbytes / sizeof(float);
+	hdr[2] = 4;
+	hdr[3] = nbytes;
+	out_write(os, (char *) hdr, sizeof(hdr));
+	out_write(os, body, nbytes);
+	out_write(os, (char *) &hdr[3], sizeof(gint32));
+}
+
+static void
+hsb_flush(HsbOut *h)
+{
+	if(h->n > 0)
+		hsb_block_output(h->os, (char *) h->vals, h->n * sizeof(float));
+	h->n = 0;
+}
+
+#define hsb_put(h, v) \
+	do { if((h)->n == HSB_BLOCKVALS) hsb_flush(h); \
+	     (h)->vals[(h)->n++] = (v); } while(0)
+
+static int
+hsb_typecode(VarType type)
+{
+	return (type == CURRENT) ? 8 : 1;
+}
+
+/*
+ * Append a name to the header at *pp, with whitespace, which would end
+ * it early, changed to '_'.
+ */
+static void
+hsb_name_output(char **pp, char *name)
+{
+	char *p = *pp;
+
+	for(; *name; name++)
+		*p++ = isspace((unsigned char) *name) ? '_' : *name;
+	*p++ = ' ';
+	*pp = p;
+}
+
+/*
+ * Write the header block.  If tposp isn't NULL, the number of tables is
+ * left blank, and its file offset is stored in *tposp.
+ */
+static void
+hsb_header_output(OutSink *os, SpiceStream *sf, SpiceVar **cvars, int ncv,
+                  SpiceVar **pvars, int *pcols, int npc, int nsp,
+                  int ntables, off_t *tposp)
+{
+	char buf[1024];
+	char *hdr, *p;
+	size_t size;
+	int i;
+
+	size = HSB_NAMES_POS + 16;
+	size += 4 + strlen(sf->ivar->name) + 1;
+	for(i = 0; i < ncv; i++)
+		size += 4 + strlen(cvars[i]->name) + 1;
+	for(i = 0; i < npc; i++)
+		size += 4 + strlen(pvars[i]->name) + 4;
+	for(i = 0; i < nsp; i++)
+		size += strlen(sf->spar[i].name) + 1;
+	hdr = g_new(char, size);
+	memset(hdr, ' ', HSB_NAMES_POS);
+
+	sprintf(buf, "%04d%04d%04d0000", ncv + 1, npc, nsp);
+	memcpy(hdr, buf, 16);
+	memcpy(hdr + 16, "9601", 4);
+	snprintf(buf, 65, "converted with sp2sp from %s", sf->filename);
+	memcpy(hdr + 24, buf, strlen(buf));
+	sprintf(buf, "%-*d", HSB_TABLES_WIDTH, ntables);
+	memcpy(hdr + HSB_TABLES_POS, buf, HSB_TABLES_WIDTH);
+
+	p = hdr + HSB_NAMES_POS;
+	if(sf->ivar->type == TIME)
+		i = 1;
+	else if(sf->ivar->type == FREQUENCY)
+		i = 2;
+	else
+		i = 3;
+	p += sprintf(p, "%d ", i);
+	for(i = 0; i < ncv; i++)
+		p += sprintf(p, "%d ", hsb_typecode(cvars[i]->type));
+	for(i = 0; i < npc; i++)
+		p += sprintf(p, "%d ", hsb_typecode(pvars[i]->type));
+	hsb_name_output(&p, sf->ivar->name);
+	for(i = 0; i < ncv; i++)
+		hsb_name_output(&p, cvars[i]->name);
+	for(i = 0; i < npc; i++)
+	{
+		if(pvars[i]->ncols == 1)
+			hsb_name_output(&p, pvars[i]->name);
+		else
+		{
+			ss_var_name(pvars[i], pcols[i], buf, 1024);
+			hsb_name_output(&p, buf);
+		}
+	}
+	for(i = 0; i < nsp; i++)
+		hsb_name_output(&p, sf->spar[i].name);
+	memcpy(p, "$&%#", 4);
+	p += 4;
+	while((p - hdr) % sizeof(float))
+		*p++ = ' ';
+
+	if(tposp)
+		*tposp = out_tell(os) + 16 + HSB_TABLES_POS;
+	hsb_block_output(os, hdr, p - hdr);
+	g_free(hdr);
+}
+
+static void
+hsbin_output(OutSink *os, SpiceStream *sf, int *indices, int nidx,
+             SSIndex *index, double begin_val, double end_val, int nthreads)
+{
+	int i, j, r;
+	SpiceVar **cvars;	/* complex variables */
+	SpiceVar **pvars;	/* variable for each other column */
+	int *pcols;	/* and which of its columns */
+	int ncv, npc, nsp;
+	int ntables, intable;
+	double ival;
+	off_t tpos;
+	HsbOut h;
+	OutSink *ts;
+	int done;
+	BlockReader *br;
+	RowBlock *b;
+	char buf[HSB_TABLES_WIDTH + 1];
+
+	cvars = g_new(SpiceVar *, nidx);
+	ncv = 0;
+	npc = 0;
+	for(i = 0; i < nidx; i++)
+	{
+		SpiceVar *dv;
+
+		if(indices[i] == 0)
+			continue;
+		dv = &sf->dvar[indices[i]-1];
+		if(dv->ncols == 2 && sf->ivar->type == FREQUENCY)
+			cvars[ncv++] = dv;
+		else
+			npc += dv->ncols;
+	}
+	pvars = g_new(SpiceVar *, npc + 1);
+	pcols = g_new(int, npc + 1);
+	npc = 0;
+	for(i = 0; i < nidx; i++)
+	{
+		SpiceVar *dv;
+
+		if(indices[i] == 0)
+			continue;
+		dv = &sf->dvar[indices[i]-1];
+		if(dv->ncols == 2 && sf->ivar->type == FREQUENCY)
+			continue;
+		for(j = 0; j < dv->ncols; j++)
+		{
+			pvars[npc] = dv;
+			pcols[npc++] = j;
+		}
+	}
+	nsp = (sweep_mode == SWEEP_NONE) ? 0 : sf->nsweepparam;
+	if(ncv + 1 > 9999 || npc > 9999)
+	{
+		fprintf(stderr, "%s: too many variables for HSPICE format\n",
+			progname);
+		exit(1);
+	}
+
+	ts = out_spool_open(os);
+	h.os = ts ? ts : os;
+	h.vals = g_new(float, HSB_BLOCKVALS);
+	h.n = 0;
+	if(!ts)
+		hsb_header_output(os, sf, cvars, ncv, pvars, pcols, npc, nsp,
+				  0, &tpos);
+
+	br = br_open(sf, nthreads > 1, index, begin_val, end_val);
+	ntables = 0;
+	intable = 0;
+	done = 0;
+	while(!done)
+	{
+		b = br_next(br);
+		switch(b->type)
+		{
+		case RB_SWEEP:
+			intable = 1;
+			for(i = 0; i < nsp; i++)
+				hsb_put(&h, b->spar[i]);
+			break;
+
+		case RB_END:
+			if(b->rc != -2)
+				done = 1;
+			/* each table ends with one, unless there was EOF
+			   where its sweep parameters should have been */
+			if(intable || sf->nsweepparam == 0)
+			{
+				hsb_put(&h, 1.0e30);
+				ntables++;
+			}
+			intable = 0;
+			break;
+
+		case RB_ROWS:
+			intable = 1;
+			for(r = 0; r < b->nrows; r++)
+			{
+				ival = b->ivals[r];
+				if(ival > end_val && sf->ntables == 1)
+				{
+					hsb_put(&h, 1.0e30);
+					ntables++;
+					done = 1;
+					break;
+				}
+				if(ival < begin_val || ival > end_val)
+					continue;
+				hsb_put(&h, ival);
+				for(i = 0; i < ncv; i++)
+				{
+					j = cvars[i]->col - 1;
+					hsb_put(&h, b->dcols[j][r]);
+					hsb_put(&h, b->dcols[j+1][r]);
+				}
+				for(i = 0; i < npc; i++)
+					hsb_put(&h, b->dcols[pvars[i]->col - 1 + pcols[i]][r]);
+			}
+			break;
+		}
+	}
+	br_close(br);
+	hsb_flush(&h);
+
+	if(ts)
+	{
+		hsb_header_output(os, sf, cvars, ncv, pvars, pcols, npc, nsp,
+				  ntables, NULL);
+		out_spool_copy(os, ts);
+	}
+	else
+	{
+		sprintf(buf, "%-*d", HSB_TABLES_WIDTH, ntables);
+		out_patch(os, tpos, buf, HSB_TABLES_WIDTH);
+	}
+	g_free(h.vals);
+	g_free(cvars);
+	g_free(pvars);
+	g_free(pcols);
+}
+
+/*
+ * Columnar cache output, as read by ss_spc.c; see ss_spc.h.  Each table
+ * is gathered a chunk of rows at a time, column by column, and written
+ * out a page-aligned chunk at a time.  The offsets of the chunks, the
+ * sweep parameters and the min and max of every column of every table
+ * go into the directory at the end, so nothing has to be filled in
+ * afterwards and the file can go to a pipe.  A column of a chunk of
+ * SPC_CHUNKROWS rows is a whole number of pages, so wf_read can map the
+ * columns in place; only very wide files get smaller chunks, to bound
+ * the memory used here.
+ * Sweep parameters are left out with -s none.
+ */
+#define SPC_CHUNKROWS 8192
+#define SPC_MAXCHUNK (64 << 20)	/* bytes in a chunk at most, if that's less */
+
+static void
+spc_write(SpcOut *s, const void *p, size_t n)
+{
+	out_write(s->os, p, n);
+	s->pos += n;
+}
+
+/*
+ * Write zeros up to the next multiple of align.
+ */
+static void
+spc_pad(SpcOut *s, int align)
+{
+	static const char zeros[SPC_PAGESIZE];
+
+	spc_write(s, zeros, SPC_PADLEN(s->pos, align));
+}
+
+static void
+spc_chunk_output(SpcOut *s)
+{
+	int c;
+
+	if(s->n == 0)
+		return;
+	spc_pad(s, SPC_PAGESIZE);
+	if(s->nchunks == s->chunkoffsize)
+	{
+		s->chunkoffsize = s->chunkoffsize ? 2 * s->chunkoffsize : 64;
+		s->chunkoff = g_realloc(s->chunkoff, s->chunkoffsize * sizeof(long long));
+	}
+	s->chunkoff[s->nchunks++] = s->pos;
+	for(c = 0; c < s->ncols; c++)
+		spc_write(s, s->vals + (size_t) c * s->chunkrows, s->n * sizeof(double));
+	s->n = 0;
+}
+
+/*
+ * Set up to gather the selected variables of sf, and the sweep
+ * parameters unless they're left out, into chunks written to os.
+ */
+void
+spc_open(SpcOut *s, OutSink *os, SpiceStream *sf, int *indices, int nidx)
+{
+	int i, j;
+
+	memset(s, 0, sizeof(*s));
+	s->os = os;
+	s->sf = sf;
+	s->nsp = (sweep_mode == SWEEP_NONE) ? 0 : sf->nsweepparam;
+	s->dvars = g_new(SpiceVar *, nidx);
+	s->dcols = g_new(int, sf->ncols + nidx);
+	s->ncols = 1;
+	s->dcols[0] = -1;
+	for(i = 0; i < nidx; i++)
+	{
+		if(indices[i] == 0)
+			continue;
+		s->dvars[s->ndv] = &sf->dvar[indices[i]-1];
+		for(j = 0; j < s->dvars[s->ndv]->ncols; j++)
+			s->dcols[s->ncols++] = s->dvars[s->ndv]->col - 1 + j;
+		s->ndv++;
+	}
+	s->chunkrows = SPC_CHUNKROWS;
+	if((size_t) s->chunkrows * s->ncols * sizeof(double) > SPC_MAXCHUNK)
+	{
+		s->chunkrows = SPC_MAXCHUNK / (s->ncols * sizeof(double));
+		if(s->chunkrows < 1)
+			s->chunkrows = 1;
+	}
+	s->vals = g_new(double, (size_t) s->chunkrows * s->ncols);
+}
+
+void
+spc_free(SpcOut *s)
+{
+	g_free(s->vals);
+	g_free(s->chunkoff);
+	g_free(s->tables);
+	g_free(s->swvals);
+	g_free(s->minmax);
+	g_free(s->dvars);
+	g_free(s->dcols);
+}
+
+/*
+ * Finish a table of nrows rows, with sweep parameters spar and column
+ * minima and maxima in minmax, which are then reset.
+ */
+static void
+spc_end_table(SpcOut *s, long long nrows, int sorted, double *spar,
+              double *minmax)
+{
+	SpcTable *tp;
+	int c;
+
+	spc_chunk_output(s);
+	if(s->ntables == s->tablesize)
+	{
+		s->tablesize = s->tablesize ? 2 * s->tablesize : 16;
+		s->tables = g_realloc(s->tables, s->tablesize * sizeof(SpcTable));
+		s->swvals = g_realloc(s->swvals, s->tablesize * (s->nsp + 1) * sizeof(double));
+		s->minmax = g_realloc(s->minmax, s->tablesize * 2 * s->ncols * sizeof(double));
+	}
+	tp = &s->tables[s->ntables];
+	tp->nrows = nrows;
+	tp->firstchunk = s->nchunks - (nrows + s->chunkrows - 1) / s->chunkrows;
+	tp->sorted = sorted;
+	tp->pad = 0;
+	memcpy(&s->swvals[s->ntables * s->nsp], spar, s->nsp * sizeof(double));
+	memcpy(&s->minmax[s->ntables * 2 * s->ncols], minmax,
+	       2 * s->ncols * sizeof(double));
+	s->ntables++;
+	for(c = 0; c < s->ncols; c++)
+	{
+		minmax[2*c] = DBL_MAX;
+		minmax[2*c+1] = -DBL_MAX;
+	}
+}
+
+/*
+ * Read the rows from begin_val to end_val of each table, into chunks.
+ */
+void
+spc_gather(SpcOut *s, SSIndex *index, double begin_val, double end_val,
+           int nthreads)
+{
+	SpiceStream *sf = s->sf;
+	double *spar;	/* sweep parameters of this table */
+	double *minmax;	/* of each column of this table */
+	double ival, v, last_ival;
+	long long nrows;
+	int sorted, intable, done;
+	int c, r;
+	BlockReader *br;
+	RowBlock *b;
+
+	spar = g_new0(double, sf->nsweepparam + 1);
+	minmax = g_new(double, 2 * s->ncols);
+	for(c = 0; c < s->ncols; c++)
+	{
+		minmax[2*c] = DBL_MAX;
+		minmax[2*c+1] = -DBL_MAX;
+	}
+	intable = 0;
+	nrows = 0;
+	sorted = 1;
+	last_ival = 0;
+
+	br = br_open(sf, nthreads > 1, index, begin_val, end_val);
+	done = 0;
+	while(!done)
+	{
+		b = br_next(br);
+		if(b->type == RB_SWEEP)
+		{
+			intable = 1;
+			memcpy(spar, b->spar, sf->nsweepparam * sizeof(double));
+			continue;
+		}
+		if(b->type == RB_ROWS)
+		{
+			intable = 1;
+			for(r = 0; r < b->nrows; r++)
+			{
+				ival = b->ivals[r];
+				if(ival > end_val && sf->ntables == 1)
+				{
+					done = 1;
+					break;
+				}
+				if(ival < begin_val || ival > end_val)
+					continue;
+				if(nrows > 0 && ival < last_ival)
+					sorted = 0;
+				last_ival = ival;
+				for(c = 0; c < s->ncols; c++)
+				{
+					v = (c == 0) ? ival : b->dcols[s->dcols[c]][r];
+					s->vals[(size_t) c * s->chunkrows + s->n] = v;
+					if(v < minmax[2*c])
+						minmax[2*c] = v;
+					if(v > minmax[2*c+1])
+						minmax[2*c+1] = v;
+				}
+				nrows++;
+				if(++s->n == s->chunkrows)
+					spc_chunk_output(s);
+			}
+			if(!done)
+				continue;
+		}
+		else
+		{
+			if(b->rc != -2)
+				done = 1;
+			/* as for hsbinary, a table cut short by EOF before
+			   its sweep parameters isn't one */
+			if(!intable && sf->nsweepparam > 0)
+				continue;
+		}
+
+		spc_end_table(s, nrows, sorted, spar, minmax);
+		intable = 0;
+		nrows = 0;
+		sorted = 1;
+	}
+	br_close(br);
+	g_free(spar);
+	g_free(minmax);
+}
+
+static void
+spc_var_output(SpcOut *s, SpiceVar *sv)
+{
+	static const char zeros[8];
+	SpcVarHdr vh;
+
+	vh.type = sv->type;
+	vh.ncols = sv->ncols;
+	vh.namelen = strlen(sv->name);
+	vh.pad = 0;
+	spc_write(s, &vh, sizeof(vh));
+	spc_write(s, sv->name, vh.namelen);
+	spc_write(s, zeros, SPC_PADLEN(vh.namelen, 8));
+}
+
+static void
+spc_output(OutSink *os, SpiceStream *sf, int *indices, int nidx,
+           SSIndex *index, double begin_val, double end_val, int nthreads)
+{
+	SpcOut s;
+	SpcHeader hdr;
+	SpcTrailer tr;
+	int i, n;
+
+	spc_open(&s, os, sf, indices, nidx);
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, SPC_MAGIC, 8);
+	hdr.version = SPC_VERSION;
+	hdr.byteorder = SPC_BYTEORDER;
+	hdr.ndv = s.ndv;
+	hdr.ncols = s.ncols;
+	hdr.nsweepparam = s.nsp;
+	hdr.chunkrows = s.chunkrows;
+	n = strlen(sf->ivar->name);
+	hdr.varsize = sizeof(SpcVarHdr) + n + SPC_PADLEN(n, 8);
+	for(i = 0; i < s.ndv; i++)
+	{
+		n = strlen(s.dvars[i]->name);
+		hdr.varsize += sizeof(SpcVarHdr) + n + SPC_PADLEN(n, 8);
+	}
+	for(i = 0; i < s.nsp; i++)
+	{
+		n = strlen(sf->spar[i].name);
+		hdr.varsize += sizeof(SpcVarHdr) + n + SPC_PADLEN(n, 8);
+	}
+	spc_write(&s, &hdr, sizeof(hdr));
+	spc_var_output(&s, sf->ivar);
+	for(i = 0; i < s.ndv; i++)
+		spc_var_output(&s, s.dvars[i]);
+	for(i = 0; i < s.nsp; i++)
+		spc_var_output(&s, &sf->spar[i]);
+
+	spc_gather(&s, index, begin_val, end_val, nthreads);
+
+	spc_pad(&s, 8);
+	memcpy(tr.magic, SPC_MAGIC, 8);
+	tr.diroffset = s.pos;
+	tr.ntables = s.ntables;
+	tr.nchunks = s.nchunks;
+	spc_write(&s, s.tables, s.ntables * sizeof(SpcTable));
+	spc_write(&s, s.chunkoff, s.nchunks * sizeof(long long));
+	spc_write(&s, s.swvals, s.ntables * s.nsp * sizeof(double));
+	spc_write(&s, s.minmax, s.ntables * 2 * s.ncols * sizeof(double));
+	spc_write(&s, &tr, sizeof(tr));
+	spc_free(&s);
+}
+
+static int parse_field_numbers(int **indices, int *idxsize, int *nidx, char *list, int nfields)
+{
+	int n, i;
+	char *fnum;
+	int err = 0;
+	int *idx = 0;
+	if(!*indices || idxsize == 0)
+	{
+		*idxsize = nfields*2;
+		idx = g_new0(int, *idxsize);
+		*indices = idx;
+		*nidx = 0;
+	}
+
+	fnum = strtok(list, ", \t");
+	i = 0;
+	while(fnum)
+	{
+		if(*nidx >= *idxsize)
+		{
+			*idxsize *= 2;
+			idx = g_realloc(idx, (*idxsize) * sizeof(int));
+			*indices = idx;
+		}
+		n = atoi(fnum);
+		if(n < 0 || n >= nfields)
+		{
+			fprintf(stderr, "bad field number in -n option: %s\n", fnum);
+			err = -1;
+		}
+		else
+		{
+			idx[i++] = n;
+			(*nidx)++;
+		}
+		fnum = strtok(NULL, ", \t");
+	}
+	return err;
+}
+
+
+/*
+ * Try looking for named dependent variable.  Try twice,
+ * first as-is, then with "v(" prepended the way hspice mangles things.
+ */
+static int find_dv_by_name(char *name, SpiceStream *sf)
+{
+	int i;
+	for(i = 0; i < sf->ndv; i++)
+	{
+		if(strcasecmp(name, sf->dvar[i].name) == 0)
+			return i;
+	}
+	for(i = 0; i < sf->ndv; i++)
+	{
+		if(strncasecmp("v(", sf->dvar[i].name, 2) == 0
+		        && strcasecmp(name, &sf->dvar[i].name[2]) == 0)
+			return i;
+	}
+	return -1;
+}
+
+/*
+ * parse comma-seperated list of field names.  Turn on the output-enables
+ * for the listed fields.
+ */
+static int parse_field_names(int **indices, int *idxsize, int *nidx, char *list, SpiceStream *sf)
+{
+	int err = 0;
+	int n;
+	char *fld;
+	int i;
+	int *idx = 0;
+
+	if(!*indices || idxsize == 0)
+	{
+		*idxsize = (sf->ndv+1)*2;
+		idx = g_new0(int, *idxsize);
+		*indices = idx;
+		*nidx = 0;
+	}
+
+	fld = strtok(list, ", \t");
+	i = 0;
+	while(fld)
+	{
+		if(*nidx >= *idxsize)
+		{
+			*idxsize *= 2;
+			idx = g_realloc(idx, (*idxsize) * sizeof(int));
+			*indices = idx;
+		}
+		if(strcasecmp(fld, sf->ivar->name)==0)
+		{
+			idx[i++] = 0;
+			(*nidx)++;
+		}
+		else if((n = find_dv_by_name(fld, sf)) >= 0)
+		{
+			idx[i++] = n+1;
+			(*nidx)++;
+		}
+		else
+		{
+			fprintf(stderr, "field name in -f option not found in file: %s\n", fld);
+			err = -1;
+		}
+		fld = strtok(NULL, ", \t");
+	}
+	return err;
+}
+
+
+struct vtlistel
+{
+	VarType t;
+	char *s;
+};
+static struct vtlistel vtlist[] =
+{
+	{TIME, "time"},
+	{VOLTAGE, "volt"},
+	{VOLTAGE, "volts"},
+	{VOLTAGE, "voltage"},
+	{CURRENT, "current"},
+	{CURRENT, "amps"},
+	{FREQUENCY, "freq"},
+	{FREQUENCY, "frequency"},
+	{FREQUENCY, "hertz"},
+	{UNKNOWN, NULL},
+};
+
+/*
+ * Given a variable type name, return a numeric VarType.
+ * Returns 0 (UNKNOWN) if no match.
+ */
+static VarType get_vartype_code(char *vartype)
+{
+	int i;
+	for(i = 0; vtlist[i].s; i++)
+	{
+		if(strcasecmp(vartype, vtlist[i].s) == 0)
+			return vtlist[i].t;
+	}
+	return UNKNOWN;
+}
+
+/*
+ * Open the output sink, writing to the named file or, if name is NULL,
+ * to stdout.  Exits if the file can't be created.
+ */
+OutSink *
+out_open(char *name)
+{
+	int fd;
+
+	if(name)
+	{
+		fd = open(name, O_WRONLY|O_CREAT|O_TRUNC, 0666);
+		if(fd < 0)
+		{
+			perror(name);
+			exit(1);
+		}
+		return out_new(fd, name);
+	}
+	fflush(stdout);	/* anything printed with stdio goes first */
+	return out_new(1, "stdout");
+}
+
+/*
+ * Make a sink that writes to fd, which out_close will close unless it
+ * is stdout.
+ */
+OutSink *
+out_new(int fd, char *name)
+{
+	OutSink *os;
+
+	os = g_new0(OutSink, 1);
+	os->fd = fd;
+	os->name = name;
+	os->size = OUT_BUFSIZE;
+	os->buf = g_new(char, os->size);
+	return os;
+}
+
+/*
+ * Write out the iovecs, retrying after short writes.
+ * Exits on a write error, since there is no way to go on.
+ */
+static void
+out_writev(OutSink *os, struct iovec *iov, int iovcnt)
+{
+	ssize_t n;
+
+	while(iovcnt > 0)
+	{
+		n = writev(os->fd, iov, iovcnt);
+		if(n < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			fprintf(stderr, "%s: %s: %s\n", progname, os->name,
+				strerror(errno));
+			exit(1);
+		}
+		while(iovcnt > 0 && (size_t) n >= iov->iov_len)
+		{
+			n -= iov->iov_len;
+			iov++;
+			iovcnt--;
+		}
+		if(iovcnt > 0)
+		{
+			iov->iov_base = (char *) iov->iov_base + n;
+			iov->iov_len -= n;
+		}
+	}
+}
+
+void
+out_flush(OutSink *os)
+{
+	struct iovec iov;
+
+	if(os->len == 0)
+		return;
+	iov.iov_base = os->buf;
+	iov.iov_len = os->len;
+	out_writev(os, &iov, 1);
+	os->len = 0;
+}
+
+/*
+ * Flush and close the sink, and free it.
+ */
+void
+out_close(OutSink *os)
+{
+	out_flush(os);
+	if(os->fd != 1 && close(os->fd) < 0)
+	{
+		fprintf(stderr, "%s: %s: %s\n", progname, os->name, strerror(errno));
+		exit(1);
+	}
+	g_free(os->buf);
+	g_free(os);
+}
+
+/*
+ * Make room for at least n more bytes in the buffer, and return a
+ * pointer to where they go.  Pass the end of what was put there to
+ * out_commit.
+ */
+char *
+out_room(OutSink *os, size_t n)
+{
+	if(os->size - os->len < n)
+	{
+		out_flush(os);
+		if(os->size < n)
+		{
+			os->size = n;
+			g_free(os->buf);
+			os->buf = g_new(char, os->size);
+		}
+	}
+	return os->buf + os->len;
+}
+
+/*
+ * Write n bytes.  Anything too big for the buffer goes out along with
+ * the buffer's contents in one writev.
+ */
+void
+out_write(OutSink *os, const char *p, size_t n)
+{
+	struct iovec iov[2];
+
+	if(os->size - os->len >= n)
+	{
+		memcpy(os->buf + os->len, p, n);
+		os->len += n;
+	}
+	else if(n < os->size)
+	{
+		out_flush(os);
+		memcpy(os->buf, p, n);
+		os->len = n;
+	}
+	else
+	{
+		iov[0].iov_base = os->buf;
+		iov[0].iov_len = os->len;
+		iov[1].iov_base = (char *) p;
+		iov[1].iov_len = n;
+		out_writev(os, iov, 2);
+		os->len = 0;
+	}
+}
+
+void
+out_puts(OutSink *os, const char *s)
+{
+	out_write(os, s, strlen(s));
+}
+
+void
+out_printf(OutSink *os, const char *fmt, ...)
+{
+	va_list args;
+	int n;
+
+	va_start(args, fmt);
+	n = vsnprintf(out_room(os, 256), 256, fmt, args);
+	va_end(args);
+	if(n < 0)
+		return;
+	if(n >= 256)
+	{
+		va_start(args, fmt);
+		vsnprintf(out_room(os, n + 1), n + 1, fmt, args);
+		va_end(args);
+	}
+	os->len += n;
+}
+
+/*
+ * Return the file offset that the next byte written will go to.
+ */
+off_t
+out_tell(OutSink *os)
+{
+	return lseek(os->fd, 0, SEEK_CUR) + os->len;
+}
+
+/*
+ * For writers whose header holds counts that are known only at the end.
+ * If what has been written can be written over, return NULL: the header
+ * goes to os with room for the counts, which out_patch fills in later.
+ * Otherwise, as with a pipe, return a sink for a temporary file, for the
+ * data to go to until the header can be written; out_spool_copy then
+ * copies it to os after the header, and closes it.
+ */
+OutSink *
+out_spool_open(OutSink *os)
+{
+	if(lseek(os->fd, 0, SEEK_CUR) >= 0
+	   && !(fcntl(os->fd, F_GETFL) & O_APPEND))
+		return NULL;
+	return out_tmp_open();
+}
+
+/*
+ * Return a sink for a new temporary file, which goes away when it
+ * is closed.
+ */
+OutSink *
+out_tmp_open(void)
+{
+	FILE *tmp;
+	int fd;
+
+	if((tmp = tmpfile()) == NULL || (fd = dup(fileno(tmp))) < 0)
+	{
+		fprintf(stderr, "%s: temporary file: %s\n", progname,
+			strerror(errno));
+		exit(1);
+	}
+	fclose(tmp);	/* the file goes away when fd is closed */
+	return out_new(fd, "temporary file");
+}
+
+void
+out_spool_copy(OutSink *os, OutSink *ts)
+{
+	ssize_t n;
+
+	out_flush(ts);
+	if(lseek(ts->fd, 0, SEEK_SET) < 0)
+	{
+		fprintf(stderr, "%s: %s: %s\n", progname, ts->name,
+			strerror(errno));
+		exit(1);
+	}
+	for(;;)
+	{
+		n = read(ts->fd, out_room(os, OUT_BUFSIZE), OUT_BUFSIZE);
+		if(n < 0 && errno == EINTR)
+			continue;
+		if(n < 0)
+		{
+			fprintf(stderr, "%s: %s: %s\n", progname, ts->name,
+				strerror(errno));
+			exit(1);
+		}
+		if(n == 0)
+			break;
+		os->len += n;
+	}
+	out_close(ts);
+}
+
+/*
+ * Write n bytes at offset pos, over what was written there before.
+ */
+void
+out_patch(OutSink *os, off_t pos, const char *p, size_t n)
+{
+	out_flush(os);
+	if(pwrite(os->fd, p, n, pos) != (ssize_t) n)
+	{
+		fprintf(stderr, "%s: %s: %s\n", progname, os->name,
+			strerror(errno));
+		exit(1);
 	}
-	return UNKNOWN;
 }
@@ -0,0 +1,140 @@
+/*
+ * sp2sp.h: what sp2sp.c shares with the output writers that live in
+ * files of their own: the output sink, the reader that hands them rows
+ * a block at a time, and the gathering of rows into spc chunks.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#ifndef SP2SP_H
+#define SP2SP_H
+
+#include <sys/types.h>
+
+#define SWEEP_NONE 0
+#define SWEEP_PREPEND 1
+#define SWEEP_HEAD 2
+
+extern int sweep_mode;
+extern char *progname;
+
+/*
+ * Output sink: everything that sp2sp writes goes through a large buffer
+ * that is handed to write(2) when it fills, rather than through stdio a
+ * value at a time.  Writers may format straight into the buffer, after
+ * reserving room with out_room.
+ */
+#define OUT_BUFSIZE (1 << 20)
+
+typedef struct {
+	int fd;
+	char *name;	/* for error messages */
+	char *buf;
+	size_t len;	/* bytes waiting in buf */
+	size_t size;
+} OutSink;
+
+#define out_putc(os, c) \
+	do { if((os)->len == (os)->size) out_flush(os); \
+	     (os)->buf[(os)->len++] = (c); } while(0)
+/* end of the bytes written at p, which came from out_room */
+#define out_commit(os, p) ((os)->len = (p) - (os)->buf)
+
+extern OutSink *out_open(char *name);
+extern OutSink *out_new(int fd, char *name);
+extern off_t out_tell(OutSink *os);
+extern OutSink *out_spool_open(OutSink *os);
+extern OutSink *out_tmp_open(void);
+extern void out_spool_copy(OutSink *os, OutSink *ts);
+extern void out_patch(OutSink *os, off_t pos, const char *p, size_t n);
+extern void out_close(OutSink *os);
+extern void out_flush(OutSink *os);
+extern char *out_room(OutSink *os, size_t n);
+extern void out_write(OutSink *os, const char *p, size_t n);
+extern void out_puts(OutSink *os, const char *s);
+extern void out_printf(OutSink *os, const char *fmt, ...);
+
+/*
+ * Reading a RowBlock at a time, from a BlockReader; see br_open.
+ */
+#define RB_ROWS 0
+#define RB_SWEEP 1
+#define RB_END 2
+
+typedef struct {
+	int type;
+	int nrows;	/* RB_ROWS: number of rows in ivals and dcols */
+	int rc;		/* RB_END: -2 end of table, 0 EOF, -1 error */
+	double *ivals;
+	double **dcols;
+	double *spar;	/* RB_SWEEP: sweep parameter values */
+} RowBlock;
+
+typedef struct _BlockReader BlockReader;
+
+extern BlockReader *br_open(SpiceStream *sf, int threaded, SSIndex *index,
+                            double begin_val, double end_val);
+extern RowBlock *br_next(BlockReader *br);
+extern void br_close(BlockReader *br);
+
+/*
+ * Rows gathered into spc chunks, for -c spc and for writers that need
+ * all of the rows before they can write anything; see spc_gather.
+ */
+typedef struct {
+	OutSink *os;
+	long long pos;	/* bytes written so far */
+	SpiceStream *sf;
+	int ndv;
+	SpiceVar **dvars;	/* selected variables */
+	int ncols;
+	int *dcols;	/* column of the input for each column of output */
+	int nsp;
+	int chunkrows;
+	double *vals;	/* column c of the chunk at vals + c * chunkrows */
+	int n;	/* rows in vals */
+	long long *chunkoff;
+	long long nchunks;
+	long long chunkoffsize;
+	SpcTable *tables;
+	int ntables;
+	int tablesize;
+	double *swvals;	/* nsp for each table */
+	double *minmax;	/* 2 * ncols for each table */
+} SpcOut;
+
+extern void spc_open(SpcOut *s, OutSink *os, SpiceStream *sf, int *indices,
+                     int nidx);
+extern void spc_gather(SpcOut *s, SSIndex *index, double begin_val,
+                       double end_val, int nthreads);
+extern void spc_free(SpcOut *s);
+
+/*
+ * Store v in the nbytes bytes at p, least significant first, as zip
+ * headers and FlatBuffers have it.
+ */
+static inline unsigned char *
+le_put(unsigned char *p, unsigned long long v, int nbytes)
+{
+	while(nbytes-- > 0)
+	{
+		*p++ = v & 0xff;
+		v >>= 8;
+	}
+	return p;
+}
+
+#endif /* SP2SP_H */
@@ -0,0 +1,431 @@
+/*
+ * sp2sp_arrow.c: Apache Arrow IPC stream output for sp2sp, -c arrow.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "glib.h"
+#include "spicestream.h"
+#include "ss_spc.h"
+#include "sp2sp.h"
+#include "sp2sp_arrow.h"
+
+/*
+ * Arrow IPC stream output: a Schema message, a RecordBatch message for
+ * each batch of rows, and the end-of-stream marker.  Each message is a
+ * FlatBuffers-encoded Message, framed by 0xFFFFFFFF and its length, and
+ * followed by a body holding the columns of the batch one after the
+ * other.  The columns are those of ascii output, sweep parameters first
+ * unless -s none, each a non-nullable float64; a variable with two
+ * columns becomes a column for each, named as in the ascii header, as
+ * Arrow has no complex type.  The data is in the native byte order,
+ * which the schema gives, so that a reader can map the file and use the
+ * columns where they are.  Only one batch is kept in memory: up to
+ * ARROW_BATCHROWS rows, fewer if there are so many columns that it would
+ * take more than ARROW_MAXBATCH bytes.
+ *
+ * The FlatBuffers are put together front to back by the few routines
+ * below, which is all these messages need: each object goes after the
+ * offsets that point to it, which are filled in once it is there.
+ */
+#define ARROW_BATCHROWS 65536
+#define ARROW_MAXBATCH (64 << 20)
+#define ARROW_V5 4	/* MetadataVersion */
+#define ARROW_SCHEMA 1	/* MessageHeader */
+#define ARROW_RECORDBATCH 3
+#define ARROW_FLOATINGPOINT 3	/* Type */
+#define ARROW_DOUBLE 2	/* Precision */
+
+typedef struct {
+	unsigned char *buf;
+	size_t len;
+	size_t size;
+} FbBuf;
+
+typedef struct {
+	int id;		/* field number in the schema */
+	int size;	/* 1, 2, 4 or 8 bytes */
+	long long val;	/* 0 for an offset, filled in with fb_patch */
+	size_t pos;	/* where fb_table put it */
+} FbField;
+
+/*
+ * Append n bytes from p, or n zeros if p is NULL, and return where they
+ * went.
+ */
+static size_t
+fb_put(FbBuf *b, const void *p, size_t n)
+{
+	size_t pos = b->len;
+
+	if(b->len + n > b->size)
+	{
+		b->size = 2 * (b->len + n);
+		b->buf = g_realloc(b->buf, b->size);
+	}
+	if(p)
+		memcpy(b->buf + pos, p, n);
+	else
+		memset(b->buf + pos, 0, n);
+	b->len += n;
+	return pos;
+}
+
+static size_t
+fb_put_le(FbBuf *b, unsigned long long v, int nbytes)
+{
+	unsigned char tmp[8];
+
+	le_put(tmp, v, nbytes);
+	return fb_put(b, tmp, nbytes);
+}
+
+/*
+ * Pad with zeros until the length is rem more than a multiple of align.
+ */
+static void
+fb_pad(FbBuf *b, int align, int rem)
+{
+	fb_put(b, NULL, (rem + align - b->len % align) % align);
+}
+
+/*
+ * Point the offset at "at" to the object at target, which follows it.
+ */
+static void
+fb_patch(FbBuf *b, size_t at, size_t target)
+{
+	le_put(b->buf + at, target - at, 4);
+}
+
+static size_t
+fb_string(FbBuf *b, const char *s)
+{
+	size_t pos;
+
+	fb_pad(b, 4, 0);
+	pos = fb_put_le(b, strlen(s), 4);
+	fb_put(b, s, strlen(s) + 1);
+	return pos;
+}
+
+/*
+ * Start a vector of n elements of elsize bytes, aligned to align, and
+ * return where it is; the caller puts in the elements.
+ */
+static size_t
+fb_vector(FbBuf *b, int n, int align)
+{
+	fb_pad(b, align, 4 % align);
+	return fb_put_le(b, n, 4);
+}
+
+/*
+ * Write a table with the nf fields in f, its vtable just before it, and
+ * return where it is.  The fields go in from the largest to the
+ * smallest, so that each is aligned to its size.
+ */
+static size_t
+fb_table(FbBuf *b, FbField *f, int nf)
+{
+	size_t vt, t;
+	int i, sz, nids, align;
+
+	nids = 0;
+	align = 4;
+	for(i = 0; i < nf; i++)
+	{
+		if(f[i].id >= nids)
+			nids = f[i].id + 1;
+		if(f[i].size == 8)
+			align = 8;
+	}
+	fb_pad(b, 2, 0);
+	vt = fb_put(b, NULL, 4 + 2 * nids);
+	fb_pad(b, align, align - 4);
+	t = b->len;
+	fb_put_le(b, t - vt, 4);
+	for(sz = 8; sz > 0; sz /= 2)
+	{
+		for(i = 0; i < nf; i++)
+		{
+			if(f[i].size != sz)
+				continue;
+			f[i].pos = fb_put_le(b, f[i].val, sz);
+			le_put(b->buf + vt + 4 + 2 * f[i].id, f[i].pos - t, 2);
+		}
+	}
+	le_put(b->buf + vt, 4 + 2 * nids, 2);
+	le_put(b->buf + vt + 2, b->len - t, 2);
+	return t;
+}
+
+/*
+ * Start a Message with the given header type, and return where its
+ * header offset is.
+ */
+static size_t
+arrow_message(FbBuf *b, int type, long long bodylen)
+{
+	FbField f[4] = {
+		{ 0, 2, ARROW_V5 },
+		{ 1, 1, 0 },
+		{ 2, 4, 0 },
+		{ 3, 8, 0 },
+	};
+
+	f[1].val = type;
+	f[3].val = bodylen;
+	b->len = 0;
+	fb_put(b, NULL, 4);
+	fb_patch(b, 0, fb_table(b, f, 4));
+	return f[2].pos;
+}
+
+/*
+ * Write the message in b, framed and padded to a multiple of 8 bytes,
+ * as the body that follows must be.
+ */
+static void
+arrow_message_output(OutSink *os, FbBuf *b)
+{
+	unsigned char hdr[8];
+
+	fb_pad(b, 8, 0);
+	le_put(le_put(hdr, 0xffffffff, 4), b->len, 4);
+	out_write(os, (char *) hdr, 8);
+	out_write(os, (char *) b->buf, b->len);
+}
+
+static void
+arrow_schema_output(OutSink *os, FbBuf *b, char **names, int ncols)
+{
+	FbField sch[2] = { { 0, 2, 0 }, { 1, 4, 0 } };
+	FbField fld[3] = { { 0, 4, 0 }, { 2, 1, ARROW_FLOATINGPOINT },
+	                   { 3, 4, 0 } };
+	FbField fp[1] = { { 0, 2, ARROW_DOUBLE } };
+	FbField ch[1] = { { 5, 4, 0 } };
+	size_t hdr, vec, type, children;
+	size_t *name, *typeoff, *chs;
+	unsigned int one = 1;
+	int i;
+
+	name = g_new(size_t, ncols);
+	typeoff = g_new(size_t, ncols);
+	chs = g_new(size_t, ncols);
+
+	hdr = arrow_message(b, ARROW_SCHEMA, 0);
+	sch[0].val = (*(unsigned char *) &one == 1) ? 0 : 1;	/* endianness */
+	fb_patch(b, hdr, fb_table(b, sch, 2));
+	vec = fb_vector(b, ncols, 4);
+	fb_patch(b, sch[1].pos, vec);
+	fb_put(b, NULL, 4 * ncols);
+	for(i = 0; i < ncols; i++)
+	{
+		FbField f[4];
+
+		memcpy(f, fld, sizeof(fld));
+		f[3] = ch[0];
+		fb_patch(b, vec + 4 + 4 * i, fb_table(b, f, 4));
+		name[i] = f[0].pos;
+		typeoff[i] = f[2].pos;
+		chs[i] = f[3].pos;
+	}
+	/* all the fields share one type and one empty list of children */
+	type = fb_table(b, fp, 1);
+	children = fb_vector(b, 0, 4);
+	for(i = 0; i < ncols; i++)
+	{
+		fb_patch(b, typeoff[i], type);
+		fb_patch(b, chs[i], children);
+		fb_patch(b, name[i], fb_string(b, names[i]));
+	}
+	arrow_message_output(os, b);
+
+	g_free(name);
+	g_free(typeoff);
+	g_free(chs);
+}
+
+/*
+ * Write a RecordBatch of nrows rows from batch, which holds the columns
+ * one after the other, maxrows apart.
+ */
+static void
+arrow_batch_output(OutSink *os, FbBuf *b, double *batch, int ncols,
+                   int nrows, int maxrows)
+{
+	FbField rb[3] = { { 0, 8, 0 }, { 1, 4, 0 }, { 2, 4, 0 } };
+	size_t hdr, vec;
+	long long len;
+	int c;
+
+	len = (long long) nrows * sizeof(double);
+	hdr = arrow_message(b, ARROW_RECORDBATCH, ncols * len);
+	rb[0].val = nrows;
+	fb_patch(b, hdr, fb_table(b, rb, 3));
+
+	vec = fb_vector(b, ncols, 8);
+	fb_patch(b, rb[1].pos, vec);
+	for(c = 0; c < ncols; c++)
+	{
+		fb_put_le(b, nrows, 8);
+		fb_put_le(b, 0, 8);	/* null count */
+	}
+	/* for each column, no validity bitmap, then the data */
+	vec = fb_vector(b, 2 * ncols, 8);
+	fb_patch(b, rb[2].pos, vec);
+	for(c = 0; c < ncols; c++)
+	{
+		fb_put_le(b, c * len, 8);
+		fb_put_le(b, 0, 8);
+		fb_put_le(b, c * len, 8);
+		fb_put_le(b, len, 8);
+	}
+	arrow_message_output(os, b);
+
+	for(c = 0; c < ncols; c++)
+		out_write(os, (char *) (batch + (size_t) c * maxrows), len);
+}
+
+void
+arrow_output(OutSink *os, SpiceStream *sf, int *indices, int nidx,
+             SSIndex *index, double begin_val, double end_val, int nthreads)
+{
+	FbBuf fb;
+	SpiceVar *dv;
+	BlockReader *br;
+	RowBlock *b;
+	double *spar = NULL;
+	double *batch;
+	char **names;
+	int *src;	/* for each column, -1 the independent variable,
+			 * -2 - i sweep parameter i, or the data column */
+	int nspar, ncols, maxrows, nrows;
+	int i, j, c, r, done;
+	double ival;
+	char buf[1024];
+	static const unsigned char eos[8] = { 0xff, 0xff, 0xff, 0xff };
+
+	nspar = (sweep_mode == SWEEP_PREPEND) ? sf->nsweepparam : 0;
+	ncols = nspar;
+	for(i = 0; i < nidx; i++)
+		ncols += (indices[i] == 0) ? 1 : sf->dvar[indices[i]-1].ncols;
+	names = g_new(char *, ncols);
+	src = g_new(int, ncols);
+	c = 0;
+	for(i = 0; i < nspar; i++)
+	{
+		names[c] = g_strdup(sf->spar[i].name);
+		src[c++] = -2 - i;
+	}
+	for(i = 0; i < nidx; i++)
+	{
+		if(indices[i] == 0)
+		{
+			ss_var_name(sf->ivar, 0, buf, 1024);
+			names[c] = g_strdup(buf);
+			src[c++] = -1;
+			continue;
+		}
+		dv = &sf->dvar[indices[i]-1];
+		for(j = 0; j < dv->ncols; j++)
+		{
+			ss_var_name(dv, j, buf, 1024);
+			names[c] = g_strdup(buf);
+			src[c++] = dv->col - 1 + j;
+		}
+	}
+
+	maxrows = ARROW_BATCHROWS;
+	if(ncols > 0 && maxrows > ARROW_MAXBATCH / (ncols * sizeof(double)))
+		maxrows = ARROW_MAXBATCH / (ncols * sizeof(double));
+	if(maxrows < 1)
+		maxrows = 1;
+	batch = g_new(double, (size_t) ncols * maxrows);
+	if(sf->nsweepparam > 0)
+		spar = g_new0(double, sf->nsweepparam);
+
+	memset(&fb, 0, sizeof(fb));
+	arrow_schema_output(os, &fb, names, ncols);
+
+	br = br_open(sf, nthreads > 1, index, begin_val, end_val);
+	nrows = 0;
+	done = 0;
+	while(!done)
+	{
+		b = br_next(br);
+		switch(b->type)
+		{
+		case RB_SWEEP:
+			memcpy(spar, b->spar, sf->nsweepparam * sizeof(double));
+			break;
+
+		case RB_END:
+			if(b->rc != -2)
+				done = 1;
+			break;
+
+		case RB_ROWS:
+			for(r = 0; r < b->nrows; r++)
+			{
+				ival = b->ivals[r];
+				if(ival > end_val && sf->ntables == 1)
+				{
+					done = 1;
+					break;
+				}
+				if(ival < begin_val || ival > end_val)
+					continue;
+				for(c = 0; c < ncols; c++)
+				{
+					double *col = batch + (size_t) c * maxrows;
+
+					if(src[c] >= 0)
+						col[nrows] = b->dcols[src[c]][r];
+					else if(src[c] == -1)
+						col[nrows] = ival;
+					else
+						col[nrows] = spar[-2 - src[c]];
+				}
+				if(++nrows == maxrows)
+				{
+					arrow_batch_output(os, &fb, batch, ncols, nrows, maxrows);
+					nrows = 0;
+				}
+			}
+			break;
+		}
+	}
+	br_close(br);
+	if(nrows > 0)
+		arrow_batch_output(os, &fb, batch, ncols, nrows, maxrows);
+	out_write(os, (const char *) eos, sizeof(eos));
+
+	for(c = 0; c < ncols; c++)
+		g_free(names[c]);
+	g_free(names);
+	g_free(src);
+	g_free(batch);
+	if(spar)
+		g_free(spar);
+	if(fb.buf)
+		g_free(fb.buf);
+}
@@ -0,0 +1,13 @@
+/*
+ * sp2sp_arrow.h: Apache Arrow IPC stream output for sp2sp; see
+ * sp2sp_arrow.c.
+ */
+
+#ifndef SP2SP_ARROW_H
+#define SP2SP_ARROW_H
+
+extern void arrow_output(OutSink *os, SpiceStream *sf, int *enab, int nidx,
+                         SSIndex *index, double begin_val, double end_val,
+                         int nthreads);
+
+#endif /* SP2SP_ARROW_H */
@@ -0,0 +1,565 @@
+/*
+ * sp2sp_npy.c: NumPy output for sp2sp, -c npz and -c npy.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "glib.h"
+#include "spicestream.h"
+#include "ss_spc.h"
+#include "sp2sp.h"
+#include "sp2sp_npy.h"
+
+/*
+ * NumPy output.  -c npz writes a zip archive of .npy arrays, stored
+ * uncompressed, which numpy.load reads without parsing anything; -c npy
+ * writes each array to a .npy file of its own, in the directory given
+ * with -o, and numpy.load can map those with mmap_mode.
+ *
+ * The independent variable and each selected variable make an array of
+ * float64 named after it, or of complex128 for a variable with two
+ * columns, with any '/' in the name made '_'.  A name that is already
+ * taken, by another variable or by "rows", "sweep" or "sweep_names",
+ * has "_1", "_2" and so on added until it isn't, since an archive with
+ * two members of one name loads as only one of them.  With one table
+ * the arrays are 1-D.  With more, they have a
+ * row for each table, padded with NaN to the length of the longest,
+ * and the int64 array "rows" holds the length of each.  The sweep
+ * parameters go into the float64 array "sweep", with a row for each
+ * table and a column for each parameter, and their names into the byte
+ * string array "sweep_names"; -s none leaves them out.
+ *
+ * The shapes are known only at the end, so the rows are gathered into
+ * a temporary file first, in the chunks that spc output uses, and the
+ * arrays are then written from there a column at a time.
+ */
+#define NPY_ALIGN 64	/* the data starts at a multiple of this */
+
+typedef struct {
+	char *name;
+	long long offset;	/* of its local header */
+	long long size;
+	unsigned long crc;
+} NpzMember;
+
+typedef struct {
+	OutSink *os;	/* the archive, or the current .npy file */
+	char *dir;	/* where .npy files go; NULL for an archive */
+	char *path;	/* of the current .npy file */
+	long long pos;	/* bytes written to the archive */
+	NpzMember *members;
+	int nmembers;
+	int membersize;
+	NpzMember *cur;	/* member being written */
+} NpyOut;
+
+/* the names of the arrays that don't come from variables */
+static char *npy_reserved[] = { "rows", "sweep", "sweep_names", NULL };
+
+/* the array names taken so far, in an open-addressed hash table */
+typedef struct {
+	char **slot;	/* NULL where empty */
+	unsigned int mask;	/* the number of slots, less one */
+} NpyNames;
+
+static unsigned int
+npy_hash(const char *s)
+{
+	unsigned int h = 5381;
+
+	while(*s)
+		h = h * 33 + (unsigned char) *s++;
+	return h;
+}
+
+/*
+ * Take name if it is free.  Returns 1 if it was already taken.
+ */
+static int
+npy_take(NpyNames *nn, char *name)
+{
+	unsigned int i;
+
+	for(i = npy_hash(name) & nn->mask; nn->slot[i]; i = (i + 1) & nn->mask)
+		if(strcmp(nn->slot[i], name) == 0)
+			return 1;
+	nn->slot[i] = name;
+	return 0;
+}
+
+/*
+ * The name of the array for the variable varname, as a new string that
+ * no other array has.
+ */
+static char *
+npy_key(NpyNames *nn, char *varname)
+{
+	char *key, *s;
+	int n;
+
+	key = g_new(char, strlen(varname) + 16);
+	for(s = key; *varname; varname++)
+		*s++ = (*varname == '/') ? '_' : *varname;
+	*s = 0;
+	for(n = 1; npy_take(nn, key); n++)
+		sprintf(s, "_%d", n);
+	return key;
+}
+
+#ifdef HAVE_ZLIB
+#define npy_crc32(crc, p, n)	crc32(crc, p, n)
+#else
+/*
+ * The CRC-32 that zlib's crc32 computes, for builds without zlib, a
+ * byte at a time from a table.
+ */
+static unsigned long
+npy_crc32(unsigned long crc, const unsigned char *p, unsigned int n)
+{
+	static unsigned long table[256];
+	unsigned long c;
+	int i, k;
+
+	if(table[1] == 0)
+	{
+		for(i = 0; i < 256; i++)
+		{
+			c = i;
+			for(k = 0; k < 8; k++)
+				c = (c >> 1) ^ (0xedb88320 & -(c & 1));
+			table[i] = c;
+		}
+	}
+	crc ^= 0xffffffff;
+	while(n-- > 0)
+		crc = table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+	return crc ^ 0xffffffff;
+}
+#endif
+
+/* zip headers and the rest of the archive's own structure */
+static void
+npz_write(NpyOut *no, const void *p, size_t n)
+{
+	out_write(no->os, p, n);
+	no->pos += n;
+}
+
+/* the contents of an array */
+static void
+npy_write(NpyOut *no, const void *p, size_t n)
+{
+	const unsigned char *q = p;
+	size_t k;
+
+	if(no->cur)
+	{
+		/* crc32 takes an unsigned int length */
+		for(k = 0; k < n; k += 1 << 30)
+			no->cur->crc = npy_crc32(no->cur->crc, q + k,
+			                         (n - k < (1 << 30)) ? n - k : (1 << 30));
+		no->cur->size += n;
+		no->pos += n;
+	}
+	out_write(no->os, p, n);
+}
+
+/*
+ * Start an array, as a .npy file or a member of the archive.
+ */
+static void
+npy_begin(NpyOut *no, char *key)
+{
+	unsigned char hdr[30], *p;
+	char *name;
+	NpzMember *m;
+
+	name = g_new(char, strlen(key) + 5);
+	sprintf(name, "%s.npy", key);
+
+	if(no->dir)
+	{
+		no->path = g_new(char, strlen(no->dir) + strlen(name) + 2);
+		sprintf(no->path, "%s/%s", no->dir, name);
+		no->os = out_open(no->path);
+		g_free(name);
+		return;
+	}
+
+	if(no->nmembers == no->membersize)
+	{
+		no->membersize = no->membersize ? 2 * no->membersize : 16;
+		no->members = g_realloc(no->members, no->membersize * sizeof(NpzMember));
+	}
+	m = no->cur = &no->members[no->nmembers++];
+	m->name = name;
+	m->offset = no->pos;
+	m->size = 0;
+	m->crc = 0;
+
+	/* local file header; the crc and sizes follow the data */
+	p = le_put(hdr, 0x04034b50, 4);
+	p = le_put(p, 45, 2);	/* version needed, for zip64 */
+	p = le_put(p, 0x0008, 2);	/* data descriptor follows */
+	p = le_put(p, 0, 2);	/* stored */
+	p = le_put(p, 0, 2);	/* time */
+	p = le_put(p, (1 << 5) | 1, 2);	/* date, 1980-01-01 */
+	p = le_put(p, 0, 12);	/* crc and sizes */
+	p = le_put(p, strlen(name), 2);
+	p = le_put(p, 0, 2);
+	npz_write(no, hdr, p - hdr);
+	npz_write(no, name, strlen(name));
+}
+
+static void
+npy_end(NpyOut *no)
+{
+	unsigned char dd[24], *p;
+	NpzMember *m = no->cur;
+
+	if(no->dir)
+	{
+		out_close(no->os);
+		g_free(no->path);
+		return;
+	}
+	p = le_put(dd, 0x08074b50, 4);
+	p = le_put(p, m->crc, 4);
+	if(m->size >= 0xffffffffLL)
+	{
+		p = le_put(p, m->size, 8);
+		p = le_put(p, m->size, 8);
+	}
+	else
+	{
+		p = le_put(p, m->size, 4);
+		p = le_put(p, m->size, 4);
+	}
+	npz_write(no, dd, p - dd);
+	no->cur = NULL;
+}
+
+/*
+ * Write the central directory and the end records of the archive.
+ */
+static void
+npz_finish(NpyOut *no)
+{
+	unsigned char hdr[64], *p;
+	long long cdstart, cdsize;
+	NpzMember *m;
+	int i, big;
+
+	cdstart = no->pos;
+	for(i = 0; i < no->nmembers; i++)
+	{
+		m = &no->members[i];
+		big = (m->size >= 0xffffffffLL || m->offset >= 0xffffffffLL);
+		p = le_put(hdr, 0x02014b50, 4);
+		p = le_put(p, 45, 2);	/* version made by */
+		p = le_put(p, 45, 2);	/* version needed */
+		p = le_put(p, 0x0008, 2);
+		p = le_put(p, 0, 2);
+		p = le_put(p, 0, 2);
+		p = le_put(p, (1 << 5) | 1, 2);
+		p = le_put(p, m->crc, 4);
+		p = le_put(p, big ? 0xffffffffLL : m->size, 4);
+		p = le_put(p, big ? 0xffffffffLL : m->size, 4);
+		p = le_put(p, strlen(m->name), 2);
+		p = le_put(p, big ? 28 : 0, 2);	/* extra field */
+		p = le_put(p, 0, 10);	/* comment, disk, attributes */
+		p = le_put(p, big ? 0xffffffffLL : m->offset, 4);
+		npz_write(no, hdr, p - hdr);
+		npz_write(no, m->name, strlen(m->name));
+		if(big)
+		{
+			p = le_put(hdr, 0x0001, 2);	/* zip64 sizes and offset */
+			p = le_put(p, 24, 2);
+			p = le_put(p, m->size, 8);
+			p = le_put(p, m->size, 8);
+			p = le_put(p, m->offset, 8);
+			npz_write(no, hdr, p - hdr);
+		}
+		g_free(m->name);
+	}
+	cdsize = no->pos - cdstart;
+
+	big = (no->nmembers >= 0xffff || cdstart >= 0xffffffffLL
+	       || cdsize >= 0xffffffffLL);
+	if(big)
+	{
+		long long eocd64 = no->pos;
+
+		p = le_put(hdr, 0x06064b50, 4);
+		p = le_put(p, 44, 8);	/* size of the rest of the record */
+		p = le_put(p, 45, 2);
+		p = le_put(p, 45, 2);
+		p = le_put(p, 0, 8);	/* disk numbers */
+		p = le_put(p, no->nmembers, 8);
+		p = le_put(p, no->nmembers, 8);
+		p = le_put(p, cdsize, 8);
+		p = le_put(p, cdstart, 8);
+		npz_write(no, hdr, p - hdr);
+		p = le_put(hdr, 0x07064b50, 4);
+		p = le_put(p, 0, 4);
+		p = le_put(p, eocd64, 8);
+		p = le_put(p, 1, 4);
+		npz_write(no, hdr, p - hdr);
+	}
+	p = le_put(hdr, 0x06054b50, 4);
+	p = le_put(p, 0, 4);
+	p = le_put(p, big ? 0xffff : no->nmembers, 2);
+	p = le_put(p, big ? 0xffff : no->nmembers, 2);
+	p = le_put(p, big ? 0xffffffffLL : cdsize, 4);
+	p = le_put(p, big ? 0xffffffffLL : cdstart, 4);
+	p = le_put(p, 0, 2);
+	npz_write(no, hdr, p - hdr);
+	g_free(no->members);
+}
+
+/*
+ * Write the .npy header for an array of type descr and the given shape,
+ * with one or two dimensions.
+ */
+static void
+npy_header_output(NpyOut *no, char *descr, long long n0, long long n1, int ndim)
+{
+	char buf[256];
+	int n, hlen;
+
+	if(ndim == 1)
+		n = sprintf(buf + 10, "{'descr': '%s', 'fortran_order': False, 'shape': (%lld,), }",
+			    descr, n0);
+	else
+		n = sprintf(buf + 10, "{'descr': '%s', 'fortran_order': False, 'shape': (%lld, %lld), }",
+			    descr, n0, n1);
+	hlen = n + 1 + SPC_PADLEN(10 + n + 1, NPY_ALIGN);
+	memset(buf + 10 + n, ' ', hlen - n - 1);
+	buf[10 + hlen - 1] = '\n';
+	memcpy(buf, "\x93NUMPY\x01\x00", 8);
+	buf[8] = hlen & 0xff;
+	buf[9] = hlen >> 8;
+	npy_write(no, buf, 10 + hlen);
+}
+
+/*
+ * numpy's name for a type with the native byte order.
+ */
+static char *
+npy_descr(char *buf, char kind, int size)
+{
+	union { gint32 i; char c[4]; } u;
+
+	u.i = 1;
+	sprintf(buf, "%c%c%d", u.c[0] ? '<' : '>', kind, size);
+	return buf;
+}
+
+/*
+ * Read n bytes at offset off of the temporary file.
+ */
+static void
+npy_tmp_read(OutSink *ts, void *p, size_t n, long long off)
+{
+	ssize_t k;
+
+	while(n > 0)
+	{
+		k = pread(ts->fd, p, n, off);
+		if(k < 0 && errno == EINTR)
+			continue;
+		if(k <= 0)
+		{
+			fprintf(stderr, "%s: %s: %s\n", progname, ts->name,
+				k < 0 ? strerror(errno) : "unexpected EOF");
+			exit(1);
+		}
+		p = (char *) p + k;
+		n -= k;
+		off += k;
+	}
+}
+
+/*
+ * Write column c of every table as an array, or columns c and c+1 as
+ * one complex array if cplx, each table padded to maxrows.  buf has
+ * room for five chunks of rows, the last of them all NaN.
+ */
+static void
+npy_column_output(NpyOut *no, SpcOut *s, OutSink *ts, char *key, int c,
+                  int cplx, long long maxrows, double *buf)
+{
+	double *re = buf;
+	double *im = buf + s->chunkrows;
+	double *z = buf + 2 * s->chunkrows;
+	double *nans = buf + 4 * s->chunkrows;
+	long long nrows, row, off, pad;
+	char descr[8];
+	int t, k, n, i;
+
+	npy_begin(no, key);
+	npy_header_output(no, npy_descr(descr, cplx ? 'c' : 'f', cplx ? 16 : 8),
+			  s->ntables == 1 ? maxrows : s->ntables, maxrows,
+			  s->ntables == 1 ? 1 : 2);
+	for(t = 0; t < s->ntables; t++)
+	{
+		nrows = s->tables[t].nrows;
+		for(row = 0, k = s->tables[t].firstchunk; row < nrows; row += n, k++)
+		{
+			n = (nrows - row < s->chunkrows) ? nrows - row : s->chunkrows;
+			off = s->chunkoff[k] + (long long) c * n * sizeof(double);
+			npy_tmp_read(ts, re, n * sizeof(double), off);
+			if(!cplx)
+			{
+				npy_write(no, re, n * sizeof(double));
+				continue;
+			}
+			npy_tmp_read(ts, im, n * sizeof(double), off + n * sizeof(double));
+			for(i = 0; i < n; i++)
+			{
+				z[2*i] = re[i];
+				z[2*i+1] = im[i];
+			}
+			npy_write(no, z, 2 * n * sizeof(double));
+		}
+		pad = (maxrows - nrows) * (cplx ? 2 : 1);
+		for(; pad > 0; pad -= n)
+		{
+			n = (pad < s->chunkrows) ? pad : s->chunkrows;
+			npy_write(no, nans, n * sizeof(double));
+		}
+	}
+	npy_end(no);
+}
+
+/*
+ * NumPy output, to the archive os, or to .npy files in dir if os is NULL.
+ */
+void
+npy_output(OutSink *os, char *dir, SpiceStream *sf, int *indices, int nidx,
+           SSIndex *index, double begin_val, double end_val, int nthreads)
+{
+	NpyOut no;
+	NpyNames nn;
+	SpcOut s;
+	OutSink *ts;
+	SpiceVar *dv;
+	double *buf;
+	long long maxrows, rows;
+	char descr[16];
+	char *names;
+	char **keys;
+	size_t len;
+	int i, t, c;
+
+	memset(&no, 0, sizeof(no));
+	no.os = os;
+	no.dir = os ? NULL : dir;
+	if(no.dir && mkdir(no.dir, 0777) < 0 && errno != EEXIST)
+	{
+		perror(no.dir);
+		exit(1);
+	}
+
+	ts = out_tmp_open();
+	spc_open(&s, ts, sf, indices, nidx);
+	spc_gather(&s, index, begin_val, end_val, nthreads);
+	out_flush(ts);
+
+	maxrows = 0;
+	for(t = 0; t < s.ntables; t++)
+		if(s.tables[t].nrows > maxrows)
+			maxrows = s.tables[t].nrows;
+	buf = g_new(double, 5 * s.chunkrows);
+	for(i = 4 * s.chunkrows; i < 5 * s.chunkrows; i++)
+		buf[i] = NAN;
+
+	/* at most half the slots are used */
+	for(nn.mask = 15; nn.mask < 2 * (s.ndv + 4); nn.mask = 2 * nn.mask + 1)
+		;
+	nn.slot = g_new0(char *, nn.mask + 1);
+	for(i = 0; npy_reserved[i]; i++)
+		npy_take(&nn, npy_reserved[i]);
+	keys = g_new(char *, s.ndv + 1);
+	keys[0] = npy_key(&nn, sf->ivar->name);
+	for(i = 0; i < s.ndv; i++)
+		keys[i + 1] = npy_key(&nn, s.dvars[i]->name);
+
+	npy_column_output(&no, &s, ts, keys[0], 0, 0, maxrows, buf);
+	c = 1;
+	for(i = 0; i < s.ndv; i++)
+	{
+		dv = s.dvars[i];
+		npy_column_output(&no, &s, ts, keys[i + 1], c, dv->ncols == 2, maxrows, buf);
+		c += dv->ncols;
+	}
+	for(i = 0; i <= s.ndv; i++)
+		g_free(keys[i]);
+	g_free(keys);
+	g_free(nn.slot);
+
+	if(s.ntables > 1)
+	{
+		npy_begin(&no, "rows");
+		npy_header_output(&no, npy_descr(descr, 'i', 8), s.ntables, 0, 1);
+		for(t = 0; t < s.ntables; t++)
+		{
+			rows = s.tables[t].nrows;
+			npy_write(&no, &rows, sizeof(rows));
+		}
+		npy_end(&no);
+	}
+
+	if(s.nsp > 0)
+	{
+		len = 1;
+		for(i = 0; i < s.nsp; i++)
+			if(strlen(sf->spar[i].name) > len)
+				len = strlen(sf->spar[i].name);
+		names = g_new0(char, s.nsp * len);
+		for(i = 0; i < s.nsp; i++)
+			memcpy(names + i * len, sf->spar[i].name, strlen(sf->spar[i].name));
+
+		npy_begin(&no, "sweep");
+		npy_header_output(&no, npy_descr(descr, 'f', 8), s.ntables, s.nsp, 2);
+		npy_write(&no, s.swvals, s.ntables * s.nsp * sizeof(double));
+		npy_end(&no);
+
+		sprintf(descr, "|S%d", (int) len);
+		npy_begin(&no, "sweep_names");
+		npy_header_output(&no, descr, s.nsp, 0, 1);
+		npy_write(&no, names, s.nsp * len);
+		npy_end(&no);
+		g_free(names);
+	}
+
+	if(os)
+		npz_finish(&no);
+	g_free(buf);
+	spc_free(&s);
+	out_close(ts);
+}
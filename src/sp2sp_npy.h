@@ -0,0 +1,12 @@
+/*
+ * sp2sp_npy.h: NumPy output for sp2sp; see sp2sp_npy.c.
+ */
+
+#ifndef SP2SP_NPY_H
+#define SP2SP_NPY_H
+
+extern void npy_output(OutSink *os, char *dir, SpiceStream *sf, int *enab,
+                       int nidx, SSIndex *index, double begin_val,
+                       double end_val, int nthreads);
+
+#endif /* SP2SP_NPY_H */
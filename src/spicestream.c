@@ -28,10 +28,17 @@
 #include <float.h>
 #include <stdarg.h>
 #include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#if defined(_POSIX_MAPPED_FILES) && _POSIX_MAPPED_FILES > 0
+#include <sys/mman.h>
+#endif
 // #include <config.h>
 #include "glib.h"
 
 #include "spicestream.h"
+#include "spice2.h"
+#include "ss_spc.h"
 
 extern SpiceStream *sf_rdhdr_hspice(char *name, FILE *fp);
 extern SpiceStream *sf_rdhdr_hsascii(char *name, FILE *fp);
@@ -39,9 +46,14 @@ extern SpiceStream *sf_rdhdr_hsbin(char *name, FILE *fp);
 extern SpiceStream *sf_rdhdr_cazm(char *name, FILE *fp);
 extern SpiceStream *sf_rdhdr_s3raw(char *name, FILE *fp);
 extern SpiceStream *sf_rdhdr_s2raw(char *name, FILE *fp);
+extern SpiceStream *sf_rdhdr_spc(char *name, FILE *fp);
 extern SpiceStream *sf_rdhdr_ascii(char *name, FILE *fp);
 // extern SpiceStream *sf_rdhdr_nsout(char *name, FILE *fp);
 static int ss_readrow_none(SpiceStream *, double *ivar, double *dvars);
+static int ss_readrows_none(SpiceStream *, int maxrows, double *ivbuf,
+                            double **colbufs, int *nrows);
+static int ss_readrows_generic(SpiceStream *, int maxrows, double *ivbuf,
+                               double **colbufs, int *nrows);
 
 SSMsgLevel spicestream_msg_level = WARN;
 
@@ -61,16 +73,104 @@ static DFormat format_tab[] =
 	{"cazm", sf_rdhdr_cazm },
 	{"spice3raw", sf_rdhdr_s3raw },
 	{"spice2raw", sf_rdhdr_s2raw },
+	{"spc", sf_rdhdr_spc },
 	{"ascii", sf_rdhdr_ascii },
 	// {"nsout", sf_rdhdr_nsout },
 };
 static const int NFormats = sizeof(format_tab)/sizeof(DFormat);
 
+/* bytes read from the start of a file to guess its format */
+#define SS_SNIFF_SIZE 4096
+
+/*
+ * Guess the format of a file from the first n bytes of it, by looking
+ * for the same things that the header readers check for first.
+ * Returns the name of the format, or NULL if it doesn't look like any.
+ */
+char *
+ss_sniff_format(const char *buf, size_t n)
+{
+	static const char blkhdr_le[4] = { 4, 0, 0, 0 };
+	static const char blkhdr_be[4] = { 0, 0, 0, 4 };
+	const char *p, *nl, *end;
+	int lineno;
+
+	if(n >= 8 && memcmp(buf, SPICE_MAGIC, 8) == 0)
+		return "spice2raw";
+	if(n >= 7 && memcmp(buf, "Title: ", 7) == 0)
+		return "spice3raw";
+	if(n >= 8 && memcmp(buf, SPC_MAGIC, 8) == 0)
+		return "spc";
+
+	/* hspice binary starts with a block header, then an ascii header
+	 * with the post format version at the same place as in the
+	 * first line of an hspice ascii file. */
+	if(n >= 36 && (memcmp(buf, blkhdr_le, 4) == 0 || memcmp(buf, blkhdr_be, 4) == 0)
+	   && memcmp(buf + 8, buf, 4) == 0
+	   && (memcmp(buf + 32, "9007", 4) == 0 || memcmp(buf + 32, "9601", 4) == 0))
+		return "hsbinary";
+	if(n >= 20 && (unsigned char) buf[0] >= ' '
+	   && (memcmp(buf + 16, "9007", 4) == 0 || memcmp(buf + 16, "9601", 4) == 0))
+		return "hsascii";
+
+	/* CAzM has a section header line within the first few lines */
+	end = buf + n;
+	for(p = buf, lineno = 0; p < end && lineno < 30; p = nl + 1, lineno++)
+	{
+		if((nl = memchr(p, '\n', end - p)) == NULL)
+			nl = end;
+		if((nl - p >= 9 && memcmp(p, "TRANSIENT", 9) == 0)
+		   || (nl - p >= 11 && memcmp(p, "AC ANALYSIS", 11) == 0)
+		   || (nl - p >= 8 && memcmp(p, "TRANSFER", 8) == 0))
+			return "cazm";
+	}
+
+	/* plain ascii has a first line of variable names */
+	for(p = buf; p < end && *p != '\n'; p++)
+	{
+		if(!isgraph((unsigned char) *p) && *p != ' ' && *p != '\t'
+		   && *p != '\r')
+			return NULL;
+	}
+	if(p == buf)
+		return NULL;
+	return "ascii";
+}
+
+/*
+ * Read the start of fp, guess its format with ss_sniff_format,
+ * and go back to where it started.
+ * Returns the name of the format, or NULL after printing a message.
+ */
+static char *
+ss_sniff_fp(FILE *fp, char *filename)
+{
+	char buf[SS_SNIFF_SIZE];
+	off64_t pos;
+	size_t n;
+	char *format;
+
+	if((pos = ftello64(fp)) < 0)
+	{
+		ss_msg(ERR, "ss_open", "%s: can't guess the format of input that can't be rewound", filename);
+		return NULL;
+	}
+	n = fread(buf, 1, sizeof(buf), fp);
+	if(fseeko64(fp, pos, SEEK_SET) < 0)
+	{
+		ss_msg(ERR, "ss_open", "%s: can't guess the format of input that can't be rewound", filename);
+		return NULL;
+	}
+	if((format = ss_sniff_format(buf, n)) == NULL)
+		ss_msg(DBG, "ss_open", "%s: format not recognized", filename);
+	return format;
+}
+
 /*
  * Open spice waveform file for reading.
  * Reads in header with signal names (and sometimes signal types).
- * TODO: simple strategies for trying to deduce file type from
- * name or contents.
+ * With format "auto", the format is guessed from the start of the
+ * file by ss_sniff_format, and only that format's header is read.
  */
 
 SpiceStream *
@@ -79,6 +179,12 @@ ss_open_internal(FILE *fp, char *filename, char *format)
 	SpiceStream *ss;
 	int i;
 
+	if(strcmp(format, "auto") == 0)
+	{
+		if((format = ss_sniff_fp(fp, filename)) == NULL)
+			return NULL;
+		ss_msg(DBG, "ss_open", "%s: looks like format %s", filename, format);
+	}
 	for(i = 0; i < NFormats; i++)
 	{
 		if(0==strcmp(format, format_tab[i].name))
@@ -87,6 +193,7 @@ ss_open_internal(FILE *fp, char *filename, char *format)
 			if(ss)
 			{
 				ss->filetype = i;
+				ss_map_input(ss);
 				return ss;
 			}
 			else
@@ -104,21 +211,51 @@ SpiceStream *
 ss_open(char *filename, char *format)
 {
 	FILE *fp;
+	SSPipe *ssp;
+	SpiceStream *ss;
 
-	fp = fopen64(filename, "r");
+	if(strcmp(filename, "-") == 0)
+		fp = stdin;
+	else
+		fp = fopen64(filename, "r");
 	if(fp == NULL)
 	{
 		fprintf(stderr, "fopen(\"%s\"): %s\n", filename, strerror(errno));
 		return NULL;
 	}
+	if((fp = ss_pipeopen(fp, filename, &ssp)) == NULL)
+		return NULL;
+	if((fp = ss_zopen(fp, filename)) == NULL)
+		return NULL;
 
-	return ss_open_internal(fp, filename, format);
+	ss = ss_open_internal(fp, filename, format);
+	if(ss)
+		ss_pipe_headerdone(ssp);
+	return ss;
+}
+
+/*
+ * Open a waveform file of any of the formats that ss_sniff_format
+ * can recognize; the same as ss_open with format "auto".
+ */
+SpiceStream *
+ss_open_auto(char *filename)
+{
+	return ss_open(filename, "auto");
 }
 
 SpiceStream *
 ss_open_fp(FILE *fp, char *format)
 {
-	return ss_open_internal(fp, "<spicestream>", format);
+	SSPipe *ssp;
+	SpiceStream *ss;
+
+	if((fp = ss_pipeopen(fp, "<spicestream>", &ssp)) == NULL)
+		return NULL;
+	ss = ss_open_internal(fp, "<spicestream>", format);
+	if(ss)
+		ss_pipe_headerdone(ssp);
+	return ss;
 }
 
 /*
@@ -143,6 +280,7 @@ ss_new(FILE *fp, char *filename, int ndv, int nspar)
 	ss->nsweepparam = nspar;
 	if(nspar)
 		ss->spar = g_new0(SpiceVar, nspar);
+	ss->readblock = ss_readrows_generic;
 
 	return ss;
 }
@@ -154,9 +292,14 @@ ss_new(FILE *fp, char *filename, int ndv, int nspar)
  */
 void ss_close(SpiceStream *ss)
 {
+	if(ss->rdfree)
+		(ss->rdfree)(ss);
+	ss->rdfree = NULL;
+	ss_unmap_input(ss);
 	fclose(ss->fp);
 	ss->fp = NULL;
 	ss->readrow = ss_readrow_none;
+	ss->readblock = ss_readrows_none;
 }
 
 /*
@@ -164,6 +307,9 @@ void ss_close(SpiceStream *ss)
  */
 void ss_delete(SpiceStream *ss)
 {
+	if(ss->rdfree)
+		(ss->rdfree)(ss);
+	ss_unmap_input(ss);
 	if(ss->fp)
 		fclose(ss->fp);
 	if(ss->filename)
@@ -174,9 +320,571 @@ void ss_delete(SpiceStream *ss)
 		g_free(ss->dvar);
 	if(ss->linebuf)
 		g_free(ss->linebuf);
+	if(ss->rowbuf)
+		g_free(ss->rowbuf);
+	if(ss->iobuf)
+		g_free(ss->iobuf);
+	if(ss->valbuf)
+		g_free(ss->valbuf);
+	if(ss->colsel)
+		g_free(ss->colsel);
+	if(ss->projcols)
+		g_free(ss->projcols);
 	g_free(ss);
 }
 
+/*
+ * If the input is a regular file, map it into memory so that the readers
+ * can decode data straight from the page cache, with sequential readahead.
+ * Called after the header has been read; reading through the mapping
+ * starts at the current position of the FILE*.
+ * If the file can't be mapped, everything keeps working through stdio.
+ */
+void
+ss_map_input(SpiceStream *ss)
+{
+#if defined(_POSIX_MAPPED_FILES) && _POSIX_MAPPED_FILES > 0
+	struct stat st;
+	off64_t pos;
+	void *p;
+	int fd;
+
+	if(ss->fp == NULL || ss->mapbase || (fd = fileno(ss->fp)) < 0)
+		return;
+	if(fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size == 0)
+		return;
+	if((off_t)(size_t)st.st_size != st.st_size)
+		return;	/* too big for our address space */
+	pos = ftello64(ss->fp);
+	if(pos < 0 || pos > st.st_size)
+		return;
+
+	p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if(p == MAP_FAILED)
+	{
+		ss_msg(DBG, "ss_map_input", "%s: mmap: %s", ss->filename, strerror(errno));
+		return;
+	}
+#ifdef MADV_SEQUENTIAL
+	madvise(p, st.st_size, MADV_SEQUENTIAL);
+#endif
+	ss->mapbase = p;
+	ss->mapp = ss->mapbase + pos;
+	ss->mapend = ss->mapbase + st.st_size;
+	ss_msg(DBG, "ss_map_input", "%s: mapped %ld bytes, data at offset 0x%lx",
+	       ss->filename, (long) st.st_size, (long) pos);
+#endif
+}
+
+/*
+ * Release the input mapping, if there is one.
+ */
+void
+ss_unmap_input(SpiceStream *ss)
+{
+#if defined(_POSIX_MAPPED_FILES) && _POSIX_MAPPED_FILES > 0
+	if(ss->mapbase)
+		munmap(ss->mapbase, ss->mapend - ss->mapbase);
+#endif
+	ss->mapbase = ss->mapp = ss->mapend = NULL;
+}
+
+/*
+ * slow path of ss_getbytes: read n bytes through stdio into our buffer,
+ * or return NULL at EOF.  Also handles a short mapping at EOF.
+ */
+void *
+ss_readbytes(SpiceStream *ss, size_t n)
+{
+	if(ss->mapbase)
+		return NULL;
+	if(n > ss->iobufsize)
+	{
+		ss->iobufsize = (n > 1024) ? n : 1024;
+		ss->iobuf = g_realloc(ss->iobuf, ss->iobufsize);
+	}
+	if(fread(ss->iobuf, 1, n, ss->fp) != n)
+		return NULL;
+	return ss->iobuf;
+}
+
+/*
+ * Like ss_getbytes, but if fewer than *np bytes remain before EOF,
+ * return those instead, with their count stored in *np.
+ * Returns NULL only if there is no data left at all.
+ */
+void *
+ss_getbytes_avail(SpiceStream *ss, size_t *np)
+{
+	size_t n = *np;
+	char *p;
+
+	if(ss->mapbase)
+	{
+		if((size_t)(ss->mapend - ss->mapp) < n)
+			n = ss->mapend - ss->mapp;
+		if(n == 0)
+			return NULL;
+		p = ss->mapp;
+		ss->mapp += n;
+		*np = n;
+		return p;
+	}
+	if(n > ss->iobufsize)
+	{
+		ss->iobufsize = (n > 1024) ? n : 1024;
+		ss->iobuf = g_realloc(ss->iobuf, ss->iobufsize);
+	}
+	n = fread(ss->iobuf, 1, n, ss->fp);
+	if(n == 0)
+		return NULL;
+	*np = n;
+	return ss->iobuf;
+}
+
+/*
+ * Skip over the next n bytes of input.
+ */
+int
+ss_skipbytes(SpiceStream *ss, size_t n)
+{
+	char buf[4096];
+	size_t k;
+
+	if(ss->mapbase)
+	{
+		if((size_t)(ss->mapend - ss->mapp) < n)
+		{
+			ss->mapp = ss->mapend;
+			return 0;
+		}
+		ss->mapp += n;
+		return 1;
+	}
+	if(n == 0 || fseeko64(ss->fp, n, SEEK_CUR) == 0)
+		return 1;
+
+	/* not seekable; read and discard */
+	while(n > 0)
+	{
+		k = (n < sizeof(buf)) ? n : sizeof(buf);
+		if(fread(buf, 1, k, ss->fp) != k)
+			return 0;
+		n -= k;
+	}
+	return 1;
+}
+
+/*
+ * Return a pointer to the next line of input, without its newline, and
+ * store its length in *lenp.  If the file is mapped the line is found
+ * in place, with nothing copied and no nul at the end; otherwise it is
+ * read into sf->linebuf, which is grown as needed.
+ * Returns NULL at EOF.
+ */
+char *
+ss_readline(SpiceStream *ss, int *lenp)
+{
+	char *p, *nl;
+	int n;
+
+	if(ss->mapbase)
+	{
+		if(ss->mapp >= ss->mapend)
+			return NULL;
+		p = ss->mapp;
+		ss->linepos = p - ss->mapbase;
+		nl = memchr(p, '\n', ss->mapend - p);
+		if(nl)
+		{
+			ss->mapp = nl + 1;
+			*lenp = nl - p;
+		}
+		else
+		{
+			ss->mapp = ss->mapend;
+			*lenp = ss->mapend - p;
+		}
+		return p;
+	}
+
+	if(ss->linebuf == NULL)
+	{
+		if(ss->lbufsize == 0)
+			ss->lbufsize = 1024;
+		ss->linebuf = g_new(char, ss->lbufsize);
+	}
+	ss->linepos = ftello64(ss->fp);
+	n = 0;
+	for(;;)
+	{
+		if(fgets(ss->linebuf + n, ss->lbufsize - n, ss->fp) == NULL)
+		{
+			if(n == 0)
+				return NULL;
+			break;
+		}
+		n += strlen(ss->linebuf + n);
+		if(n > 0 && ss->linebuf[n-1] == '\n')
+		{
+			n--;
+			break;
+		}
+		if(n < ss->lbufsize - 1)
+			break;		/* no newline at EOF */
+		ss->lbufsize *= 2;
+		ss->linebuf = g_realloc(ss->linebuf, ss->lbufsize);
+	}
+	ss->linebuf[n] = 0;
+	*lenp = n;
+	return ss->linebuf;
+}
+
+/*
+ * Return the file offset that the next byte of data will come from.
+ */
+off64_t
+ss_inpos(SpiceStream *ss)
+{
+	if(ss->mapbase)
+		return ss->mapp - ss->mapbase;
+	return ftello64(ss->fp);
+}
+
+/*
+ * Size of the input file, or -1 if it isn't a regular file, or is read
+ * through a decompressing stream, so that there's no telling.
+ */
+off64_t
+ss_input_size(SpiceStream *ss)
+{
+	struct stat st;
+
+	if(ss->mapbase)
+		return ss->mapend - ss->mapbase;
+	if(fstat(fileno(ss->fp), &st) == 0 && S_ISREG(st.st_mode))
+		return st.st_size;
+	return -1;
+}
+
+/*
+ * Move the input to file offset pos.
+ * Returns 0 on success, -1 if the input can't be positioned there.
+ */
+int
+ss_setpos(SpiceStream *ss, off64_t pos)
+{
+	if(ss->mapbase)
+	{
+		if(pos < 0 || pos > ss->mapend - ss->mapbase)
+			return -1;
+		ss->mapp = ss->mapbase + pos;
+		return 0;
+	}
+	if(fseeko64(ss->fp, pos, SEEK_SET) < 0)
+		return -1;
+	return 0;
+}
+
+/*
+ * tellpos and seekpos functions for readers that take their input
+ * through ss_getbytes and keep nothing read ahead.
+ */
+int
+ss_tellpos_bytes(SpiceStream *ss, SSCheckpoint *cp)
+{
+	off64_t pos;
+
+	if((pos = ss_inpos(ss)) < 0)
+		return -1;
+	cp->offset = pos;
+	return 0;
+}
+
+int
+ss_seekpos_bytes(SpiceStream *ss, SSCheckpoint *cp)
+{
+	return ss_setpos(ss, cp->offset);
+}
+
+/*
+ * Save the position of the reader in *cp.  The position is between
+ * two rows: call this before reading any data, or after ss_readrow,
+ * ss_readblock or ss_readsweep have returned.
+ * Returns 0 on success, -1 if the format or input doesn't allow it.
+ */
+int
+ss_tell(SpiceStream *ss, SSCheckpoint *cp)
+{
+	if(ss->fp == NULL || ss->tellpos == NULL)
+		return -1;
+	cp->offset = 0;
+	cp->aux = 0;
+	cp->flags = ss->flags & (SSF_ESWAP | SSF_PUSHBACK | SSF_BLKPEND);
+	cp->blkrc = ss->blkrc;
+	cp->lineno = ss->lineno;
+	cp->expected_vals = ss->expected_vals;
+	cp->read_vals = ss->read_vals;
+	cp->read_rows = ss->read_rows;
+	cp->read_tables = ss->read_tables;
+	cp->read_sweepparam = ss->read_sweepparam;
+	cp->ivval = ss->ivval;
+	return (ss->tellpos)(ss, cp);
+}
+
+/*
+ * Go back (or forward) to a position saved by ss_tell on this
+ * SpiceStream, or on another one open on the same file.  Reading
+ * carries on from there as if the rows in between had just been read.
+ * Returns 0 on success, or -1 if the input can't be repositioned.
+ */
+int
+ss_seek(SpiceStream *ss, SSCheckpoint *cp)
+{
+	if(ss->fp == NULL || ss->seekpos == NULL)
+		return -1;
+	if((ss->seekpos)(ss, cp) < 0)
+	{
+		ss_msg(DBG, "ss_seek", "%s: can't seek to offset 0x%lx",
+		       ss->filename, (long) cp->offset);
+		return -1;
+	}
+	ss->flags &= ~(SSF_ESWAP | SSF_PUSHBACK | SSF_BLKPEND);
+	ss->flags |= cp->flags;
+	ss->blkrc = cp->blkrc;
+	ss->lineno = cp->lineno;
+	ss->expected_vals = cp->expected_vals;
+	ss->read_vals = cp->read_vals;
+	ss->read_rows = cp->read_rows;
+	ss->read_tables = cp->read_tables;
+	ss->read_sweepparam = cp->read_sweepparam;
+	ss->ivval = cp->ivval;
+	return 0;
+}
+
+/*
+ * Number of rows of a file with fixed-size rows that are checked to be
+ * in order before ss_seek_ival relies on a binary search.
+ */
+#define SS_IVSAMPLES 64
+
+/*
+ * Fetch the independent-variable value at the start of row k of a file
+ * with fixed-size rows, without moving the read position.
+ * Returns 0 on success, -1 if the row isn't in the file.
+ */
+static int
+ss_rowival(SpiceStream *ss, long long k, double *ivp)
+{
+	off64_t off;
+
+	off = ss->rowbase + k * ss->rowsize;
+	if(ss->mapbase)
+	{
+		if(off < 0 || off > (ss->mapend - ss->mapbase) - (off64_t) sizeof(double))
+			return -1;
+		memcpy(ivp, ss->mapbase + off, sizeof(double));
+		return 0;
+	}
+	if(pread64(fileno(ss->fp), ivp, sizeof(double), off) != sizeof(double))
+		return -1;
+	return 0;
+}
+
+/*
+ * Return the number of whole rows in a file with fixed-size rows,
+ * no more than the header said to expect, or -1 if the size
+ * of the file can't be found.
+ */
+static long long
+ss_fixed_nrows(SpiceStream *ss)
+{
+	off64_t size;
+	long long n;
+
+	if((size = ss_input_size(ss)) < 0)
+		return -1;
+	if(size < ss->rowbase)
+		return 0;
+	n = (size - ss->rowbase) / ss->rowsize;
+	if(ss->expected_vals > 0 && ss->expected_vals / ss->rowvals < n)
+		n = ss->expected_vals / ss->rowvals;
+	return n;
+}
+
+/*
+ * Check that SS_IVSAMPLES rows spread evenly over the n rows of the
+ * file have nondecreasing independent-variable values.
+ * Returns 1 if they do, 0 if they don't or can't be read.
+ */
+static int
+ss_check_ivsorted(SpiceStream *ss, long long n)
+{
+	long long i, k;
+	double v, last;
+
+	last = -DBL_MAX;
+	for(i = 0; i < SS_IVSAMPLES && i < n; i++)
+	{
+		k = (n < SS_IVSAMPLES) ? i : i * (n - 1) / (SS_IVSAMPLES - 1);
+		if(ss_rowival(ss, k, &v) < 0 || !(v >= last))
+			return 0;
+		last = v;
+	}
+	return 1;
+}
+
+/*
+ * In a file with fixed-size rows, skip forward over the rows that have
+ * independent-variable values less than ival, by a binary search over
+ * the rows not yet read instead of reading them all.
+ * The search relies on the independent variable never decreasing; the
+ * first call checks that on a sample of rows across the file, and each
+ * row looked at during a search must fit too.  Files that fail, such as
+ * spice3 files with several sweeps, are left to be read row by row.
+ * Call this before reading any data or between calls to ss_readblock.
+ *
+ * Returns 1 if rows were skipped, 0 if there were none to skip, or -1
+ * if the format, the input, or the order of the rows doesn't allow it.
+ */
+int
+ss_seek_ival(SpiceStream *ss, double ival)
+{
+	off64_t pos;
+	long long n, start, lo, hi, mid;
+	double v, lov, hiv;
+
+	if(ss->fp == NULL || ss->rowsize <= 0
+	   || (ss->flags & (SSF_PUSHBACK | SSF_BLKPEND | SSF_IVUNSORTED)))
+		return -1;
+	pos = ss_inpos(ss);
+	if(pos < ss->rowbase || (pos - ss->rowbase) % ss->rowsize != 0)
+		return -1;
+	if((n = ss_fixed_nrows(ss)) < 0)
+		return -1;
+	if((ss->flags & SSF_IVSORTED) == 0)
+	{
+		if(!ss_check_ivsorted(ss, n))
+		{
+			ss_msg(DBG, "ss_seek_ival", "%s: independent variable not in order; reading all rows", ss->filename);
+			ss->flags |= SSF_IVUNSORTED;
+			return -1;
+		}
+		ss->flags |= SSF_IVSORTED;
+	}
+
+	/* find the first row from start on with a value >= ival,
+	 * keeping the values just outside of lo to hi in lov and hiv. */
+	start = lo = (pos - ss->rowbase) / ss->rowsize;
+	hi = n;
+	lov = -DBL_MAX;
+	hiv = DBL_MAX;
+	while(lo < hi)
+	{
+		mid = lo + (hi - lo) / 2;
+		if(ss_rowival(ss, mid, &v) < 0 || !(v >= lov && v <= hiv))
+		{
+			ss_msg(DBG, "ss_seek_ival", "%s: row %lld out of order; reading all rows", ss->filename, mid);
+			ss->flags &= ~SSF_IVSORTED;
+			ss->flags |= SSF_IVUNSORTED;
+			return -1;
+		}
+		if(v < ival)
+		{
+			lo = mid + 1;
+			lov = v;
+		}
+		else
+		{
+			hi = mid;
+			hiv = v;
+		}
+	}
+	if(lo == start)
+		return 0;
+	if(ss_setpos(ss, ss->rowbase + lo * ss->rowsize) < 0)
+		return -1;
+	ss->read_vals += (lo - start) * ss->rowvals;
+	ss->read_rows += lo - start;
+	ss->ivval = lov;
+	return 1;
+}
+
+/*
+ * Most values read at a time by ss_skip_table for formats that
+ * can't skip a table by themselves.
+ */
+#define SS_SKIPVALS 65536
+
+/*
+ * Pass over the rest of the current table, without handing out its rows.
+ * Readers that can do so step over the rows without decoding them; for
+ * the others, the rows are read a block at a time and dropped.
+ * Call this between calls to ss_readblock.
+ *
+ * Returns -2 if another table follows, 0 on EOF, or -1 on error, the
+ * same as the ss_readblock call that would have ended the table.
+ */
+int
+ss_skip_table(SpiceStream *ss)
+{
+	double *ivbuf;
+	double **colbufs;
+	int i, maxrows, rc;
+
+	if(ss->flags & SSF_BLKPEND)
+	{
+		ss->flags &= ~SSF_BLKPEND;
+		return ss->blkrc;
+	}
+	if(ss->skiptable)
+		return (ss->skiptable)(ss);
+	ss_seek_ival(ss, DBL_MAX);
+
+	maxrows = SS_SKIPVALS / ss->ncols;
+	if(maxrows < 1)
+		maxrows = 1;
+	ivbuf = g_new(double, maxrows);
+	colbufs = g_new0(double *, ss->ncols);
+	for(i = 0; i < ss->ncols-1; i++)
+		if(ss->colsel == NULL || ss->colsel[i])
+			colbufs[i] = g_new(double, maxrows);
+	while((rc = ss_readblock(ss, maxrows, ivbuf, colbufs)) > 0)
+		;
+	for(i = 0; i < ss->ncols-1; i++)
+		if(colbufs[i])
+			g_free(colbufs[i]);
+	g_free(colbufs);
+	g_free(ivbuf);
+	return rc;
+}
+
+/*
+ * Estimate how many rows are left to read in the file, so that callers
+ * reading all of it can plan their memory use.  Files with fixed-size
+ * rows give the exact number; for other formats, the reader guesses from
+ * the header or the size of the file if it can, and the guess may be a
+ * little high or low.  Rows in all of the tables that follow are counted.
+ *
+ * Returns 0 if there's no telling.
+ */
+long long
+ss_estimate_rows(SpiceStream *ss)
+{
+	long long n, done;
+
+	if(ss->fp == NULL)
+		return 0;
+	if(ss->rowsize > 0 && (n = ss_fixed_nrows(ss)) >= 0)
+	{
+		done = (ss_inpos(ss) - ss->rowbase) / ss->rowsize;
+		return (n > done) ? n - done : 0;
+	}
+	if(ss->estrows && (n = (ss->estrows)(ss)) > 0)
+		return n;
+	return 0;
+}
+
 /*
  * row-reading function that always returns EOF.
  */
@@ -186,6 +894,162 @@ ss_readrow_none(SpiceStream *ss, double *ivar, double *dvars)
 	return 0;
 }
 
+/*
+ * Read up to maxrows rows of data into column-major buffers.
+ * ivbuf receives the independent variable, and colbufs[c-1] receives
+ * data column c, numbered the same way as the dvars array filled in
+ * by ss_readrow.  Each buffer must have room for maxrows values.
+ *
+ * Returns:
+ *	n > 0: number of rows read
+ *	0 on EOF, -1 on error, -2 on end of table, the same as ss_readrow.
+ * If a table boundary, EOF, or error is found after some rows have
+ * been read, those rows are returned first and the status is returned
+ * by the next call.
+ * Don't mix calls to ss_readrow and ss_readblock on the same table.
+ */
+int
+ss_readblock(SpiceStream *ss, int maxrows, double *ivbuf, double **colbufs)
+{
+	int rc;
+	int nrows = 0;
+
+	if(ss->flags & SSF_BLKPEND)
+	{
+		ss->flags &= ~SSF_BLKPEND;
+		return ss->blkrc;
+	}
+	rc = (ss->readblock)(ss, maxrows, ivbuf, colbufs, &nrows);
+	if(nrows > 0)
+	{
+		if(rc <= 0)
+		{
+			ss->blkrc = rc;
+			ss->flags |= SSF_BLKPEND;
+		}
+		return nrows;
+	}
+	if(rc > 0)	/* maxrows == 0 */
+		return 0;
+	return rc;
+}
+
+/*
+ * Tell the reader that only the n dependent variables whose indices
+ * (into sf->dvar) are listed in dvsel will be used.  Readers that support
+ * it skip over the values in the other columns without converting them,
+ * so that the cost of reading a wide file depends mostly on the number
+ * of columns wanted.  The dvars and colbufs entries for unwanted columns
+ * are left alone, and the colbufs pointers for them may be NULL.
+ * The independent variable is always read.
+ * Passing a NULL dvsel turns projection off again.
+ *
+ * Returns 0 on success, -1 if an index is out of range.
+ */
+int
+ss_set_projection(SpiceStream *ss, int *dvsel, int n)
+{
+	char *colsel;
+	int i, j, nsel;
+
+	if(ss->colsel)
+		g_free(ss->colsel);
+	if(ss->projcols)
+		g_free(ss->projcols);
+	ss->colsel = NULL;
+	ss->projcols = NULL;
+	ss->nprojcols = 0;
+	if(dvsel == NULL || ss->ncols < 2)
+		return 0;
+
+	colsel = g_new0(char, ss->ncols-1);
+	for(i = 0; i < n; i++)
+	{
+		if(dvsel[i] < 0 || dvsel[i] >= ss->ndv)
+		{
+			ss_msg(ERR, "ss_set_projection", "no dependent variable %d", dvsel[i]);
+			g_free(colsel);
+			return -1;
+		}
+		for(j = 0; j < ss->dvar[dvsel[i]].ncols; j++)
+			colsel[ss->dvar[dvsel[i]].col - 1 + j] = 1;
+	}
+	nsel = 0;
+	for(i = 0; i < ss->ncols-1; i++)
+		if(colsel[i])
+			nsel++;
+	if(nsel == ss->ncols-1)
+	{
+		/* everything is wanted anyway */
+		g_free(colsel);
+		return 0;
+	}
+
+	ss->colsel = colsel;
+	ss->projcols = g_new(int, nsel ? nsel : 1);
+	for(i = 0; i < ss->ncols-1; i++)
+		if(colsel[i])
+			ss->projcols[ss->nprojcols++] = i;
+	return 0;
+}
+
+/*
+ * Allow the reader to use up to n threads to convert the data, for
+ * formats where that is possible.  So far these are ascii and cazm,
+ * when the input could be memory-mapped.  Rows are still returned
+ * in order.  Call this before reading any data.
+ */
+void
+ss_set_threads(SpiceStream *ss, int n)
+{
+	ss->nthreads = (n < 1) ? 1 : n;
+}
+
+/*
+ * block-reading function for formats that only provide readrow.
+ * Returns 1 if maxrows rows were read, otherwise the status
+ * from readrow, with the number of rows stored in *nrows.
+ */
+static int
+ss_readrows_generic(SpiceStream *ss, int maxrows, double *ivbuf,
+                    double **colbufs, int *nrows)
+{
+	int i, n;
+	int rc = 1;
+
+	if(ss->rowbuf == NULL)
+		ss->rowbuf = g_new(double, ss->ncols);
+	for(n = 0; n < maxrows; n++)
+	{
+		rc = ss_readrow(ss, &ivbuf[n], ss->rowbuf);
+		if(rc <= 0)
+			break;
+		if(ss->projcols)
+		{
+			for(i = 0; i < ss->nprojcols; i++)
+				colbufs[ss->projcols[i]][n] = ss->rowbuf[ss->projcols[i]];
+		}
+		else
+		{
+			for(i = 0; i < ss->ncols-1; i++)
+				colbufs[i][n] = ss->rowbuf[i];
+		}
+	}
+	*nrows = n;
+	return rc;
+}
+
+/*
+ * block-reading function that always returns EOF.
+ */
+static int
+ss_readrows_none(SpiceStream *ss, int maxrows, double *ivbuf,
+                 double **colbufs, int *nrows)
+{
+	*nrows = 0;
+	return 0;
+}
+
 
 static char *vartype_names[] =
 {
@@ -13,6 +13,9 @@ extern "C" {
 
 typedef struct _SpiceStream SpiceStream;
 typedef struct _SpiceVar SpiceVar;
+typedef struct _SSCheckpoint SSCheckpoint;
+typedef struct _SSIndex SSIndex;
+typedef struct _SSPipe SSPipe;
 
 
 typedef enum
@@ -41,8 +44,32 @@ struct _SpiceVar
 	int ncols;  /* number of columns of data for this variable; complex numbers have two */
 };
 
+/* A position in the data part of a file, between two rows, saved by
+ * ss_tell so that ss_seek can go back to it later.  Holds everything
+ * that the readers keep about where they are.
+ */
+struct _SSCheckpoint
+{
+	long long offset;	/* file offset that reading carries on from */
+	int aux;	/* reader-specific, such as a value index within a line */
+	int flags;	/* SSF_ESWAP, SSF_PUSHBACK and SSF_BLKPEND */
+	int blkrc;
+	int lineno;
+	int expected_vals;
+	int read_vals;
+	int read_rows;
+	int read_tables;
+	int read_sweepparam;
+	double ivval;
+};
+
 typedef int (*SSReadRow) (SpiceStream *sf, double *ivar, double *dvars);
 typedef int (*SSReadSweep) (SpiceStream *sf, double *spar);
+typedef int (*SSReadBlock) (SpiceStream *sf, int maxrows, double *ivbuf,
+			    double **colbufs, int *nrows);
+typedef int (*SSTellPos) (SpiceStream *sf, SSCheckpoint *cp);
+typedef int (*SSSkipTable) (SpiceStream *sf);
+typedef long long (*SSEstimateRows) (SpiceStream *sf);
 
 struct _SpiceStream
 {
@@ -56,6 +83,7 @@ struct _SpiceStream
 
 	SSReadRow readrow;  /* func to read one row of data points */
 	SSReadSweep readsweep;  /* func to read one row of data points */
+	SSReadBlock readblock;  /* func to read a block of rows into columns */
 	int ntables;	/* number of data tables in the file; not
 			* reliable for all file formats */
 	int nsweepparam; /* number of implicit sweep parameter values at the start
@@ -75,7 +103,58 @@ struct _SpiceStream
 	int read_tables;
 	int read_sweepparam;
 	char *linep;
+	long long linepos;	/* file offset of the last line from ss_readline */
 	double ivval;
+	int blkrc;	/* status held back by ss_readblock for the next call */
+	double *rowbuf;	/* row buffer for readers without a native readblock */
+
+	/* input file mapped into memory by ss_open, if possible */
+	char *mapbase;	/* start of mapping, or NULL if reading through fp */
+	char *mapp;	/* current read position in the mapping */
+	char *mapend;	/* end of mapping */
+	char *iobuf;	/* buffer for ss_getbytes when not mapped */
+	size_t iobufsize;
+
+	/* values decoded ahead of the reader, for formats that decode in bulk */
+	double *valbuf;
+	int valbuf_size;	/* allocated size of valbuf, if it can grow */
+	int valbuf_len;	/* number of values in valbuf */
+	int valbuf_pos;	/* index of next value to hand out */
+
+	/* data columns selected by ss_set_projection; NULL if all are wanted.
+	 * Both are indexed like the dvars array: entry i is column i+1. */
+	char *colsel;	/* colsel[i] nonzero if column i+1 is wanted */
+	int *projcols;	/* ascending list of wanted entries */
+	int nprojcols;
+
+	int nthreads;	/* threads a reader may use, from ss_set_threads */
+	void *rdpriv;	/* reader state that needs cleaning up, such as */
+	void (*rdfree)(SpiceStream *sf);	/* worker threads; freed by rdfree */
+
+	/* reader's part of ss_tell and ss_seek: tellpos fills in cp->offset
+	 * and cp->aux, and may adjust the other fields for values that have
+	 * been read ahead; seekpos goes to cp->offset.  NULL if the format
+	 * can't be repositioned. */
+	SSTellPos tellpos;
+	SSTellPos seekpos;
+
+	/* reader's part of ss_skip_table: pass over the rest of the current
+	 * table without decoding it, and return the status that ends it.
+	 * NULL if the rows have to be read. */
+	SSSkipTable skiptable;
+
+	/* reader's part of ss_estimate_rows: a guess at the number of rows
+	 * left in the file, from its header or from its size, or -1 if it
+	 * can't tell.  NULL if the format gives nothing to go on. */
+	SSEstimateRows estrows;
+
+	/* for formats with fixed-size rows that start with the independent
+	 * variable as a native double: row k of the data starts at file
+	 * offset rowbase + k * rowsize, and holds rowvals values.
+	 * rowsize is 0 for other formats.  Used by ss_seek_ival. */
+	long long rowbase;
+	int rowsize;
+	int rowvals;
 
 	/* following for nsout format */
 	double voltage_resolution;
@@ -89,19 +168,53 @@ struct _SpiceStream
 /* values for flags field */
 #define SSF_ESWAP 1
 #define SSF_PUSHBACK 2
+#define SSF_BLKPEND 4
+#define SSF_DECODED 8
+#define SSF_IVSORTED 16	/* ss_seek_ival found the rows in order */
+#define SSF_IVUNSORTED 32	/* ss_seek_ival found they aren't */
+#define SSF_SINGLE 64	/* values are single precision in the file */
 
 #define ss_readrow(sf, ivp, dvp) ((sf->readrow)(sf, ivp, dvp))
 #define ss_readsweep(sf, swp) ((sf->readsweep)(sf, swp))
 
 extern SpiceStream *ss_open(char *filename, char *type);
 extern SpiceStream *ss_open_fp(FILE *fp, char *type);
+extern SpiceStream *ss_open_auto(char *filename);
+extern char *ss_sniff_format(const char *buf, size_t n);
+extern FILE *ss_zopen(FILE *fp, char *filename);
+extern FILE *ss_pipeopen(FILE *fp, char *filename, SSPipe **pipep);
+extern void ss_pipe_headerdone(SSPipe *p);
 extern SpiceStream *ss_open_internal(FILE *fp, char *name, char *type);
 extern SpiceStream *ss_new(FILE *fp, char *name, int ndv, int nspar);
+extern int ss_readblock(SpiceStream *sf, int maxrows, double *ivbuf,
+			double **colbufs);
+extern int ss_set_projection(SpiceStream *sf, int *dvsel, int n);
+extern void ss_set_threads(SpiceStream *sf, int n);
+extern int ss_tell(SpiceStream *sf, SSCheckpoint *cp);
+extern int ss_seek(SpiceStream *sf, SSCheckpoint *cp);
+extern int ss_seek_ival(SpiceStream *sf, double ival);
+extern int ss_skip_table(SpiceStream *sf);
+extern long long ss_estimate_rows(SpiceStream *sf);
+extern SSIndex *ss_index_build(SpiceStream *sf, int interval);
+extern SSIndex *ss_index_load(SpiceStream *sf, char *filename);
+extern int ss_index_save(SSIndex *ix, char *filename);
+extern SSIndex *ss_index_open(SpiceStream *sf, int interval);
+extern SSCheckpoint *ss_index_find(SSIndex *ix, int table, double ival);
+extern int ss_index_seek(SSIndex *ix, SpiceStream *sf, int table, double ival);
+extern int ss_index_next_table(SSIndex *ix, SpiceStream *sf, int table);
+extern void ss_index_free(SSIndex *ix);
+extern int ss_spc_table(SpiceStream *sf, int t, int *nrowsp, int *chunkrowsp,
+			int *sortedp, double **swvalsp);
+extern int ss_spc_column(SpiceStream *sf, int t, int col, double **blocks,
+			 double *minp, double *maxp);
 extern void ss_close(SpiceStream *sf);
 extern void ss_delete(SpiceStream *ss);
 extern char *ss_var_name(SpiceVar *sv, int col, char *buf, int n);
 extern char *vartype_name_str(VarType type);
 extern int fread_line(FILE *fp, char **bufp, int *bufsize);
+extern double ss_strtod(const char *s, char **endp);
+extern double ss_strntod(const char *s, size_t n, char **endp);
+extern int ss_fmtg(char *buf, double v, int ndigits);
 extern void ss_msg(SSMsgLevel type, const char *id, const char *msg, ...);
 extern char *ss_filetype_name(int n);
 
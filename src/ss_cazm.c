@@ -43,14 +43,31 @@
 #include <string.h>
 #include <ctype.h>
 #include <float.h>
+#include <unistd.h>
 
 // #include <config.h>
 #include "glib.h"
 #include "spicestream.h"
 
+#if defined(_POSIX_THREADS) && _POSIX_THREADS > 0
+#include <pthread.h>
+#define ASCII_THREADS 1
+#endif
+
 static int sf_readrow_ascii(SpiceStream *sf, double *ivar, double *dvars);
+static int sf_readrows_ascii(SpiceStream *sf, int maxrows, double *ivbuf,
+                             double **colbufs, int *nrows);
 static SpiceStream *ascii_process_header(char *line, VarType ivtype,
         char *fname, int lineno);
+static int sf_tellpos_ascii(SpiceStream *sf, SSCheckpoint *cp);
+static int sf_seekpos_ascii(SpiceStream *sf, SSCheckpoint *cp);
+#ifdef ASCII_THREADS
+static int ascii_par_start(SpiceStream *sf);
+static int ascii_par_readrows(SpiceStream *sf, int maxrows, double *ivbuf,
+                              double **colbufs, double *dvars, int *nrows);
+static char *ascii_par_tell(SpiceStream *sf);
+static int ascii_par_seek(SpiceStream *sf, char *p);
+#endif
 
 /* Read spice-type file header - cazm format */
 SpiceStream *
@@ -222,23 +239,24 @@ SpiceStream *ascii_process_header(char *line, VarType ivtype,
 		sf->ncols++;
 	}
 	sf->readrow = sf_readrow_ascii;
+	sf->readblock = sf_readrows_ascii;
+	sf->tellpos = sf_tellpos_ascii;
+	sf->seekpos = sf_seekpos_ascii;
 
 	return sf;
 }
 
 
 
-/* Read row of values from ascii- or cazm- format file.
- * Possibly reusable for other future formats with lines of
- * whitespace-seperated values.
- * Returns:
- *	1 on success.  also fills in *ivar scalar and *dvars vector
- *	0 on EOF
- *	-1 on error  (may change some ivar/dvar values)
+/*
+ * Read the next line of an ascii- or cazm- format file and return its
+ * first token, which has been checked to look like a number.
+ * Returns 1 with *tokp set on success,
+ *	0 on EOF or blank line
+ *	-1 on error
  */
-static int sf_readrow_ascii(SpiceStream *sf, double *ivar, double *dvars)
+static int ascii_nextline(SpiceStream *sf, char **tokp)
 {
-	int i = 0;
 	char *tok;
 
 	if(fread_line(sf->fp, &sf->linebuf, &sf->lbufsize) == EOF)
@@ -258,11 +276,34 @@ static int sf_readrow_ascii(SpiceStream *sf, double *ivar, double *dvars)
 
 	if(strspn(tok, "0123456789eE+-.") != strlen(tok))
 	{
-		ss_msg(ERR, "sf_readrow_ascii", "%s:%d: expected number; maybe this isn't an ascii data file at all?", sf->filename, sf->lineno, i);
+		ss_msg(ERR, "sf_readrow_ascii", "%s:%d: expected number; maybe this isn't an ascii data file at all?", sf->filename, sf->lineno);
 		return -1;
 	}
+	*tokp = tok;
+	return 1;
+}
+
+/* Read row of values from ascii- or cazm- format file.
+ * Possibly reusable for other future formats with lines of
+ * whitespace-seperated values.
+ * Returns:
+ *	1 on success.  also fills in *ivar scalar and *dvars vector
+ *	0 on EOF
+ *	-1 on error  (may change some ivar/dvar values)
+ */
+static int sf_readrow_ascii(SpiceStream *sf, double *ivar, double *dvars)
+{
+	int i, rc;
+	char *tok;
 
-	*ivar = atof(tok);
+#ifdef ASCII_THREADS
+	if(sf->rdpriv || ascii_par_start(sf))
+		return ascii_par_readrows(sf, 1, ivar, NULL, dvars, &i);
+#endif
+	if((rc = ascii_nextline(sf, &tok)) != 1)
+		return rc;
+
+	*ivar = ss_strtod(tok, NULL);
 
 	for(i = 0; i < sf->ncols-1; i++)
 	{
@@ -272,7 +313,512 @@ static int sf_readrow_ascii(SpiceStream *sf, double *ivar, double *dvars)
 			ss_msg(ERR, "sf_readrow_ascii", "%s:%d: data field %d missing", sf->filename, sf->lineno, i);
 			return -1;
 		}
-		dvars[i] = atof(tok);
+		if(sf->colsel == NULL || sf->colsel[i])
+			dvars[i] = ss_strtod(tok, NULL);
 	}
 	return 1;
 }
+
+/* Read block of rows from ascii- or cazm- format file into column buffers.
+ * Returns 1 if maxrows rows were read, otherwise the same status as
+ * sf_readrow_ascii, with the number of rows read in *nrows.
+ */
+static int sf_readrows_ascii(SpiceStream *sf, int maxrows, double *ivbuf,
+                             double **colbufs, int *nrows)
+{
+	int i, n, rc;
+	char *tok;
+
+#ifdef ASCII_THREADS
+	if(sf->rdpriv || ascii_par_start(sf))
+		return ascii_par_readrows(sf, maxrows, ivbuf, colbufs, NULL, nrows);
+#endif
+	for(n = 0; n < maxrows; n++)
+	{
+		if((rc = ascii_nextline(sf, &tok)) != 1)
+		{
+			*nrows = n;
+			return rc;
+		}
+		ivbuf[n] = ss_strtod(tok, NULL);
+
+		for(i = 0; i < sf->ncols-1; i++)
+		{
+			tok = strtok(NULL, " \t\n");
+			if(!tok)
+			{
+				ss_msg(ERR, "sf_readrows_ascii", "%s:%d: data field %d missing", sf->filename, sf->lineno, i);
+				*nrows = n;
+				return -1;
+			}
+			if(sf->colsel == NULL || sf->colsel[i])
+				colbufs[i][n] = ss_strtod(tok, NULL);
+		}
+	}
+	*nrows = n;
+	return 1;
+}
+
+/*
+ * tellpos and seekpos for ascii- and cazm- format files.  Each row is
+ * a line, so the position is that of the next line to be read.
+ */
+static int sf_tellpos_ascii(SpiceStream *sf, SSCheckpoint *cp)
+{
+	off_t pos;
+
+#ifdef ASCII_THREADS
+	if(sf->rdpriv)
+	{
+		cp->offset = ascii_par_tell(sf) - sf->mapbase;
+		return 0;
+	}
+#endif
+	if((pos = ftello(sf->fp)) < 0)
+		return -1;
+	cp->offset = pos;
+	return 0;
+}
+
+static int sf_seekpos_ascii(SpiceStream *sf, SSCheckpoint *cp)
+{
+#ifdef ASCII_THREADS
+	if(sf->rdpriv)
+	{
+		if(cp->offset < 0 || cp->offset > sf->mapend - sf->mapbase)
+			return -1;
+		return ascii_par_seek(sf, sf->mapbase + cp->offset);
+	}
+#endif
+	if(fseeko(sf->fp, cp->offset, SEEK_SET) < 0)
+		return -1;
+	return 0;
+}
+
+#ifdef ASCII_THREADS
+/*
+ * Parallel parsing.
+ * With more than one thread allowed and the file mapped into memory, the
+ * data is cut into chunks of whole lines, which are converted by a pool
+ * of worker threads into rows of values.  The reading thread hands out
+ * the rows chunk by chunk, in file order.  A worker stops at a blank line
+ * or an error, and records what it found there; whatever the workers
+ * did beyond that point is thrown away, and if reading goes on after a
+ * blank line, it starts again from the next line.
+ */
+
+#define ASCII_CHUNK (1 << 20)	/* bytes of text per chunk, about */
+
+/* chunk states */
+#define AC_FREE 0
+#define AC_QUEUED 1
+#define AC_DONE 2
+
+typedef struct {
+	char *begin, *end;	/* text of the chunk; whole lines */
+	int state;
+	int nrows;	/* rows converted */
+	int status;	/* 1 all lines converted, 0 blank line or EOF, -1 error */
+	int stopline;	/* 1 if the line that stopped it counts toward lineno */
+	int errfield;	/* for errors, the missing field, or -1 if not a number */
+	char *stop;	/* where to carry on after a blank line or error */
+	double *vals;	/* nrows rows of ncols values */
+	int valrows;	/* room for rows in vals */
+} AsciiChunk;
+
+typedef struct {
+	pthread_mutex_t lock;
+	pthread_cond_t work;	/* a chunk was queued, or it is time to quit */
+	pthread_cond_t done;	/* a chunk was finished */
+	pthread_t *threads;
+	int nthreads;
+	AsciiChunk *chunks;
+	int nchunks;
+	long head;	/* chunk that rows are being handed out from */
+	long next;	/* next chunk for a worker to take */
+	long tail;	/* next chunk to queue */
+	int rowpos;	/* next row of the head chunk */
+	char *textp;	/* text not yet queued */
+	char *textend;
+	int quit;
+	SpiceStream *sf;
+	long scanchunk;	/* for ascii_par_tell: scanp is the start */
+	int scanrow;	/* of row scanrow of chunk scanchunk */
+	char *scanp;
+} AsciiPar;
+
+#define ascii_isdelim(c) ((c) == ' ' || (c) == '\t')
+
+/*
+ * Convert the lines of a chunk, the same way that ascii_nextline and
+ * sf_readrow_ascii do.  Like fread_line, a last line with no newline
+ * counts as EOF.
+ */
+static void
+ascii_parse_chunk(SpiceStream *sf, AsciiChunk *c)
+{
+	char *p, *nl, *tok;
+	double *row;
+	int i, n;
+
+	c->nrows = 0;
+	c->status = 1;
+	for(p = c->begin; p < c->end; p = nl + 1)
+	{
+		nl = memchr(p, '\n', c->end - p);
+		if(!nl)
+		{
+			c->status = 0;
+			c->stopline = 0;
+			c->stop = c->end;
+			return;
+		}
+		while(p < nl && ascii_isdelim(*p))
+			p++;
+		c->stop = nl + 1;
+		if(p == nl)
+		{
+			c->status = 0;	/* blank line */
+			c->stopline = 1;
+			return;
+		}
+		for(tok = p; p < nl && !ascii_isdelim(*p); p++)
+		{
+			if(!strchr("0123456789eE+-.", *p) || *p == 0)
+				break;
+		}
+		if(p < nl && !ascii_isdelim(*p))
+		{
+			c->status = -1;
+			c->errfield = -1;
+			c->stopline = 1;
+			return;
+		}
+
+		if(c->nrows >= c->valrows)
+		{
+			c->valrows = c->valrows ? 2 * c->valrows : 1024;
+			c->vals = g_realloc(c->vals, c->valrows * sf->ncols * sizeof(double));
+		}
+		row = c->vals + c->nrows * sf->ncols;
+		row[0] = ss_strntod(tok, p - tok, NULL);
+		for(i = 0; i < sf->ncols-1; i++)
+		{
+			while(p < nl && ascii_isdelim(*p))
+				p++;
+			if(p == nl)
+			{
+				c->status = -1;
+				c->errfield = i;
+				c->stopline = 1;
+				return;
+			}
+			for(tok = p, n = 0; p < nl && !ascii_isdelim(*p); p++)
+				n++;
+			if(sf->colsel == NULL || sf->colsel[i])
+				row[i+1] = ss_strntod(tok, n, NULL);
+		}
+		c->nrows++;
+	}
+}
+
+static void *
+ascii_par_worker(void *arg)
+{
+	AsciiPar *ap = arg;
+	AsciiChunk *c;
+
+	pthread_mutex_lock(&ap->lock);
+	for(;;)
+	{
+		while(!ap->quit && ap->next == ap->tail)
+			pthread_cond_wait(&ap->work, &ap->lock);
+		if(ap->quit)
+			break;
+		c = &ap->chunks[ap->next++ % ap->nchunks];
+		pthread_mutex_unlock(&ap->lock);
+
+		ascii_parse_chunk(ap->sf, c);
+
+		pthread_mutex_lock(&ap->lock);
+		c->state = AC_DONE;
+		pthread_cond_broadcast(&ap->done);
+	}
+	pthread_mutex_unlock(&ap->lock);
+	return NULL;
+}
+
+/*
+ * Queue as many chunks as there is room for.  Called with the lock held.
+ */
+static void
+ascii_par_queue(AsciiPar *ap)
+{
+	AsciiChunk *c;
+	char *end, *nl;
+
+	while(ap->tail - ap->head < ap->nchunks && ap->textp < ap->textend)
+	{
+		end = ap->textend;
+		if(end - ap->textp > ASCII_CHUNK)
+		{
+			nl = memchr(ap->textp + ASCII_CHUNK, '\n',
+				    ap->textend - (ap->textp + ASCII_CHUNK));
+			if(nl)
+				end = nl + 1;
+		}
+		c = &ap->chunks[ap->tail++ % ap->nchunks];
+		c->begin = ap->textp;
+		c->end = end;
+		c->state = AC_QUEUED;
+		ap->textp = end;
+	}
+	pthread_cond_broadcast(&ap->work);
+}
+
+/*
+ * Throw away all of the chunks, once the workers are done with them,
+ * and carry on from the text at p.  Called with the lock held.
+ */
+static void
+ascii_par_restart(AsciiPar *ap, char *p)
+{
+	long i;
+
+	ap->tail = ap->next;	/* unqueue chunks nobody has taken */
+	for(i = ap->head; i < ap->tail; i++)
+	{
+		while(ap->chunks[i % ap->nchunks].state != AC_DONE)
+			pthread_cond_wait(&ap->done, &ap->lock);
+	}
+	ap->head = ap->next = ap->tail;
+	ap->rowpos = 0;
+	ap->textp = p;
+}
+
+/*
+ * Return the start of the line that the next row handed out will come
+ * from.  Only the rows' values are kept, so the lines of the head chunk
+ * are counted to find it, carrying on from the last time if possible.
+ */
+static char *
+ascii_par_tell(SpiceStream *sf)
+{
+	AsciiPar *ap = sf->rdpriv;
+	AsciiChunk *c;
+	char *p;
+
+	pthread_mutex_lock(&ap->lock);
+	if(ap->head == ap->tail)
+	{
+		p = ap->textp;
+	}
+	else
+	{
+		c = &ap->chunks[ap->head % ap->nchunks];
+		while(c->state != AC_DONE)
+			pthread_cond_wait(&ap->done, &ap->lock);
+		if(ap->scanchunk != ap->head || ap->scanp == NULL
+		   || ap->scanrow > ap->rowpos)
+		{
+			ap->scanchunk = ap->head;
+			ap->scanrow = 0;
+			ap->scanp = c->begin;
+		}
+		for(; ap->scanrow < ap->rowpos; ap->scanrow++)
+			ap->scanp = (char *) memchr(ap->scanp, '\n', c->end - ap->scanp) + 1;
+		p = ap->scanp;
+	}
+	pthread_mutex_unlock(&ap->lock);
+	return p;
+}
+
+/*
+ * Throw away everything parsed so far, and carry on from the line at p.
+ */
+static int
+ascii_par_seek(SpiceStream *sf, char *p)
+{
+	AsciiPar *ap = sf->rdpriv;
+
+	pthread_mutex_lock(&ap->lock);
+	ascii_par_restart(ap, p);
+	ap->scanp = NULL;
+	pthread_mutex_unlock(&ap->lock);
+	return 0;
+}
+
+/*
+ * Stop the worker threads and free everything.
+ */
+static void
+ascii_par_free(SpiceStream *sf)
+{
+	AsciiPar *ap = sf->rdpriv;
+	int i;
+
+	pthread_mutex_lock(&ap->lock);
+	ap->quit = 1;
+	pthread_cond_broadcast(&ap->work);
+	pthread_mutex_unlock(&ap->lock);
+	for(i = 0; i < ap->nthreads; i++)
+		pthread_join(ap->threads[i], NULL);
+	pthread_mutex_destroy(&ap->lock);
+	pthread_cond_destroy(&ap->work);
+	pthread_cond_destroy(&ap->done);
+	for(i = 0; i < ap->nchunks; i++)
+		g_free(ap->chunks[i].vals);
+	g_free(ap->chunks);
+	g_free(ap->threads);
+	g_free(ap);
+	sf->rdpriv = NULL;
+}
+
+/*
+ * Switch to parallel parsing, if more than one thread is allowed and
+ * the input is mapped.  Returns 1 if it did, 0 if not.
+ */
+static int
+ascii_par_start(SpiceStream *sf)
+{
+	AsciiPar *ap;
+	off_t pos;
+
+	if(sf->nthreads < 2 || sf->mapbase == NULL)
+		return 0;
+	pos = ftello(sf->fp);
+	if(pos < 0 || pos > sf->mapend - sf->mapbase)
+	{
+		sf->nthreads = 1;
+		return 0;
+	}
+
+	ap = g_new0(AsciiPar, 1);
+	ap->sf = sf;
+	ap->nchunks = 4 * sf->nthreads;
+	ap->chunks = g_new0(AsciiChunk, ap->nchunks);
+	ap->threads = g_new(pthread_t, sf->nthreads);
+	ap->textp = sf->mapbase + pos;
+	ap->textend = sf->mapend;
+	pthread_mutex_init(&ap->lock, NULL);
+	pthread_cond_init(&ap->work, NULL);
+	pthread_cond_init(&ap->done, NULL);
+	sf->rdpriv = ap;
+	sf->rdfree = ascii_par_free;
+	for(ap->nthreads = 0; ap->nthreads < sf->nthreads; ap->nthreads++)
+	{
+		if(pthread_create(&ap->threads[ap->nthreads], NULL,
+				  ascii_par_worker, ap) != 0)
+			break;
+	}
+	if(ap->nthreads == 0)
+	{
+		ss_msg(DBG, "ascii_par_start", "%s: no threads", sf->filename);
+		ascii_par_free(sf);
+		sf->rdfree = NULL;
+		sf->nthreads = 1;
+		return 0;
+	}
+	ss_msg(DBG, "ascii_par_start", "%s: parsing with %d threads",
+	       sf->filename, ap->nthreads);
+	return 1;
+}
+
+/*
+ * Hand out up to maxrows rows, into ivbuf and colbufs, or into *ivbuf
+ * and dvars if colbufs is NULL.  Returns as sf_readrows_ascii does.
+ */
+static int
+ascii_par_readrows(SpiceStream *sf, int maxrows, double *ivbuf,
+		   double **colbufs, double *dvars, int *nrows)
+{
+	AsciiPar *ap = sf->rdpriv;
+	AsciiChunk *c;
+	double *row;
+	int n, i, k, rc;
+
+	n = 0;
+	rc = 1;
+	pthread_mutex_lock(&ap->lock);
+	while(n < maxrows)
+	{
+		if(ap->head == ap->tail)
+		{
+			ascii_par_queue(ap);
+			if(ap->head == ap->tail)
+			{
+				rc = 0;	/* EOF */
+				break;
+			}
+		}
+		c = &ap->chunks[ap->head % ap->nchunks];
+		while(c->state != AC_DONE)
+			pthread_cond_wait(&ap->done, &ap->lock);
+
+		if(ap->rowpos < c->nrows)
+		{
+			k = c->nrows - ap->rowpos;
+			if(k > maxrows - n)
+				k = maxrows - n;
+			row = c->vals + ap->rowpos * sf->ncols;
+			ap->rowpos += k;
+			sf->lineno += k;
+			pthread_mutex_unlock(&ap->lock);
+			if(colbufs == NULL)
+			{
+				*ivbuf = row[0];
+				for(i = 0; i < sf->ncols-1; i++)
+					if(sf->colsel == NULL || sf->colsel[i])
+						dvars[i] = row[i+1];
+			}
+			else
+			{
+				for(; k > 0; k--, n++, row += sf->ncols)
+				{
+					ivbuf[n] = row[0];
+					if(sf->projcols)
+					{
+						for(i = 0; i < sf->nprojcols; i++)
+							colbufs[sf->projcols[i]][n] = row[sf->projcols[i]+1];
+					}
+					else
+					{
+						for(i = 0; i < sf->ncols-1; i++)
+							colbufs[i][n] = row[i+1];
+					}
+				}
+			}
+			if(colbufs == NULL)
+				n++;
+			pthread_mutex_lock(&ap->lock);
+			continue;
+		}
+
+		if(c->status == 1)
+		{
+			/* used up; reuse it for more text */
+			c->state = AC_FREE;
+			ap->head++;
+			ap->rowpos = 0;
+			ascii_par_queue(ap);
+			continue;
+		}
+
+		/* blank line, EOF, or error */
+		rc = c->status;
+		sf->lineno += c->stopline;
+		if(rc < 0)
+		{
+			if(c->errfield < 0)
+				ss_msg(ERR, "sf_readrow_ascii", "%s:%d: expected number; maybe this isn't an ascii data file at all?", sf->filename, sf->lineno);
+			else
+				ss_msg(ERR, colbufs ? "sf_readrows_ascii" : "sf_readrow_ascii", "%s:%d: data field %d missing", sf->filename, sf->lineno, c->errfield);
+		}
+		ascii_par_restart(ap, c->stop);
+		break;
+	}
+	pthread_mutex_unlock(&ap->lock);
+	*nrows = n;
+	return rc;
+}
+#endif /* ASCII_THREADS */
@@ -27,6 +27,13 @@
 #include <float.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define HS_HAVE_AVX2 1
+#endif
 
 // #include <config.h>
 #include "glib.h"
@@ -38,11 +45,24 @@ SpiceStream *sf_rdhdr_hsbin(char *name, FILE *fp);
 
 static int sf_readrow_hsascii(SpiceStream *sf, double *ivar, double *dvars);
 static int sf_readrow_hsbin(SpiceStream *sf, double *ivar, double *dvars);
+static int sf_readrows_hsascii(SpiceStream *sf, int maxrows, double *ivbuf,
+                               double **colbufs, int *nrows);
+static int sf_readrows_hsbin(SpiceStream *sf, int maxrows, double *ivbuf,
+                             double **colbufs, int *nrows);
+static int hs_end_table(SpiceStream *sf);
 static SpiceStream *hs_process_header(int nauto, int nprobe,
                                       int nsweepparam, char *line, char *name);
 static int sf_readsweep_hsascii(SpiceStream *sf, double *svar);
 static int sf_readsweep_hsbin(SpiceStream *sf, double *svar);
 static int sf_readblock_hsbin(FILE *fp, char **bufp, int *bufsize, int offset);
+static int sf_tellpos_hsascii(SpiceStream *sf, SSCheckpoint *cp);
+static int sf_seekpos_hsascii(SpiceStream *sf, SSCheckpoint *cp);
+static int sf_tellpos_hsbin(SpiceStream *sf, SSCheckpoint *cp);
+static int sf_seekpos_hsbin(SpiceStream *sf, SSCheckpoint *cp);
+static int sf_skiptable_hsascii(SpiceStream *sf);
+static int sf_skiptable_hsbin(SpiceStream *sf);
+static long long sf_estrows_hsascii(SpiceStream *sf);
+static long long sf_estrows_hsbin(SpiceStream *sf);
 
 struct hsblock_header    /* structure of binary tr0 block headers */
 {
@@ -52,13 +72,14 @@ struct hsblock_header    /* structure of binary tr0 block headers */
 	gint32 block_nbytes;
 };
 
-union gint32bytes
-{
-	gint32 i;
-	gchar b[4];
-};
+/* largest number of values decoded from a data block at one time */
+#define HS_DECODE_VALS 8192
+
+/* width of each value on the data lines of an ascii file */
+#define HS_FIELD_WIDTH 11
 
 static void swap_gint32(gint32 *pi, size_t n);
+static void hs_decode_floats(double *dst, const char *src, int n, int eswap);
 
 /* Read spice-type file header - autosense hspice binary or ascii */
 SpiceStream *
@@ -172,8 +193,14 @@ sf_rdhdr_hsascii(char *name, FILE *fp)
 		goto fail;
 	sf->fp = fp;
 	sf->readrow = sf_readrow_hsascii;
+	sf->readblock = sf_readrows_hsascii;
+	sf->tellpos = sf_tellpos_hsascii;
+	sf->seekpos = sf_seekpos_hsascii;
+	sf->skiptable = sf_skiptable_hsascii;
+	sf->estrows = sf_estrows_hsascii;
 	sf->linebuf = line;
 	sf->linep = NULL;
+	sf->line_length = 0;
 	sf->lbufsize = linesize;
 	sf->ntables = ntables;
 	sf->read_tables = 0;
@@ -273,7 +300,13 @@ sf_rdhdr_hsbin(char *name, FILE *fp)
 
 
 	sf->fp = fp;
+	sf->flags |= SSF_SINGLE;
 	sf->readrow = sf_readrow_hsbin;
+	sf->readblock = sf_readrows_hsbin;
+	sf->tellpos = sf_tellpos_hsbin;
+	sf->seekpos = sf_seekpos_hsbin;
+	sf->skiptable = sf_skiptable_hsbin;
+	sf->estrows = sf_estrows_hsbin;
 	sf->readsweep = sf_readsweep_hsbin;
 
 	sf->ntables = ntables;
@@ -492,136 +525,517 @@ sf_readblock_hsbin(FILE *fp, char **bufp, int *bufsize, int offset)
 }
 
 /*
- * helper routine: get next floating-point value from data part of binary
- * hspice file.   Handles the block-structure of hspice files; all blocks
- * encountered are assumed to be data blocks.  We don't use readblock_hsbin because
- * some versions of hspice write very large blocks, which would require a
- * very large buffer.
+ * helper routine: the current data block of a binary hspice file has been
+ * used up; check its trailer and read the header of the next block.
+ * All blocks encountered are assumed to be data blocks.
  *
  * Returns 0 on EOF, 1 on success, negative on error.
  */
 static int
-sf_getval_hsbin(SpiceStream *sf, double *dval)
+sf_nextblock_hsbin(SpiceStream *sf)
 {
 	off64_t pos;
-	float val;
 	struct hsblock_header hh;
 	gint32 trailer;
+	void *p;
+
+	pos = ss_inpos(sf);
+	if((p = ss_getbytes(sf, sizeof(gint32))) == NULL)
+	{
+		ss_msg(DBG, "sf_nextblock_hsbin", "EOF reading block trailer at offset 0x%lx", (long) pos);
+		return 0;
+	}
+	memcpy(&trailer, p, sizeof(gint32));
+	if(sf->flags & SSF_ESWAP)
+	{
+		swap_gint32(&trailer, 1);
+	}
+	if(trailer != sf->expected_vals * sizeof(float))
+	{
+		ss_msg(DBG, "sf_nextblock_hsbin", "block trailer mismatch at offset 0x%lx", (long) pos);
+		return -2;
+	}
+
+	pos = ss_inpos(sf);
+	if((p = ss_getbytes(sf, sizeof(hh))) == NULL)
+	{
+		ss_msg(DBG, "sf_nextblock_hsbin", "EOF reading block header at offset 0x%lx", (long) pos);
+		return 0;
+	}
+	memcpy(&hh, p, sizeof(hh));
+	if(hh.h1 == 0x04000000 && hh.h3 == 0x04000000)
+	{
+		/* detected endian swap */
+		sf->flags |= SSF_ESWAP;
+		swap_gint32((gint32*)&hh, sizeof(hh)/sizeof(gint32));
+	}
+	else
+	{
+		sf->flags &= ~SSF_ESWAP;
+	}
+	if(hh.h1 != 0x00000004 || hh.h3 != 0x00000004)
+	{
+		ss_msg(ERR, "sf_nextblock_hsbin", "unexepected values in block header at offset 0x%lx", (long) pos);
+		return -1;
+	}
+	sf->expected_vals = hh.block_nbytes / sizeof(float);
+	sf->read_vals = 0;
+	return 1;
+}
+
+/*
+ * helper routine: decode the next run of up to want values from the data
+ * part of a binary hspice file into sf->valbuf, moving on to the next
+ * block if the current one has been used up.  At most HS_DECODE_VALS values
+ * are decoded at a time, because some versions of hspice write very large
+ * blocks.
+ *
+ * Returns 0 on EOF, 1 on success, negative on error.
+ */
+static int
+sf_fillvals_hsbin(SpiceStream *sf, int want)
+{
+	off64_t pos;
+	size_t nbytes;
+	void *p;
+	int n, rc;
 
 	if(sf->read_vals >= sf->expected_vals)
 	{
-		pos = ftello64(sf->fp);
-		if(fread(&trailer, sizeof(gint32), 1, sf->fp) != 1)
+		if((rc = sf_nextblock_hsbin(sf)) <= 0)
+			return rc;
+	}
+
+	n = sf->expected_vals - sf->read_vals;
+	if(n > want)
+		n = want;
+	if(n > HS_DECODE_VALS)
+		n = HS_DECODE_VALS;
+	nbytes = n * sizeof(float);
+	if((p = ss_getbytes(sf, nbytes)) == NULL)
+	{
+		/* truncated file: decode whatever complete values remain */
+		if((p = ss_getbytes_avail(sf, &nbytes)) == NULL
+		   || nbytes < sizeof(float))
 		{
-			ss_msg(DBG, "sf_getval_hsbin", "EOF reading block trailer at offset 0x%lx", (long) pos);
+			pos = ss_inpos(sf);
+			ss_msg(ERR, "sf_fillvals_hsbin", "unexepected EOF in data at offset 0x%lx", (long) pos);
 			return 0;
 		}
-		if(sf->flags & SSF_ESWAP)
+		n = nbytes / sizeof(float);
+		/* leave a partial value unread, so that ss_tell is right */
+		if(nbytes % sizeof(float))
+			ss_setpos(sf, ss_inpos(sf) - nbytes % sizeof(float));
+	}
+	if(sf->valbuf == NULL)
+		sf->valbuf = g_new(double, HS_DECODE_VALS);
+	hs_decode_floats(sf->valbuf, p, n, sf->flags & SSF_ESWAP);
+	sf->read_vals += n;
+	sf->valbuf_len = n;
+	sf->valbuf_pos = 0;
+	return 1;
+}
+
+/*
+ * helper routine: get next floating-point value from data part of binary
+ * hspice file, decoding another run of values if needed.
+ * With a projection set, most values are skipped rather than decoded,
+ * so we decode only one at a time here.
+ *
+ * Returns 0 on EOF, 1 on success, negative on error.
+ */
+static int
+sf_getval_hsbin(SpiceStream *sf, double *dval)
+{
+	int rc;
+
+	if(sf->valbuf_pos >= sf->valbuf_len)
+	{
+		rc = sf_fillvals_hsbin(sf, sf->projcols ? 1 : HS_DECODE_VALS);
+		if(rc <= 0)
+			return rc;
+	}
+	*dval = sf->valbuf[sf->valbuf_pos++];
+	return 1;
+}
+
+/*
+ * helper routine: skip over the next n values in the data part of a
+ * binary hspice file without decoding them.
+ *
+ * Returns 0 on EOF, 1 on success, negative on error.
+ */
+static int
+sf_skipvals_hsbin(SpiceStream *sf, int n)
+{
+	int k, rc;
+
+	while(n > 0)
+	{
+		if(sf->valbuf_pos < sf->valbuf_len)
 		{
-			swap_gint32(&trailer, 1);
+			k = sf->valbuf_len - sf->valbuf_pos;
+			if(k > n)
+				k = n;
+			sf->valbuf_pos += k;
 		}
-		if(trailer != sf->expected_vals * sizeof(float))
+		else if(sf->read_vals < sf->expected_vals)
 		{
-			ss_msg(DBG, "sf_getval_hsbin", "block trailer mismatch at offset 0x%lx", (long) pos);
-			return -2;
+			k = sf->expected_vals - sf->read_vals;
+			if(k > n)
+				k = n;
+			if(!ss_skipbytes(sf, k * sizeof(float)))
+			{
+				ss_msg(ERR, "sf_skipvals_hsbin", "unexepected EOF in data");
+				return 0;
+			}
+			sf->read_vals += k;
 		}
-
-		pos = ftello64(sf->fp);
-		if(fread(&hh, sizeof(hh), 1, sf->fp) != 1)
+		else
 		{
-			ss_msg(DBG, "sf_getval_hsbin", "EOF reading block header at offset 0x%lx", (long) pos);
-			return 0;
+			if((rc = sf_nextblock_hsbin(sf)) <= 0)
+				return rc;
+			k = 0;
 		}
-		if(hh.h1 == 0x04000000 && hh.h3 == 0x04000000)
+		n -= k;
+	}
+	return 1;
+}
+
+/*
+ * helper routine: read the dependent-variable values of one row of a
+ * binary hspice file into dvars, or into row n of colbufs if colbufs
+ * isn't NULL.  Columns left out by ss_set_projection are skipped, and
+ * runs of adjacent wanted columns are decoded together.
+ *
+ * Returns the number of columns read or skipped, which is less than
+ * sf->ncols-1 if EOF or an error was found.
+ */
+static int
+sf_getdvals_hsbin(SpiceStream *sf, double *dvars, double **colbufs, int n)
+{
+	int i, k, c, run;
+	double *dp;
+
+	if(sf->projcols == NULL)
+	{
+		if(colbufs)
 		{
-			/* detected endian swap */
-			sf->flags |= SSF_ESWAP;
-			swap_gint32((gint32*)&hh, sizeof(hh)/sizeof(gint32));
+			for(i = 0; i < sf->ncols-1; i++)
+				if(sf_getval_hsbin(sf, &colbufs[i][n]) != 1)
+					return i;
 		}
 		else
 		{
-			sf->flags &= ~SSF_ESWAP;
+			for(i = 0; i < sf->ncols-1; i++)
+				if(sf_getval_hsbin(sf, &dvars[i]) != 1)
+					return i;
 		}
-		if(hh.h1 != 0x00000004 || hh.h3 != 0x00000004)
+		return sf->ncols-1;
+	}
+
+	c = 0;
+	for(k = 0; k < sf->nprojcols; k++)
+	{
+		i = sf->projcols[k];
+		if(i > c && sf_skipvals_hsbin(sf, i - c) != 1)
+			return c;
+		if(sf->valbuf_pos >= sf->valbuf_len)
 		{
-			ss_msg(ERR, "sf_getval_hsbin", "unexepected values in block header at offset 0x%lx", pos);
-			return -1;
+			for(run = 1; k + run < sf->nprojcols
+				    && sf->projcols[k + run] == i + run; run++)
+				;
+			if(sf_fillvals_hsbin(sf, run) != 1)
+				return i;
 		}
-		sf->expected_vals = hh.block_nbytes / sizeof(float);
-		sf->read_vals = 0;
+		dp = colbufs ? &colbufs[i][n] : &dvars[i];
+		*dp = sf->valbuf[sf->valbuf_pos++];
+		c = i + 1;
 	}
-	if(fread(&val, sizeof(float), 1, sf->fp) != 1)
-	{
-		pos = ftello64(sf->fp);
-		ss_msg(ERR, "sf_getval_hsbin", "unexepected EOF in data at offset 0x%lx", (long) pos);
+	if(c < sf->ncols-1 && sf_skipvals_hsbin(sf, sf->ncols-1 - c) != 1)
+		return c;
+	return sf->ncols-1;
+}
+
+/*
+ * tellpos and seekpos for binary hspice files.  Values decoded into
+ * valbuf but not yet handed out are given back, so the position is
+ * that of the first of them.  valbuf never runs past the end of a block.
+ */
+static int
+sf_tellpos_hsbin(SpiceStream *sf, SSCheckpoint *cp)
+{
+	off64_t pos;
+	int k;
+
+	if((pos = ss_inpos(sf)) < 0)
+		return -1;
+	k = sf->valbuf_len - sf->valbuf_pos;
+	cp->offset = pos - k * sizeof(float);
+	cp->read_vals -= k;
+	return 0;
+}
+
+static int
+sf_seekpos_hsbin(SpiceStream *sf, SSCheckpoint *cp)
+{
+	if(ss_setpos(sf, cp->offset) < 0)
+		return -1;
+	sf->valbuf_len = 0;
+	sf->valbuf_pos = 0;
+	return 0;
+}
+
+/*
+ * helper routine: read the next line of an ascii hspice file, with
+ * trailing whitespace removed, and set up to hand out its fields.
+ * The line is left where ss_readline found it, usually in the
+ * mapped file; its fields are decoded when the first one is needed.
+ * Returns 0 on EOF, 1 on success.
+ */
+static int
+hs_ascii_nextline(SpiceStream *sf)
+{
+	char *line;
+	int len;
+
+	if((line = ss_readline(sf, &len)) == NULL)
 		return 0;
-	}
-	sf->read_vals++;
+	while(len > 0 && isspace((unsigned char) line[len-1]))
+		len--;
+	sf->linep = line;
+	sf->line_length = len;
+	sf->valbuf_len = len / HS_FIELD_WIDTH;
+	sf->valbuf_pos = 0;
+	sf->flags &= ~SSF_DECODED;
+	/* fprintf(stderr, "#line: \"%.*s\"\n", len, line); */
+	return 1;
+}
 
-	if(sf->flags & SSF_ESWAP)
+/*
+ * helper routine: make sure that there is another field left in the
+ * current line of an ascii hspice file, reading lines as needed.
+ * Returns 0 on EOF, or if the rest of the line is an incomplete value,
+ * probably from a truncated or partialy-written file.  1 on success.
+ */
+static int
+hs_ascii_morefields(SpiceStream *sf)
+{
+	while(sf->valbuf_pos >= sf->valbuf_len)
 	{
-		swap_gint32((gint32 *)&val, 1);
+		if(sf->line_length % HS_FIELD_WIDTH != 0)
+			return 0;
+		if(hs_ascii_nextline(sf) == 0)
+			return 0;
 	}
-	*dval = val;
 	return 1;
 }
 
 /*
- * helper routine: get next value from ascii hspice file.
+ * Decode n fixed-width fields of an hspice ascii data line into dst.
+ * Nearly all fields look like "0.66687E-09", " .30000E+01" or
+ * "-.30000E+01"; for those the digits are picked out by position into
+ * an integer and a power of ten, which ss_scale10 turns into a correctly
+ * rounded double.  Anything else goes to ss_strntod.
+ */
+static void
+hs_decode_fields(double *dst, const char *src, int n)
+{
+	const unsigned char *f;
+	unsigned d2, d3, d4, d5, d6, d9, d10;
+	int i, q;
+
+	for(i = 0; i < n; i++, src += HS_FIELD_WIDTH)
+	{
+		f = (const unsigned char *) src;
+		d2 = f[2] - '0';
+		d3 = f[3] - '0';
+		d4 = f[4] - '0';
+		d5 = f[5] - '0';
+		d6 = f[6] - '0';
+		d9 = f[9] - '0';
+		d10 = f[10] - '0';
+		if(f[1] == '.' && (f[7] == 'E' || f[7] == 'e')
+		   && (f[8] == '-' || f[8] == '+')
+		   && (f[0] == ' ' || f[0] == '0' || f[0] == '-')
+		   && ((d2 > 9) | (d3 > 9) | (d4 > 9) | (d5 > 9) | (d6 > 9)
+		       | (d9 > 9) | (d10 > 9)) == 0)
+		{
+			q = d9 * 10 + d10;
+			if(f[8] == '-')
+				q = -q;
+			dst[i] = ss_scale10(d2 * 10000 + d3 * 1000 + d4 * 100 + d5 * 10 + d6,
+					    q - 5, f[0] == '-');
+		}
+		else
+		{
+			dst[i] = ss_strntod(src, HS_FIELD_WIDTH, NULL);
+		}
+	}
+}
+
+/*
+ * helper routine: make sure that the current line of an ascii hspice
+ * file has values left and that they have been decoded into sf->valbuf.
  * the file is line-oriented, with fixed-width fields on each line.
  * Lines may look like either of these two examples:
 0.66687E-090.21426E+010.00000E+000.00000E+000.25000E+010.71063E-090.17877E+01
  .00000E+00 .30000E+01 .30000E+01 .30000E+01 .30000E+01 .30000E+01 .30092E-05
  * There may be whitespace at the end of the line before the newline.
+ * All of the values on a line are decoded in one pass.
  *
  * Returns 0 on EOF, 1 on success.
  */
 static int
+hs_ascii_decoded(SpiceStream *sf)
+{
+	if(sf->valbuf_pos < sf->valbuf_len && (sf->flags & SSF_DECODED))
+		return 1;
+	if(hs_ascii_morefields(sf) == 0)
+		return 0;
+	if(sf->valbuf_len > sf->valbuf_size)
+	{
+		sf->valbuf_size = sf->valbuf_len;
+		sf->valbuf = g_realloc(sf->valbuf, sf->valbuf_size * sizeof(double));
+	}
+	hs_decode_fields(sf->valbuf, sf->linep, sf->valbuf_len);
+	sf->flags |= SSF_DECODED;
+	return 1;
+}
+
+/*
+ * helper routine: get next value from ascii hspice file.
+ * Returns 0 on EOF, 1 on success.
+ */
+static int
 sf_getval_hsascii(SpiceStream *sf, double *val)
 {
-	char vbuf[16];
-	char *vp;
-	char *cp;
-	int l;
+	if(hs_ascii_decoded(sf) == 0)
+		return 0;
+	*val = sf->valbuf[sf->valbuf_pos++];
+	return 1;
+}
 
-	if(!sf->linep || (*sf->linep==0) || *sf->linep == '\n')
+/*
+ * helper routine: skip over the next n values in an ascii hspice file
+ * without converting them.  Lines that are skipped entirely are never
+ * decoded.
+ * Returns 0 on EOF or an incomplete value, 1 on success.
+ */
+static int
+sf_skipvals_hsascii(SpiceStream *sf, int n)
+{
+	int k;
+
+	while(n > 0)
 	{
-		if(fgets(sf->linebuf, sf->lbufsize, sf->fp) == NULL)
+		if(hs_ascii_morefields(sf) == 0)
 			return 0;
+		k = sf->valbuf_len - sf->valbuf_pos;
+		if(k > n)
+			k = n;
+		sf->valbuf_pos += k;
+		n -= k;
+	}
+	return 1;
+}
+
+/*
+ * helper routine: read the dependent-variable values of one row of an
+ * ascii hspice file into dvars, or into row n of colbufs if colbufs
+ * isn't NULL.  Columns left out by ss_set_projection are skipped.
+ *
+ * Returns the number of columns read or skipped, which is less than
+ * sf->ncols-1 if EOF or an error was found.
+ */
+static int
+sf_getdvals_hsascii(SpiceStream *sf, double *dvars, double **colbufs, int n)
+{
+	int i, k, c;
 
-		l = strlen(sf->linebuf);
-		if(l)    /* delete whitespace at end of line */
+	if(sf->projcols == NULL)
+	{
+		/* take the values a line at a time */
+		for(i = 0; i < sf->ncols-1; )
 		{
-			cp = sf->linebuf + l - 1;
-			while(cp > sf->linebuf && *cp && isspace(*cp))
-				*cp-- = '\0';
+			if(hs_ascii_decoded(sf) == 0)
+				return i;
+			k = sf->valbuf_len - sf->valbuf_pos;
+			if(k > sf->ncols-1 - i)
+				k = sf->ncols-1 - i;
+			if(colbufs)
+			{
+				for(c = 0; c < k; c++)
+					colbufs[i+c][n] = sf->valbuf[sf->valbuf_pos + c];
+			}
+			else
+			{
+				memcpy(&dvars[i], &sf->valbuf[sf->valbuf_pos], k * sizeof(double));
+			}
+			sf->valbuf_pos += k;
+			i += k;
 		}
-		sf->linep = sf->linebuf;
-		sf->line_length = strlen(sf->linep);
-		/* fprintf(stderr, "#line: \"%s\"\n", sf->linebuf); */
+		return sf->ncols-1;
 	}
-	if(sf->linep > sf->linebuf + sf->line_length)
+
+	c = 0;
+	for(k = 0; k < sf->nprojcols; k++)
 	{
-		ss_msg(WARN, "sf_getval_hsascii",
-		       "%s: internal error or bad line in file", sf->filename);
-		return 0;
+		i = sf->projcols[k];
+		if(i > c && sf_skipvals_hsascii(sf, i - c) == 0)
+			return c;
+		if(sf_getval_hsascii(sf, colbufs ? &colbufs[i][n] : &dvars[i]) == 0)
+			return i;
+		c = i + 1;
 	}
+	if(c < sf->ncols-1 && sf_skipvals_hsascii(sf, sf->ncols-1 - c) == 0)
+		return c;
+	return sf->ncols-1;
+}
+
+/*
+ * tellpos and seekpos for ascii hspice files.  Rows needn't start at
+ * the beginning of a line, so the position is the offset of the current
+ * line and the index of the next field in it, or -1 if no line has
+ * been read yet.
+ */
+static int
+sf_tellpos_hsascii(SpiceStream *sf, SSCheckpoint *cp)
+{
+	off64_t pos;
 
-	strncpy(vbuf, sf->linep, 11);
-	sf->linep += 11;
-	vbuf[11] = 0;
-	if(strlen(vbuf) != 11)
+	if(sf->linep)
 	{
-		/* incomplete float value - probably truncated or
-		   partialy-written file */
-		return 0;
+		cp->offset = sf->linepos;
+		cp->aux = sf->valbuf_pos;
 	}
-	vp = vbuf;
-	while(isspace(*vp)) /* atof doesn't like spaces */
-		vp++;
-	*val = atof(vp);
-	/* fprintf(stderr, "#vp=\"%s\" val=%f\n", vp, *val); */
-	return 1;
+	else
+	{
+		if((pos = ss_inpos(sf)) < 0)
+			return -1;
+		cp->offset = pos;
+		cp->aux = -1;
+	}
+	return 0;
+}
+
+static int
+sf_seekpos_hsascii(SpiceStream *sf, SSCheckpoint *cp)
+{
+	if(ss_setpos(sf, cp->offset) < 0)
+		return -1;
+	sf->linep = NULL;
+	sf->line_length = 0;
+	sf->valbuf_len = 0;
+	sf->valbuf_pos = 0;
+	sf->flags &= ~SSF_DECODED;
+	if(cp->aux >= 0)
+	{
+		if(hs_ascii_nextline(sf) == 0 || cp->aux > sf->valbuf_len)
+			return -1;
+		sf->valbuf_pos = cp->aux;
+	}
+	return 0;
 }
 
 /* Read row of values from ascii hspice-format file.
@@ -645,24 +1059,13 @@ sf_readrow_hsascii(SpiceStream *sf, double *ivar, double *dvars)
 	if(sf_getval_hsascii(sf, ivar) == 0)
 		return 0;
 	if(*ivar >= 1.0e29)   /* "infinity" at end of data table */
-	{
-		sf->read_tables++;
-		if(sf->read_tables == sf->ntables)
-			return 0; /* EOF */
-		else
-			sf->read_sweepparam = 0;
-		sf->read_rows = 0;
-		return -2;  /* end of table, more tables follow */
-	}
+		return hs_end_table(sf);
 
 	sf->read_rows++;
-	for(i = 0; i < sf->ncols-1; i++)
+	if((i = sf_getdvals_hsascii(sf, dvars, NULL, 0)) < sf->ncols-1)
 	{
-		if(sf_getval_hsascii(sf, &dvars[i]) == 0)
-		{
-			ss_msg(WARN, "sf_readrow_hsascii", "%s: EOF or error reading data field %d in row %d of table %d; file is incomplete.", sf->filename, i, sf->read_rows, sf->read_tables);
-			return 0;
-		}
+		ss_msg(WARN, "sf_readrow_hsascii", "%s: EOF or error reading data field %d in row %d of table %d; file is incomplete.", sf->filename, i, sf->read_rows, sf->read_tables);
+		return 0;
 	}
 	return 1;
 }
@@ -691,27 +1094,207 @@ sf_readrow_hsbin(SpiceStream *sf, double *ivar, double *dvars)
 	if(rc < 0)
 		return -1;
 	if(*ivar >= 1.0e29)   /* "infinity" at end of data table */
+		return hs_end_table(sf);
+	sf->read_rows++;
+	if((i = sf_getdvals_hsbin(sf, dvars, NULL, 0)) < sf->ncols-1)
 	{
-		sf->read_tables++;
-		if(sf->read_tables == sf->ntables)
-			return 0; /* end of data, should also be EOF but we don't check */
-		else
+		ss_msg(WARN, "sf_readrow_hsbin", "%s: EOF or error reading data field %d in row %d of table %d; file is incomplete.", sf->filename, i, sf->read_rows, sf->read_tables);
+		return 0;
+	}
+	return 1;
+}
+
+/* Read block of rows from ascii hspice-format file into column buffers.
+ * Returns 1 if maxrows rows were read, otherwise the same status as
+ * sf_readrow_hsascii, with the number of rows read in *nrows.
+ */
+static int
+sf_readrows_hsascii(SpiceStream *sf, int maxrows, double *ivbuf,
+                    double **colbufs, int *nrows)
+{
+	int i, n;
+	int rc = 1;
+
+	for(n = 0; n < maxrows; n++)
+	{
+		if(!sf->read_sweepparam)   /* first row of table */
 		{
-			sf->read_sweepparam = 0;
-			sf->read_rows = 0;
-			return -2;  /* end of table, more tables follow */
+			if(sf_readsweep_hsascii(sf, NULL) <= 0)
+			{
+				rc = -1;
+				break;
+			}
+		}
+		if(sf_getval_hsascii(sf, &ivbuf[n]) == 0)
+		{
+			rc = 0;
+			break;
+		}
+		if(ivbuf[n] >= 1.0e29)   /* "infinity" at end of data table */
+		{
+			rc = hs_end_table(sf);
+			break;
+		}
+
+		sf->read_rows++;
+		if((i = sf_getdvals_hsascii(sf, NULL, colbufs, n)) < sf->ncols-1)
+		{
+			ss_msg(WARN, "sf_readrows_hsascii", "%s: EOF or error reading data field %d in row %d of table %d; file is incomplete.", sf->filename, i, sf->read_rows, sf->read_tables);
+			*nrows = n;
+			return 0;
 		}
 	}
-	sf->read_rows++;
-	for(i = 0; i < sf->ncols-1; i++)
+	*nrows = n;
+	return rc;
+}
+
+/* Read block of rows from binary hspice-format file into column buffers.
+ * Returns 1 if maxrows rows were read, otherwise the same status as
+ * sf_readrow_hsbin, with the number of rows read in *nrows.
+ */
+static int
+sf_readrows_hsbin(SpiceStream *sf, int maxrows, double *ivbuf,
+                  double **colbufs, int *nrows)
+{
+	int i, n;
+	int rc = 1;
+
+	for(n = 0; n < maxrows; n++)
 	{
-		if(sf_getval_hsbin(sf, &dvars[i]) != 1)
+		if(!sf->read_sweepparam)   /* first row of table */
+		{
+			if(sf_readsweep_hsbin(sf, NULL) <= 0)
+			{
+				rc = -1;
+				break;
+			}
+		}
+		rc = sf_getval_hsbin(sf, &ivbuf[n]);
+		if(rc <= 0)
+		{
+			if(rc < 0)
+				rc = -1;
+			break;
+		}
+		if(ivbuf[n] >= 1.0e29)   /* "infinity" at end of data table */
 		{
-			ss_msg(WARN, "sf_readrow_hsbin", "%s: EOF or error reading data field %d in row %d of table %d; file is incomplete.", sf->filename, i, sf->read_rows, sf->read_tables);
+			rc = hs_end_table(sf);
+			break;
+		}
+
+		sf->read_rows++;
+		if((i = sf_getdvals_hsbin(sf, NULL, colbufs, n)) < sf->ncols-1)
+		{
+			ss_msg(WARN, "sf_readrows_hsbin", "%s: EOF or error reading data field %d in row %d of table %d; file is incomplete.", sf->filename, i, sf->read_rows, sf->read_tables);
+			*nrows = n;
+			return 0;
+		}
+	}
+	*nrows = n;
+	return rc;
+}
+
+/*
+ * Skip the rest of the current table of an ascii hspice file.  Only the
+ * field that starts each row is decoded, to look for the end-of-table
+ * marker; lines that hold no such field are passed over unconverted.
+ * Returns the same as sf_readrows_hsascii would at the end of the table.
+ */
+static int
+sf_skiptable_hsascii(SpiceStream *sf)
+{
+	double ival;
+
+	if(!sf->read_sweepparam)   /* first row of table */
+	{
+		if(sf_readsweep_hsascii(sf, NULL) <= 0)
+			return -1;
+	}
+	for(;;)
+	{
+		if(hs_ascii_morefields(sf) == 0)
+			return 0;
+		if(sf->flags & SSF_DECODED)
+			ival = sf->valbuf[sf->valbuf_pos];
+		else
+			hs_decode_fields(&ival, sf->linep + sf->valbuf_pos * HS_FIELD_WIDTH, 1);
+		sf->valbuf_pos++;
+		if(ival >= 1.0e29)   /* "infinity" at end of data table */
+			return hs_end_table(sf);
+
+		sf->read_rows++;
+		if(sf_skipvals_hsascii(sf, sf->ncols-1) == 0)
+		{
+			ss_msg(WARN, "sf_skiptable_hsascii", "%s: EOF or error in row %d of table %d; file is incomplete.", sf->filename, sf->read_rows, sf->read_tables);
 			return 0;
 		}
 	}
-	return 1;
+}
+
+/*
+ * Skip the rest of the current table of a binary hspice file.  Only the
+ * value that starts each row is decoded, to look for the end-of-table
+ * marker; the rest of the row is stepped over, going on through the
+ * block headers as needed.
+ * Returns the same as sf_readrows_hsbin would at the end of the table.
+ */
+static int
+sf_skiptable_hsbin(SpiceStream *sf)
+{
+	off64_t pos;
+	double ival;
+	void *p;
+	int rc;
+
+	if(!sf->read_sweepparam)   /* first row of table */
+	{
+		if(sf_readsweep_hsbin(sf, NULL) <= 0)
+			return -1;
+	}
+	for(;;)
+	{
+		if(sf->valbuf_pos < sf->valbuf_len)
+			ival = sf->valbuf[sf->valbuf_pos++];
+		else
+		{
+			if(sf->read_vals >= sf->expected_vals
+			   && (rc = sf_nextblock_hsbin(sf)) <= 0)
+				return (rc < 0) ? -1 : 0;
+			if((p = ss_getbytes(sf, sizeof(float))) == NULL)
+			{
+				pos = ss_inpos(sf);
+				ss_msg(ERR, "sf_skiptable_hsbin", "unexepected EOF in data at offset 0x%lx", (long) pos);
+				return 0;
+			}
+			hs_decode_floats(&ival, p, 1, sf->flags & SSF_ESWAP);
+			sf->read_vals++;
+		}
+		if(ival >= 1.0e29)   /* "infinity" at end of data table */
+			return hs_end_table(sf);
+
+		sf->read_rows++;
+		if((rc = sf_skipvals_hsbin(sf, sf->ncols-1)) != 1)
+		{
+			ss_msg(WARN, "sf_skiptable_hsbin", "%s: EOF or error in row %d of table %d; file is incomplete.", sf->filename, sf->read_rows, sf->read_tables);
+			return (rc < 0) ? -1 : 0;
+		}
+	}
+}
+
+/*
+ * Common handling of the end-of-table marker in either type of hspice file.
+ * Returns 0 if this was the last table, or -2 if more tables follow.
+ */
+static int
+hs_end_table(SpiceStream *sf)
+{
+	sf->read_tables++;
+	if(sf->read_tables == sf->ntables)
+		return 0; /* end of data, should also be EOF but we don't check */
+
+	sf->read_sweepparam = 0;
+	sf->read_rows = 0;
+	return -2;  /* end of table, more tables follow */
 }
 
 /*
@@ -766,45 +1349,136 @@ sf_readsweep_hsbin(SpiceStream *sf, double *svar)
 
 
 /*
- * Estimate how many rows are in the file associated with sf.
- * We base our estimate on the size of the file.
- * This can be useful to aid in memory-use planning by programs planning to
- * read the entire file.
- *
- * If the file descriptor is not associated with an ordinary file, we return 0
- * to indicate that the length cannot be estimated.
- * If an error occurs, -1 is returned.
+ * Estimate how many rows are left in the file associated with sf, from
+ * the size of the rest of it and the size of a value.  Block headers,
+ * line ends, sweep parameters and the ends of tables make the estimate
+ * a little high.
  */
-/* unused function
-static long sf_guessrows_hsbin(SpiceStream *sf)
+static long long
+hs_estrows(SpiceStream *sf, int valsize)
 {
-	int rc;
-	struct stat st;
+	off64_t size;
 
-	rc = fstat(fileno(sf->fp), &st);
-	if(rc < 0)
+	if((size = ss_input_size(sf)) < 0)
 		return -1;
-	if((st.st_mode & S_IFMT) != S_IFREG)
-		return 0;
+	return (size - ss_inpos(sf)) / ((long long) valsize * sf->ncols);
+}
 
-	return st.st_size / (sizeof(float)  * sf->ncols);
+static long long
+sf_estrows_hsascii(SpiceStream *sf)
+{
+	return hs_estrows(sf, HS_FIELD_WIDTH);
+}
+
+static long long
+sf_estrows_hsbin(SpiceStream *sf)
+{
+	return hs_estrows(sf, sizeof(float));
 }
-*/
 
 
 static void swap_gint32(gint32 *pi, size_t n)
 {
-	union gint32bytes *p = (union gint32bytes *)pi;
+	unsigned int u;
 	size_t i;
-	gchar temp;
 	for(i = 0; i < n; i++)
 	{
-		temp = p[i].b[3] ;
-		p[i].b[3] = p[i].b[0];
-		p[i].b[0] = temp;
+		memcpy(&u, &pi[i], sizeof(u));
+		u = (u >> 24) | ((u >> 8) & 0xff00) | ((u << 8) & 0xff0000) | (u << 24);
+		memcpy(&pi[i], &u, sizeof(u));
+	}
+}
+
+/*
+ * Convert n single-precision values, byte-swapping them first if eswap
+ * is set, from the raw data at src (which need not be aligned) into
+ * doubles at dst.
+ * There are SSE2 and AVX2 versions for x86; the AVX2 one is selected
+ * at runtime if the CPU supports it.
+ */
+static void
+hs_decode_floats_scalar(double *dst, const char *src, int n, int eswap)
+{
+	unsigned int u;
+	float f;
+	int i;
+
+	for(i = 0; i < n; i++)
+	{
+		memcpy(&u, src + i * sizeof(float), sizeof(u));
+		if(eswap)
+			u = (u >> 24) | ((u >> 8) & 0xff00) | ((u << 8) & 0xff0000) | (u << 24);
+		memcpy(&f, &u, sizeof(f));
+		dst[i] = f;
+	}
+}
+
+#if defined(__SSE2__)
+static void
+hs_decode_floats_sse2(double *dst, const char *src, int n, int eswap)
+{
+	__m128i v;
+	__m128 f;
+	int i;
 
-		temp = p[i].b[2] ;
-		p[i].b[2] = p[i].b[1];
-		p[i].b[1] = temp;
+	for(i = 0; i + 4 <= n; i += 4)
+	{
+		v = _mm_loadu_si128((const __m128i *)(src + i * sizeof(float)));
+		if(eswap)
+		{
+			/* swap bytes in each 16-bit half, then swap the halves */
+			v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+			v = _mm_shufflelo_epi16(v, 0xb1);
+			v = _mm_shufflehi_epi16(v, 0xb1);
+		}
+		f = _mm_castsi128_ps(v);
+		_mm_storeu_pd(dst + i, _mm_cvtps_pd(f));
+		_mm_storeu_pd(dst + i + 2, _mm_cvtps_pd(_mm_movehl_ps(f, f)));
+	}
+	hs_decode_floats_scalar(dst + i, src + i * sizeof(float), n - i, eswap);
+}
+#endif
+
+#ifdef HS_HAVE_AVX2
+__attribute__((target("avx2")))
+static void
+hs_decode_floats_avx2(double *dst, const char *src, int n, int eswap)
+{
+	const __m256i bswap = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4,
+					       11, 10, 9, 8, 15, 14, 13, 12,
+					       3, 2, 1, 0, 7, 6, 5, 4,
+					       11, 10, 9, 8, 15, 14, 13, 12);
+	__m256i v;
+	int i;
+
+	for(i = 0; i + 8 <= n; i += 8)
+	{
+		v = _mm256_loadu_si256((const __m256i *)(src + i * sizeof(float)));
+		if(eswap)
+			v = _mm256_shuffle_epi8(v, bswap);
+		_mm256_storeu_pd(dst + i, _mm256_cvtps_pd(_mm256_castps256_ps128(_mm256_castsi256_ps(v))));
+		_mm256_storeu_pd(dst + i + 4, _mm256_cvtps_pd(_mm256_extractf128_ps(_mm256_castsi256_ps(v), 1)));
+	}
+	hs_decode_floats_scalar(dst + i, src + i * sizeof(float), n - i, eswap);
+}
+#endif
+
+static void
+hs_decode_floats(double *dst, const char *src, int n, int eswap)
+{
+#ifdef HS_HAVE_AVX2
+	static int have_avx2 = -1;
+	if(have_avx2 < 0)
+		have_avx2 = __builtin_cpu_supports("avx2");
+	if(have_avx2)
+	{
+		hs_decode_floats_avx2(dst, src, n, eswap);
+		return;
 	}
+#endif
+#if defined(__SSE2__)
+	hs_decode_floats_sse2(dst, src, n, eswap);
+#else
+	hs_decode_floats_scalar(dst, src, n, eswap);
+#endif
 }
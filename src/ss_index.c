@@ -0,0 +1,471 @@
+/*
+ * ss_index.c: seek indexes for SpiceStream files.
+ *
+ * An index holds a checkpoint from ss_tell every so many rows of each
+ * table in a file, along with the independent-variable value of the row
+ * that follows it.  With it, a program that wants only part of a long
+ * file can ss_seek to the checkpoint just before that part, instead of
+ * reading everything up to it.
+ *
+ * Building an index takes a pass over the file, so it can be kept in a
+ * sidecar file next to the data, with ".ssidx" added to the name, or,
+ * for data in a tree that can't be written, in the directory named by
+ * SS_INDEX_DIR in the environment (see ss_index_name).  The
+ * sidecar records the size and modification time of the data file it
+ * was made from, and is ignored if they no longer match.  It is written
+ * in the native byte order; it is a cache, not an interchange format.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this library; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include "ssintern.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <float.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+// #include <config.h>
+#include "glib.h"
+#include "spicestream.h"
+
+/* rows between checkpoints, if the caller doesn't say */
+#define SS_INDEX_INTERVAL 1024
+
+#define SSIDX_MAGIC "SSIDX01\n"
+
+typedef struct {
+	int table;	/* table number, counting from 0 */
+	int unordered;	/* independent variable decreases somewhere in table */
+	double ival;	/* independent variable of the row after cp */
+	SSCheckpoint cp;
+} SSIndexEntry;
+
+/* start of the sidecar file, followed by nentries SSIndexEntry */
+typedef struct {
+	char magic[8];
+	int entsize;	/* sizeof(SSIndexEntry), to catch changes in layout */
+	int filetype;
+	int ncols;
+	int interval;
+	long long filesize;	/* identify the data file */
+	long long mtime;
+	long long dataoffset;	/* checkpoint offset at the start of the data */
+	int nentries;
+	int pad;
+} SSIndexHeader;
+
+struct _SSIndex
+{
+	SSIndexHeader hdr;
+	SSIndexEntry *entries;
+	int size;
+};
+
+/*
+ * Fill in the header fields that identify the data in sf.
+ * The stream must be at the start of its data.
+ * Returns 0 on success, -1 if sf can't be indexed.
+ */
+static int
+ss_index_ident(SpiceStream *sf, SSIndexHeader *h)
+{
+	SSCheckpoint cp;
+	struct stat st;
+
+	memset(h, 0, sizeof(*h));
+	if(sf->fp == NULL || fstat(fileno(sf->fp), &st) < 0 || !S_ISREG(st.st_mode))
+		return -1;
+	if(ss_tell(sf, &cp) < 0)
+		return -1;
+	memcpy(h->magic, SSIDX_MAGIC, sizeof(h->magic));
+	h->entsize = sizeof(SSIndexEntry);
+	h->filetype = sf->filetype;
+	h->ncols = sf->ncols;
+	h->filesize = st.st_size;
+	h->mtime = st.st_mtime;
+	h->dataoffset = cp.offset;
+	return 0;
+}
+
+static void
+ss_index_add(SSIndex *ix, int table, double ival, SSCheckpoint *cp)
+{
+	SSIndexEntry *e;
+
+	if(ix->hdr.nentries >= ix->size)
+	{
+		ix->size = ix->size ? 2 * ix->size : 256;
+		ix->entries = g_realloc(ix->entries, ix->size * sizeof(SSIndexEntry));
+	}
+	e = &ix->entries[ix->hdr.nentries++];
+	e->table = table;
+	e->unordered = 0;
+	e->ival = ival;
+	e->cp = *cp;
+}
+
+/*
+ * Read through the data in sf, which must not have been read from yet,
+ * and make an index with a checkpoint every interval rows, or a default
+ * number of rows if interval is 0.  Tables are numbered in the order that
+ * ss_readblock finds them, counting from 0.  Only the independent
+ * variable is converted.  Afterwards sf is back at the start of the data.
+ *
+ * Returns NULL if the file can't be indexed.
+ */
+SSIndex *
+ss_index_build(SpiceStream *sf, int interval)
+{
+	SSIndex *ix;
+	SSCheckpoint start, cp;
+	char *colsel;
+	int *projcols;
+	int nprojcols;
+	double *ivbuf;
+	double **colbufs;
+	double lastiv;
+	int table, tabstart, unordered;
+	int i, rc, none;
+
+	if(interval <= 0)
+		interval = SS_INDEX_INTERVAL;
+	ix = g_new0(SSIndex, 1);
+	if(ss_index_ident(sf, &ix->hdr) < 0 || ss_tell(sf, &start) < 0)
+	{
+		ss_msg(DBG, "ss_index_build", "%s: can't be indexed", sf->filename);
+		g_free(ix);
+		return NULL;
+	}
+	ix->hdr.interval = interval;
+
+	/* skip all of the dependent variables */
+	colsel = sf->colsel;
+	projcols = sf->projcols;
+	nprojcols = sf->nprojcols;
+	sf->colsel = NULL;
+	sf->projcols = NULL;
+	ss_set_projection(sf, &none, 0);
+
+	ivbuf = g_new(double, interval);
+	colbufs = g_new0(double *, sf->ncols);
+	table = 0;
+	tabstart = 0;
+	unordered = 0;
+	lastiv = -DBL_MAX;
+	for(;;)
+	{
+		if(ss_tell(sf, &cp) < 0)
+			break;
+		rc = ss_readblock(sf, interval, ivbuf, colbufs);
+		if(rc > 0)
+		{
+			ss_index_add(ix, table, ivbuf[0], &cp);
+			for(i = 0; i < rc; i++)
+			{
+				if(ivbuf[i] < lastiv)
+					unordered = 1;
+				lastiv = ivbuf[i];
+			}
+			continue;
+		}
+
+		/* end of table; if some format runs several sweeps together
+		 * in one, looking up values in it won't work */
+		if(unordered)
+		{
+			for(i = tabstart; i < ix->hdr.nentries; i++)
+				ix->entries[i].unordered = 1;
+		}
+		if(rc != -2)
+			break;	/* EOF; after an error, index what we found */
+		table++;
+		tabstart = ix->hdr.nentries;
+		unordered = 0;
+		lastiv = -DBL_MAX;
+	}
+	g_free(ivbuf);
+	g_free(colbufs);
+
+	rc = ss_seek(sf, &start);
+	ss_set_projection(sf, NULL, 0);
+	sf->colsel = colsel;
+	sf->projcols = projcols;
+	sf->nprojcols = nprojcols;
+	if(rc < 0)
+	{
+		ss_msg(ERR, "ss_index_build", "%s: can't get back to start of data", sf->filename);
+		ss_index_free(ix);
+		return NULL;
+	}
+	ss_msg(DBG, "ss_index_build", "%s: %d checkpoints in %d tables",
+	       sf->filename, ix->hdr.nentries, table + 1);
+	return ix;
+}
+
+/*
+ * Read an index for sf from filename, made by ss_index_save.  The stream
+ * must be at the start of its data.  Returns NULL if there is no such
+ * file, or if it doesn't go with the data that sf is reading.
+ */
+SSIndex *
+ss_index_load(SpiceStream *sf, char *filename)
+{
+	SSIndex *ix;
+	SSIndexHeader h;
+	FILE *fp;
+
+	ix = g_new0(SSIndex, 1);
+	if(ss_index_ident(sf, &ix->hdr) < 0)
+	{
+		g_free(ix);
+		return NULL;
+	}
+	if((fp = fopen64(filename, "rb")) == NULL)
+	{
+		g_free(ix);
+		return NULL;
+	}
+	if(fread(&h, sizeof(h), 1, fp) != 1
+	   || memcmp(h.magic, ix->hdr.magic, sizeof(h.magic)) != 0
+	   || h.entsize != ix->hdr.entsize
+	   || h.filetype != ix->hdr.filetype
+	   || h.ncols != ix->hdr.ncols
+	   || h.filesize != ix->hdr.filesize
+	   || h.mtime != ix->hdr.mtime
+	   || h.dataoffset != ix->hdr.dataoffset
+	   || h.nentries < 0)
+	{
+		ss_msg(DBG, "ss_index_load", "%s: doesn't match %s", filename, sf->filename);
+		goto fail;
+	}
+	ix->hdr = h;
+	ix->size = h.nentries;
+	ix->entries = g_new(SSIndexEntry, h.nentries ? h.nentries : 1);
+	if(fread(ix->entries, sizeof(SSIndexEntry), h.nentries, fp) != h.nentries)
+	{
+		ss_msg(DBG, "ss_index_load", "%s: file is incomplete", filename);
+		goto fail;
+	}
+	fclose(fp);
+	ss_msg(DBG, "ss_index_load", "%s: %d checkpoints", filename, h.nentries);
+	return ix;
+
+fail:
+	fclose(fp);
+	ss_index_free(ix);
+	return NULL;
+}
+
+/*
+ * Write an index to filename.  It is written under a temporary name
+ * first, so that a reader never sees half of it.
+ * Returns 0 on success, -1 on failure.
+ */
+int
+ss_index_save(SSIndex *ix, char *filename)
+{
+	FILE *fp;
+	char *tmpname;
+	int ok;
+
+	tmpname = g_new(char, strlen(filename) + 5);
+	sprintf(tmpname, "%s.tmp", filename);
+	if((fp = fopen64(tmpname, "wb")) == NULL)
+	{
+		ss_msg(WARN, "ss_index_save", "can't write seek index %s: %s", tmpname, strerror(errno));
+		g_free(tmpname);
+		return -1;
+	}
+	ok = fwrite(&ix->hdr, sizeof(ix->hdr), 1, fp) == 1
+		&& fwrite(ix->entries, sizeof(SSIndexEntry), ix->hdr.nentries, fp)
+		   == ix->hdr.nentries;
+	if(fclose(fp) != 0)
+		ok = 0;
+	if(!ok || rename(tmpname, filename) < 0)
+	{
+		ss_msg(WARN, "ss_index_save", "can't write seek index %s: %s", filename, strerror(errno));
+		remove(tmpname);
+		g_free(tmpname);
+		return -1;
+	}
+	g_free(tmpname);
+	return 0;
+}
+
+/*
+ * The name of the sidecar file for sf: the file's name with ".ssidx"
+ * added, or, if SS_INDEX_DIR is set, that in the directory it names,
+ * with the full path of the file flattened by making each '/' a '%'.
+ * Free it with g_free.
+ */
+static char *
+ss_index_name(SpiceStream *sf)
+{
+	char *dir, *path, *name, *cp;
+
+	dir = getenv("SS_INDEX_DIR");
+	if(dir == NULL || *dir == 0 || (path = realpath(sf->filename, NULL)) == NULL)
+	{
+		name = g_new(char, strlen(sf->filename) + 7);
+		sprintf(name, "%s.ssidx", sf->filename);
+		return name;
+	}
+	for(cp = path; *cp; cp++)
+		if(*cp == '/')
+			*cp = '%';
+	name = g_new(char, strlen(dir) + strlen(path) + 8);
+	sprintf(name, "%s/%s.ssidx", dir, path);
+	free(path);
+	return name;
+}
+
+/*
+ * Get an index for sf, which must not have been read from yet:
+ * the one in the sidecar file if there is a good one, otherwise a new
+ * one, which is saved in the sidecar file, with a warning if it can't
+ * be (see ss_index_name for where the sidecar is).  interval is
+ * as for ss_index_build; a sidecar made with a different nonzero
+ * interval is rebuilt.
+ * Returns NULL if the file can't be indexed.
+ */
+SSIndex *
+ss_index_open(SpiceStream *sf, int interval)
+{
+	SSIndex *ix;
+	char *name;
+
+	if(strcmp(sf->filename, "-") == 0)
+		return ss_index_build(sf, interval);	/* no sidecar for stdin */
+	name = ss_index_name(sf);
+	ix = ss_index_load(sf, name);
+	if(ix && interval > 0 && ix->hdr.interval != interval)
+	{
+		ss_index_free(ix);
+		ix = NULL;
+	}
+	if(ix == NULL)
+	{
+		ix = ss_index_build(sf, interval);
+		if(ix && ss_index_save(ix, name) < 0 && getenv("SS_INDEX_DIR") == NULL)
+			ss_msg(INFO, "ss_index_open", "set SS_INDEX_DIR to keep seek indexes in a directory that can be written");
+	}
+	g_free(name);
+	return ix;
+}
+
+/*
+ * Find where to start reading table number table, to get the rows with
+ * independent-variable values of ival and up: the last checkpoint in
+ * the table that is followed by a row with a smaller value, or else
+ * the first one in the table, which is also the answer if the values
+ * in the table aren't in order.  Returns the index of its entry, or -1
+ * if the table has no rows.
+ */
+static int
+ss_index_lookup(SSIndex *ix, int table, double ival)
+{
+	SSIndexEntry *e = ix->entries;
+	int lo, hi, mid, first;
+
+	lo = 0;
+	hi = ix->hdr.nentries;
+	while(lo < hi)
+	{
+		mid = (lo + hi) / 2;
+		if(e[mid].table < table)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if(lo == ix->hdr.nentries || e[lo].table != table)
+		return -1;
+	first = lo;
+	if(e[first].unordered)
+		return first;
+
+	/* first entry after first that isn't wanted */
+	hi = ix->hdr.nentries;
+	lo = first + 1;
+	while(lo < hi)
+	{
+		mid = (lo + hi) / 2;
+		if(e[mid].table == table && e[mid].ival < ival)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo - 1;
+}
+
+/*
+ * Return the checkpoint that ss_index_lookup finds, or NULL.
+ */
+SSCheckpoint *
+ss_index_find(SSIndex *ix, int table, double ival)
+{
+	int i;
+
+	if((i = ss_index_lookup(ix, table, ival)) < 0)
+		return NULL;
+	return &ix->entries[i].cp;
+}
+
+/*
+ * Move sf ahead to the checkpoint that ss_index_find gives for table
+ * and ival, if that is ahead of where it is now.  Call this between
+ * rows, as for ss_tell.  Returns 1 if sf was moved, 0 if not.
+ */
+int
+ss_index_seek(SSIndex *ix, SpiceStream *sf, int table, double ival)
+{
+	SSCheckpoint *cp, here;
+
+	cp = ss_index_find(ix, table, ival);
+	if(cp == NULL || ss_tell(sf, &here) < 0)
+		return 0;
+	if(cp->offset < here.offset
+	   || (cp->offset == here.offset && cp->aux <= here.aux))
+		return 0;
+	return ss_seek(sf, cp) == 0;
+}
+
+/*
+ * Skip the rest of table number table, which has been read up past the
+ * last value wanted, by moving sf to the start of the next table.  If
+ * the values in the table aren't in order, or there is no next table
+ * with rows in it, sf is left alone.  Returns 1 if sf was moved.
+ */
+int
+ss_index_next_table(SSIndex *ix, SpiceStream *sf, int table)
+{
+	int i;
+
+	i = ss_index_lookup(ix, table, -DBL_MAX);
+	if(i < 0 || ix->entries[i].unordered)
+		return 0;
+	return ss_index_seek(ix, sf, table + 1, -DBL_MAX);
+}
+
+void
+ss_index_free(SSIndex *ix)
+{
+	if(ix->entries)
+		g_free(ix->entries);
+	g_free(ix);
+}
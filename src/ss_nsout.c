@@ -252,7 +252,7 @@ sf_readrow_nsout(SpiceStream *sf, double *ivar, double *dvars)
 	}
 
 	// process iv line
-	v = atof(sf->linebuf) * sf->time_resolution * 1e-9; /* ns */
+	v = ss_strtod(sf->linebuf, NULL) * sf->time_resolution * 1e-9; /* ns */
 	*ivar = v;
 
 	// read and process dv lines until we see another iv line
@@ -279,7 +279,7 @@ sf_readrow_nsout(SpiceStream *sf, double *ivar, double *dvars)
 		idx = atoi(sidx);
 		if(idx <= sf->maxindex)
 		{
-			sf->datrow[idx] = atof(sval);
+			sf->datrow[idx] = ss_strtod(sval, NULL);
 		}
 	}
 
@@ -0,0 +1,279 @@
+/*
+ * ss_pipe.c: reading waveform files from pipes.
+ *
+ * Opening a file takes some going back: the format is guessed from the
+ * first few kilobytes, wf_read tries one header reader after another
+ * from the start of the file, and a few readers step back over bytes
+ * they have just read.  None of that works on a pipe, so input that
+ * can't seek is read through a FILE*, made with fopencookie, that keeps
+ * the start of the file and the last SSP_TAIL bytes read, and can go
+ * back to anywhere in them.  The start kept grows with what is read
+ * until the caller says the header is done, with ss_pipe_headerdone,
+ * so that a header of any width can be read again; only a header of
+ * more than SSP_HEADMAX bytes is too much.  Seeking forward reads and
+ * drops the data in between.  Checkpoints and indexes are of no use
+ * with such input, since the data they point back to is gone.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#define _GNU_SOURCE 1
+#include "ssintern.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "glib.h"
+#include "spicestream.h"
+
+#define SSP_HEAD (64*1024)	/* first size of the start kept */
+#define SSP_HEADMAX (256*1024*1024)	/* most of the start that is kept */
+#define SSP_TAIL (64*1024)	/* most recent bytes that are kept */
+
+struct _SSPipe {
+	FILE *src;	/* the pipe */
+	char *filename;
+	char *head;	/* bytes 0 to headlen */
+	size_t headlen;
+	size_t headsize;
+	int headdone;	/* the header is read; keep no more of the start */
+	char *tail;	/* byte at offset o is at tail[o % SSP_TAIL] */
+	off64_t end;	/* bytes read from src so far */
+	off64_t pos;	/* offset of the next byte to hand out */
+};
+
+/*
+ * Say why the pipe can't go back to offset off.
+ */
+static void
+ssp_lost(SSPipe *p, off64_t off)
+{
+	if(!p->headdone)
+		ss_msg(ERR, "ss_pipe", "%s: header too large for non-seekable input; "
+		       "only its first %d MB are kept", p->filename,
+		       SSP_HEADMAX / (1024*1024));
+	else
+		ss_msg(ERR, "ss_pipe", "%s: can't go back to offset 0x%lx in a pipe",
+		       p->filename, (long) off);
+}
+
+/*
+ * Read up to n bytes from the pipe itself, keeping a copy of them.
+ * Returns the number of bytes, 0 at EOF, or -1 on error.
+ */
+static ssize_t
+ssp_fill(SSPipe *p, char *buf, size_t n)
+{
+	size_t k, i, h;
+
+	k = fread(buf, 1, n, p->src);
+	if(k == 0)
+		return ferror(p->src) ? -1 : 0;
+	if(!p->headdone && p->end < SSP_HEADMAX)
+	{
+		h = k;
+		if(p->end + h > SSP_HEADMAX)
+			h = SSP_HEADMAX - p->end;
+		if(p->end + h > p->headsize)
+		{
+			while(p->end + h > p->headsize)
+				p->headsize *= 2;
+			p->head = g_realloc(p->head, p->headsize);
+		}
+		memcpy(p->head + p->end, buf, h);
+		p->headlen = p->end + h;
+	}
+	for(i = 0; i < k; )
+	{
+		size_t t = (p->end + i) % SSP_TAIL;
+		size_t m = SSP_TAIL - t;
+		if(m > k - i)
+			m = k - i;
+		memcpy(p->tail + t, buf + i, m);
+		i += m;
+	}
+	p->end += k;
+	return k;
+}
+
+/*
+ * fopencookie read function.
+ */
+static ssize_t
+ssp_read(void *cookie, char *buf, size_t n)
+{
+	SSPipe *p = cookie;
+	size_t k, t;
+	ssize_t rc;
+
+	if(p->pos == p->end)
+	{
+		rc = ssp_fill(p, buf, n);
+		if(rc > 0)
+			p->pos += rc;
+		return rc;
+	}
+
+	/* going over kept data again */
+	if(p->pos < (off64_t) p->headlen)
+	{
+		k = p->headlen - p->pos;
+		if(k > n)
+			k = n;
+		memcpy(buf, p->head + p->pos, k);
+	}
+	else if(p->end - p->pos <= SSP_TAIL)
+	{
+		t = p->pos % SSP_TAIL;
+		k = SSP_TAIL - t;
+		if(k > n)
+			k = n;
+		if((off64_t) k > p->end - p->pos)
+			k = p->end - p->pos;
+		memcpy(buf, p->tail + t, k);
+	}
+	else
+	{
+		ssp_lost(p, p->pos);
+		errno = ESPIPE;
+		return -1;
+	}
+	p->pos += k;
+	return k;
+}
+
+/*
+ * fopencookie seek function.
+ */
+static int
+ssp_seek(void *cookie, off64_t *offset, int whence)
+{
+	SSPipe *p = cookie;
+	char buf[4096];
+	off64_t target;
+	ssize_t rc;
+
+	switch(whence)
+	{
+	case SEEK_SET:
+		target = *offset;
+		break;
+	case SEEK_CUR:
+		target = p->pos + *offset;
+		break;
+	default:
+		errno = ESPIPE;
+		return -1;	/* the length isn't known */
+	}
+	if(target < 0)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	if(target < p->end && target >= (off64_t) p->headlen
+	   && p->end - target > SSP_TAIL)
+	{
+		ssp_lost(p, target);
+		errno = ESPIPE;
+		return -1;	/* no longer kept */
+	}
+	if(target <= p->end)
+		p->pos = target;
+	else
+	{
+		p->pos = p->end;
+		while(p->end < target)
+		{
+			rc = ssp_fill(p, buf, (target - p->end < (off64_t) sizeof(buf))
+				      ? (size_t) (target - p->end) : sizeof(buf));
+			p->pos = p->end;
+			if(rc <= 0)
+			{
+				errno = EINVAL;
+				return -1;	/* past the end */
+			}
+		}
+	}
+	*offset = p->pos;
+	return 0;
+}
+
+/*
+ * fopencookie close function.
+ */
+static int
+ssp_close(void *cookie)
+{
+	SSPipe *p = cookie;
+
+	fclose(p->src);
+	g_free(p->head);
+	g_free(p->tail);
+	g_free(p->filename);
+	g_free(p);
+	return 0;
+}
+
+/*
+ * Given a newly-opened file, check whether it can seek.  If not, return
+ * a FILE* that reads it and can go back as far as reading a header
+ * needs, which takes over fp, and set *pipep for ss_pipe_headerdone;
+ * otherwise return fp as it was, with *pipep NULL.
+ * Returns NULL, with fp closed, on failure.
+ */
+FILE *
+ss_pipeopen(FILE *fp, char *filename, SSPipe **pipep)
+{
+	static cookie_io_functions_t iofuncs = {
+		ssp_read, NULL, ssp_seek, ssp_close
+	};
+	SSPipe *p;
+	FILE *nfp;
+
+	*pipep = NULL;
+	if(fseeko64(fp, 0, SEEK_CUR) == 0)
+		return fp;
+
+	ss_msg(DBG, "ss_pipeopen", "%s: not seekable, reading as a pipe", filename);
+	p = g_new0(SSPipe, 1);
+	p->src = fp;
+	p->filename = g_strdup(filename);
+	p->headsize = SSP_HEAD;
+	p->head = g_new(char, p->headsize);
+	p->tail = g_new(char, SSP_TAIL);
+	if((nfp = fopencookie(p, "r", iofuncs)) == NULL)
+	{
+		ss_msg(ERR, "ss_pipeopen", "%s: %s", filename, strerror(errno));
+		ssp_close(p);
+		return NULL;
+	}
+	*pipep = p;
+	return nfp;
+}
+
+/*
+ * Say that the header of the file being read through pipe p has been
+ * read, so that no more of the start of the file need be kept for going
+ * back over.  Does nothing if p is NULL, as ss_pipeopen leaves it for
+ * a file that can seek.
+ */
+void
+ss_pipe_headerdone(SSPipe *p)
+{
+	if(p)
+		p->headdone = 1;
+}
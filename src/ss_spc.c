@@ -0,0 +1,434 @@
+/*
+ * ss_spc.c: reading the columnar cache files that sp2sp writes with
+ * -c spc.  See ss_spc.h for the layout.
+ *
+ * The whole file is mapped, and rows are put together from the columns
+ * in place; nothing is decoded.  wf_read goes further and maps the
+ * columns from the file into its WDataSets, finding them through
+ * ss_spc_table and ss_spc_column, so that only the pages of the signals
+ * that are looked at ever get read.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this library; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include "ssintern.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/mman.h>
+
+#include "glib.h"
+#include "spicestream.h"
+#include "ss_spc.h"
+
+typedef struct {
+	SpcTable *tables;	/* these point into the mapping */
+	long long *chunkoff;
+	double *swvals;
+	double *minmax;
+	int ntables;
+	int chunkrows;
+	double **rowcols;	/* column pointers for sf_readrow_spc */
+} SpcPriv;
+
+static int sf_readrow_spc(SpiceStream *sf, double *ivar, double *dvars);
+static int sf_readrows_spc(SpiceStream *sf, int maxrows, double *ivbuf,
+                           double **colbufs, int *nrows);
+static int sf_readsweep_spc(SpiceStream *sf, double *spar);
+static int sf_tellpos_spc(SpiceStream *sf, SSCheckpoint *cp);
+static int sf_skiptable_spc(SpiceStream *sf);
+static void sf_free_spc(SpiceStream *sf);
+
+/*
+ * Read the variable descriptions that follow the header, into the
+ * SpiceVar arrays of sf.
+ * Returns 0 on success, -1 if they don't fit what the header says.
+ */
+static int
+spc_read_vars(SpiceStream *sf, char *buf, int size, int ncols)
+{
+	SpcVarHdr vh;
+	SpiceVar *sv;
+	int i, n, pos, col;
+
+	pos = 0;
+	col = 1;
+	n = 1 + sf->ndv + sf->nsweepparam;
+	for(i = 0; i < n; i++)
+	{
+		if(i == 0)
+			sv = sf->ivar;
+		else if(i <= sf->ndv)
+			sv = &sf->dvar[i-1];
+		else
+			sv = &sf->spar[i-1 - sf->ndv];
+		if(size - pos < (int) sizeof(vh))
+			return -1;
+		memcpy(&vh, buf + pos, sizeof(vh));
+		pos += sizeof(vh);
+		if(vh.namelen < 0 || vh.namelen > size - pos
+		   || vh.ncols < 0 || vh.ncols > ncols)
+			return -1;
+		sv->name = g_new(char, vh.namelen + 1);
+		memcpy(sv->name, buf + pos, vh.namelen);
+		sv->name[vh.namelen] = '\0';
+		pos += vh.namelen + SPC_PADLEN(vh.namelen, 8);
+		sv->type = vh.type;
+		sv->ncols = vh.ncols;
+		if(i == 0)
+			sv->col = 0;
+		else if(i <= sf->ndv)
+		{
+			sv->col = col;
+			col += vh.ncols;
+		}
+	}
+	return (col == ncols) ? 0 : -1;
+}
+
+/*
+ * Find the directory through the trailer at the end of the mapping, and
+ * check that everything it points to is inside the file.
+ * Returns 0 on success, -1 if the file is damaged.
+ */
+static int
+spc_read_dir(SpiceStream *sf, SpcPriv *sp)
+{
+	SpcTrailer tr;
+	long long size, dirsize, n, i, k, nch, rows, off, end;
+	char *dir;
+
+	size = sf->mapend - sf->mapbase;
+	if(size < (long long) (sizeof(SpcHeader) + sizeof(tr)))
+		return -1;
+	memcpy(&tr, sf->mapend - sizeof(tr), sizeof(tr));
+	if(memcmp(tr.magic, SPC_MAGIC, 8) != 0)
+		return -1;
+	end = size - sizeof(tr);
+	if(tr.ntables < 0 || tr.ntables > INT_MAX || tr.nchunks < 0
+	   || tr.diroffset < (long long) sizeof(SpcHeader)
+	   || tr.diroffset > end || tr.diroffset % 8 != 0)
+		return -1;
+	n = tr.ntables;
+	dirsize = n * (long long) sizeof(SpcTable)
+		+ tr.nchunks * (long long) sizeof(long long)
+		+ n * sf->nsweepparam * (long long) sizeof(double)
+		+ n * sf->ncols * 2 * (long long) sizeof(double);
+	if(tr.nchunks > end / 8 || n > end / 8 || dirsize != end - tr.diroffset)
+		return -1;
+
+	dir = sf->mapbase + tr.diroffset;
+	sp->ntables = n;
+	sp->tables = (SpcTable *) dir;
+	sp->chunkoff = (long long *) (dir + n * sizeof(SpcTable));
+	sp->swvals = (double *) (sp->chunkoff + tr.nchunks);
+	sp->minmax = sp->swvals + n * sf->nsweepparam;
+
+	for(i = 0; i < n; i++)
+	{
+		if(sp->tables[i].nrows < 0 || sp->tables[i].nrows > INT_MAX)
+			return -1;
+		nch = (sp->tables[i].nrows + sp->chunkrows - 1) / sp->chunkrows;
+		if(sp->tables[i].firstchunk < 0
+		   || sp->tables[i].firstchunk > tr.nchunks - nch)
+			return -1;
+		for(k = 0; k < nch; k++)
+		{
+			rows = sp->tables[i].nrows - k * sp->chunkrows;
+			if(rows > sp->chunkrows)
+				rows = sp->chunkrows;
+			off = sp->chunkoff[sp->tables[i].firstchunk + k];
+			if(off < 0 || off % 8 != 0 || off > tr.diroffset
+			   || rows * sf->ncols * (long long) sizeof(double) > tr.diroffset - off)
+				return -1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Read the header of an spc file, and map the file.
+ */
+SpiceStream *
+sf_rdhdr_spc(char *name, FILE *fp)
+{
+	SpiceStream *sf;
+	SpcHeader hdr;
+	SpcPriv *sp;
+	char *buf;
+
+	if(fread(&hdr, sizeof(hdr), 1, fp) != 1
+	   || memcmp(hdr.magic, SPC_MAGIC, 8) != 0)
+		return NULL;
+	if(hdr.byteorder != SPC_BYTEORDER)
+	{
+		ss_msg(ERR, "sf_rdhdr_spc", "%s: written on a machine with a different byte order", name);
+		return NULL;
+	}
+	if(hdr.version != SPC_VERSION)
+	{
+		ss_msg(ERR, "sf_rdhdr_spc", "%s: unknown version %d", name, hdr.version);
+		return NULL;
+	}
+	/* every variable has a description of its own in varsize, and
+	 * one or two (complex) columns, so the counts can't be bigger than
+	 * those allow; check before ss_new allocates by them */
+	if(hdr.ndv < 0 || hdr.ncols < 1 || hdr.nsweepparam < 0
+	   || hdr.chunkrows < 1 || hdr.varsize < 0 || hdr.varsize > (1 << 30)
+	   || hdr.ndv > hdr.ncols - 1
+	   || hdr.ncols - 1 > 2 * (long long) hdr.ndv
+	   || (1 + (long long) hdr.ndv + hdr.nsweepparam)
+	      * (long long) sizeof(SpcVarHdr) > hdr.varsize)
+	{
+		ss_msg(ERR, "sf_rdhdr_spc", "%s: bad header", name);
+		return NULL;
+	}
+
+	buf = g_new(char, hdr.varsize + 1);
+	if(fread(buf, 1, hdr.varsize, fp) != (size_t) hdr.varsize)
+	{
+		ss_msg(ERR, "sf_rdhdr_spc", "%s: EOF reading variable names", name);
+		g_free(buf);
+		return NULL;
+	}
+	sf = ss_new(fp, name, hdr.ndv, hdr.nsweepparam);
+	sf->ncols = hdr.ncols;
+	if(spc_read_vars(sf, buf, hdr.varsize, hdr.ncols) < 0)
+	{
+		ss_msg(ERR, "sf_rdhdr_spc", "%s: bad variable descriptions", name);
+		g_free(buf);
+		goto fail;
+	}
+	g_free(buf);
+
+	ss_map_input(sf);
+	if(sf->mapbase == NULL)
+	{
+		ss_msg(ERR, "sf_rdhdr_spc", "%s: spc files can only be read from a regular file", name);
+		goto fail;
+	}
+#ifdef MADV_NORMAL
+	/* the columns are read side by side, or not at all */
+	madvise(sf->mapbase, sf->mapend - sf->mapbase, MADV_NORMAL);
+#endif
+
+	sp = g_new0(SpcPriv, 1);
+	sp->chunkrows = hdr.chunkrows;
+	sp->rowcols = g_new(double *, sf->ncols);
+	sf->rdpriv = sp;
+	sf->rdfree = sf_free_spc;
+	if(spc_read_dir(sf, sp) < 0)
+	{
+		ss_msg(ERR, "sf_rdhdr_spc", "%s: incomplete or damaged file", name);
+		goto fail;
+	}
+
+	sf->readrow = sf_readrow_spc;
+	sf->readblock = sf_readrows_spc;
+	sf->readsweep = sf_readsweep_spc;
+	sf->tellpos = sf_tellpos_spc;
+	sf->seekpos = sf_tellpos_spc;
+	sf->skiptable = sf_skiptable_spc;
+	sf->ntables = sp->ntables;
+	sf->read_tables = 0;
+	sf->read_rows = 0;
+	sf->read_sweepparam = 0;
+	ss_msg(DBG, "sf_rdhdr_spc", "%s: %d tables, %d columns, %d rows a chunk",
+	       name, sp->ntables, sf->ncols, sp->chunkrows);
+	return sf;
+
+fail:
+	sf->fp = NULL;	/* left for the caller to close */
+	ss_delete(sf);
+	return NULL;
+}
+
+static void
+sf_free_spc(SpiceStream *sf)
+{
+	SpcPriv *sp = sf->rdpriv;
+
+	g_free(sp->rowcols);
+	g_free(sp);
+	sf->rdpriv = NULL;
+}
+
+/*
+ * Start of column col of chunk k of table t, and the number of rows in
+ * that chunk.
+ */
+static double *
+spc_chunkcol(SpiceStream *sf, int t, int k, int col, int *np)
+{
+	SpcPriv *sp = sf->rdpriv;
+	SpcTable *tp = &sp->tables[t];
+	long long n;
+
+	n = tp->nrows - (long long) k * sp->chunkrows;
+	if(n > sp->chunkrows)
+		n = sp->chunkrows;
+	*np = n;
+	return (double *) (sf->mapbase + sp->chunkoff[tp->firstchunk + k]) + col * n;
+}
+
+/*
+ * Move on to the next table.  Returns -2 if there is one, 0 if not.
+ */
+static int
+spc_end_table(SpiceStream *sf)
+{
+	SpcPriv *sp = sf->rdpriv;
+
+	sf->read_tables++;
+	sf->read_rows = 0;
+	sf->read_sweepparam = 0;
+	return (sf->read_tables < sp->ntables) ? -2 : 0;
+}
+
+/*
+ * Copy up to maxrows rows of the current table into ivbuf and colbufs,
+ * column by column.  Columns left out by ss_set_projection aren't touched.
+ */
+static int
+sf_readrows_spc(SpiceStream *sf, int maxrows, double *ivbuf,
+                double **colbufs, int *nrows)
+{
+	SpcPriv *sp = sf->rdpriv;
+	double *p;
+	int n, k, c, cn, off;
+
+	*nrows = 0;
+	if(maxrows <= 0)
+		return 1;
+	if(sf->read_tables >= sp->ntables)
+		return 0;
+	sf->read_sweepparam = 1;	/* nothing to skip over */
+
+	n = 0;
+	while(n < maxrows && sf->read_rows < sp->tables[sf->read_tables].nrows)
+	{
+		p = spc_chunkcol(sf, sf->read_tables, sf->read_rows / sp->chunkrows, 0, &cn);
+		off = sf->read_rows % sp->chunkrows;
+		k = cn - off;
+		if(k > maxrows - n)
+			k = maxrows - n;
+		memcpy(&ivbuf[n], p + off, k * sizeof(double));
+		for(c = 1; c < sf->ncols; c++)
+		{
+			if(sf->colsel == NULL || sf->colsel[c-1])
+				memcpy(&colbufs[c-1][n], p + c * cn + off, k * sizeof(double));
+		}
+		n += k;
+		sf->read_rows += k;
+	}
+	*nrows = n;
+	if(n == maxrows)
+		return 1;
+	return spc_end_table(sf);
+}
+
+static int
+sf_readrow_spc(SpiceStream *sf, double *ivar, double *dvars)
+{
+	SpcPriv *sp = sf->rdpriv;
+	int c, n, rc;
+
+	for(c = 1; c < sf->ncols; c++)
+		sp->rowcols[c-1] = &dvars[c-1];
+	rc = sf_readrows_spc(sf, 1, ivar, sp->rowcols, &n);
+	return (n == 1) ? 1 : rc;
+}
+
+/*
+ * The sweep parameters of each table are in the directory.
+ */
+static int
+sf_readsweep_spc(SpiceStream *sf, double *spar)
+{
+	SpcPriv *sp = sf->rdpriv;
+
+	if(sf->read_tables >= sp->ntables)
+		return 0;
+	if(spar)
+		memcpy(spar, &sp->swvals[sf->read_tables * sf->nsweepparam],
+		       sf->nsweepparam * sizeof(double));
+	sf->read_sweepparam = 1;
+	return 1;
+}
+
+/*
+ * The table and row counts saved by ss_tell say where we are; there
+ * is nothing else to save or restore.
+ */
+static int
+sf_tellpos_spc(SpiceStream *sf, SSCheckpoint *cp)
+{
+	return 0;
+}
+
+static int
+sf_skiptable_spc(SpiceStream *sf)
+{
+	SpcPriv *sp = sf->rdpriv;
+
+	if(sf->read_tables >= sp->ntables)
+		return 0;
+	return spc_end_table(sf);
+}
+
+/*
+ * For wf_read: get the number of rows in table t of an spc file, the
+ * rows in each of its chunks but the last, whether its independent
+ * variable is in order, and its sweep parameter values.
+ * Returns 0 on success, -1 if there's no such table.
+ */
+int
+ss_spc_table(SpiceStream *sf, int t, int *nrowsp, int *chunkrowsp,
+             int *sortedp, double **swvalsp)
+{
+	SpcPriv *sp = sf->rdpriv;
+
+	if(sp == NULL || sf->rdfree != sf_free_spc || t < 0 || t >= sp->ntables)
+		return -1;
+	*nrowsp = sp->tables[t].nrows;
+	*chunkrowsp = sp->chunkrows;
+	*sortedp = sp->tables[t].sorted;
+	*swvalsp = &sp->swvals[t * sf->nsweepparam];
+	return 0;
+}
+
+/*
+ * For wf_read: point blocks[k] at the values of column col in chunk k of
+ * table t, in the mapping, and get the smallest and largest of them.
+ * The pointers stay good until the SpiceStream is closed.
+ * Returns the number of chunks.
+ */
+int
+ss_spc_column(SpiceStream *sf, int t, int col, double **blocks,
+              double *minp, double *maxp)
+{
+	SpcPriv *sp = sf->rdpriv;
+	int k, n, nch;
+
+	nch = (sp->tables[t].nrows + sp->chunkrows - 1) / sp->chunkrows;
+	for(k = 0; k < nch; k++)
+		blocks[k] = spc_chunkcol(sf, t, k, col, &n);
+	*minp = sp->minmax[((long long) t * sf->ncols + col) * 2];
+	*maxp = sp->minmax[((long long) t * sf->ncols + col) * 2 + 1];
+	return nch;
+}
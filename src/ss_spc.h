@@ -0,0 +1,72 @@
+/*
+ * ss_spc.h: layout of the columnar cache files, ".spc", that sp2sp
+ * writes with -c spc and ss_spc.c reads.
+ *
+ * The file starts with an SpcHeader, followed by an SpcVarHdr and name
+ * for the independent variable, each dependent variable and each sweep
+ * parameter, in that order.  The data follows in chunks of up to
+ * chunkrows rows, each starting at a multiple of SPC_PAGESIZE.  Within
+ * a chunk of n rows, column c (0 for the independent variable, then the
+ * data columns as numbered by SpiceVar.col) is n native doubles starting
+ * at byte c * n * sizeof(double) of the chunk.  The chunks of a table
+ * are consecutive, and a new table starts a new chunk.  The independent
+ * variable has one column even if its ncols says otherwise; spice3 uses
+ * that to mark complex frequency sweeps.
+ *
+ * After the data comes the directory, at an 8-byte boundary: an
+ * SpcTable for each table, the file offset of each chunk (long long), the
+ * sweep parameter values of each table, and the minimum and maximum of
+ * each column of each table (doubles, min then max, by table and then
+ * column).  The file ends with an SpcTrailer.  Keeping everything that
+ * is known only at the end in the directory lets sp2sp write the file
+ * in one pass, to a pipe if need be.
+ *
+ * Everything is in the native byte order; like the .ssidx sidecars,
+ * this is a cache, not an interchange format.
+ */
+
+#ifndef SS_SPC_H
+#define SS_SPC_H
+
+#define SPC_MAGIC "SP2SPSPC"
+#define SPC_VERSION 1
+#define SPC_BYTEORDER 0x01020304
+#define SPC_PAGESIZE 4096
+
+typedef struct {
+	char magic[8];	/* SPC_MAGIC */
+	gint32 version;	/* SPC_VERSION */
+	gint32 byteorder;	/* SPC_BYTEORDER, as the writer stored it */
+	gint32 ndv;
+	gint32 ncols;	/* including the independent variable */
+	gint32 nsweepparam;
+	gint32 chunkrows;
+	gint32 varsize;	/* bytes of variable descriptions that follow */
+	gint32 pad;
+} SpcHeader;
+
+/* followed by namelen bytes of name, padded to a multiple of 8 */
+typedef struct {
+	gint32 type;	/* VarType */
+	gint32 ncols;
+	gint32 namelen;
+	gint32 pad;
+} SpcVarHdr;
+
+typedef struct {
+	long long nrows;
+	long long firstchunk;	/* index of its first entry in the chunk offsets */
+	gint32 sorted;	/* independent variable never decreases in the table */
+	gint32 pad;
+} SpcTable;
+
+typedef struct {
+	long long diroffset;	/* file offset of the directory */
+	long long ntables;
+	long long nchunks;
+	char magic[8];	/* SPC_MAGIC again */
+} SpcTrailer;
+
+#define SPC_PADLEN(n, a) (((a) - (n) % (a)) % (a))
+
+#endif /* SS_SPC_H */
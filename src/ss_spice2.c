@@ -37,6 +37,8 @@
 #include "spicestream.h"
 
 static int sf_readrow_s2raw(SpiceStream *sf, double *ivar, double *dvars);
+static int sf_readrows_s2raw(SpiceStream *sf, int maxrows, double *ivbuf,
+                             double **colbufs, int *nrows);
 static char *msgid = "s2raw";
 
 /* Read spice-type file header - Berkeley Spice2G6 "raw" format */
@@ -77,7 +79,7 @@ sf_rdhdr_s2raw(char *name, FILE *fp)
 
 	ndv = s2hdr.nvars - 1;
 	sf = ss_new(fp, name, ndv, 0);
-	sf->ncols = ndv;
+	sf->ncols = ndv + 1;
 	sf->ivar->name = g_strdup(s2vname.name);
 	sf->ivar->type = TIME;
 	sf->ivar->col = 0;
@@ -95,7 +97,7 @@ sf_rdhdr_s2raw(char *name, FILE *fp)
 
 		sf->dvar[i].name = g_strdup(s2vname.name);
 		sf->dvar[i].type = VOLTAGE;  /* FIXME:sgt: get correct type */
-		sf->dvar[i].col = i; /* FIXME:sgt: handle complex */
+		sf->dvar[i].col = i + 1; /* FIXME:sgt: handle complex */
 		sf->dvar[i].ncols = 1;
 	}
 
@@ -121,6 +123,12 @@ sf_rdhdr_s2raw(char *name, FILE *fp)
 	ss_msg(DBG, msgid, "done with header at offset=0x%lx", (long) ftello64(fp));
 
 	sf->readrow = sf_readrow_s2raw;
+	sf->readblock = sf_readrows_s2raw;
+	sf->tellpos = ss_tellpos_bytes;
+	sf->seekpos = ss_seekpos_bytes;
+	sf->rowbase = ftello64(fp);
+	sf->rowvals = sf->ncols;
+	sf->rowsize = sf->ncols * sizeof(spice_var_t);
 	return sf;
 err:
 	if(sf)
@@ -132,35 +140,122 @@ err:
 
 
 /*
- * Read row of values from a spice2 rawfile
+ * Read one value from a spice2 rawfile into *val.
+ * Returns 1 on success, 0 on EOF.
  */
 static int
-sf_readrow_s2raw(SpiceStream *sf, double *ivar, double *dvars)
+sf_getval_s2raw(SpiceStream *sf, spice_var_t *val)
+{
+	void *p;
+
+	if((p = ss_getbytes(sf, sizeof(spice_var_t))) == NULL)
+		return 0;
+	memcpy(val, p, sizeof(spice_var_t));
+	return 1;
+}
+
+/*
+ * Read the dependent-variable values of one row of a spice2 rawfile
+ * into dvars, or into row n of colbufs if colbufs isn't NULL.
+ * Columns left out by ss_set_projection are skipped.
+ * Returns the number of columns read or skipped, which is less than
+ * sf->ndv on EOF.
+ */
+static int
+sf_getdvals_s2raw(SpiceStream *sf, double *dvars, double **colbufs, int n)
 {
-	int i, rc;
 	spice_var_t val;
+	int i, k, c;
 
-	/* independent var */
-	if ((rc = fread (&val,sizeof(val),1, sf->fp)) != 1)
+	if(sf->projcols == NULL)
 	{
-		if(rc == 0)
-			return 0;
+		for(i = 0; i < sf->ndv; i++)
+		{
+			if(sf_getval_s2raw(sf, &val) != 1)
+				return i;
+			if(colbufs)
+				colbufs[i][n] = val.val;
+			else
+				dvars[i] = val.val;
+		}
+		return sf->ndv;
+	}
+
+	c = 0;
+	for(k = 0; k < sf->nprojcols; k++)
+	{
+		i = sf->projcols[k];
+		if(i > c && !ss_skipbytes(sf, (i - c) * sizeof(spice_var_t)))
+			return c;
+		if(sf_getval_s2raw(sf, &val) != 1)
+			return i;
+		if(colbufs)
+			colbufs[i][n] = val.val;
 		else
-			return -1;
+			dvars[i] = val.val;
+		c = i + 1;
 	}
+	if(c < sf->ndv && !ss_skipbytes(sf, (sf->ndv - c) * sizeof(spice_var_t)))
+		return c;
+	return sf->ndv;
+}
+
+/*
+ * Read row of values from a spice2 rawfile
+ */
+static int
+sf_readrow_s2raw(SpiceStream *sf, double *ivar, double *dvars)
+{
+	int i;
+	spice_var_t val;
+
+	/* independent var */
+	if (sf_getval_s2raw(sf, &val) != 1)
+		return 0;
 	if (memcmp(&val,SPICE_MAGIC,8) == 0) /* another analysis */
 		return 0;
 	*ivar = val.val;
 
 	/* dependent vars */
-	for(i = 0; i < sf->ndv; i++)
+	if((i = sf_getdvals_s2raw(sf, dvars, NULL, 0)) < sf->ndv)
 	{
-		if(fread(&val, sizeof(val), 1, sf->fp) != 1)
+		ss_msg(ERR, msgid, "unexpected EOF at dvar %d", i);
+		return -1;
+	}
+	return 1;
+}
+
+/*
+ * Read block of rows from a spice2 rawfile into column buffers.
+ * Returns 1 if maxrows rows were read, otherwise the same status as
+ * sf_readrow_s2raw, with the number of rows read in *nrows.
+ */
+static int
+sf_readrows_s2raw(SpiceStream *sf, int maxrows, double *ivbuf,
+                  double **colbufs, int *nrows)
+{
+	int i, n;
+	spice_var_t val;
+
+	for(n = 0; n < maxrows; n++)
+	{
+		/* independent var */
+		if (sf_getval_s2raw(sf, &val) != 1
+		    || memcmp(&val,SPICE_MAGIC,8) == 0) /* EOF or another analysis */
+		{
+			*nrows = n;
+			return 0;
+		}
+		ivbuf[n] = val.val;
+
+		/* dependent vars */
+		if((i = sf_getdvals_s2raw(sf, NULL, colbufs, n)) < sf->ndv)
 		{
 			ss_msg(ERR, msgid, "unexpected EOF at dvar %d", i);
+			*nrows = n;
 			return -1;
 		}
-		dvars[i] = val.val;
 	}
+	*nrows = n;
 	return 1;
 }
@@ -35,6 +35,13 @@
 static int sf_readrow_s3raw(SpiceStream *sf, double *ivar, double *dvars);
 char *msgid = "s3raw";
 static int sf_readrow_s3bin(SpiceStream *sf, double *ivar, double *dvars);
+static int sf_readrows_s3raw(SpiceStream *sf, int maxrows, double *ivbuf,
+                             double **colbufs, int *nrows);
+static int sf_readrows_s3bin(SpiceStream *sf, int maxrows, double *ivbuf,
+                             double **colbufs, int *nrows);
+static int sf_tellpos_s3raw(SpiceStream *sf, SSCheckpoint *cp);
+static int sf_seekpos_s3raw(SpiceStream *sf, SSCheckpoint *cp);
+static long long sf_estrows_s3raw(SpiceStream *sf);
 
 /* convert variable type string from spice3 raw file to
  * our type numbers
@@ -216,11 +223,21 @@ SpiceStream* sf_rdhdr_s3raw(char *name, FILE *fp)
 	if(binary)
 	{
 		sf->readrow = sf_readrow_s3bin;
+		sf->readblock = sf_readrows_s3bin;
+		sf->tellpos = ss_tellpos_bytes;
+		sf->seekpos = ss_seekpos_bytes;
+		sf->rowbase = ftello64(fp);
+		sf->rowvals = sf->ncols + (dtype_complex ? 1 : 0);
+		sf->rowsize = sf->rowvals * sizeof(double);
 	}
 	else
 	{
 		sf->readrow = sf_readrow_s3raw;
+		sf->readblock = sf_readrows_s3raw;
+		sf->tellpos = sf_tellpos_s3raw;
+		sf->seekpos = sf_seekpos_s3raw;
 	}
+	sf->estrows = sf_estrows_s3raw;
 	sf->read_rows = 0;
 	sf->expected_vals = npoints * (sf->ncols + (dtype_complex ? 1 : 0));
 	ss_msg(DBG, msgid, "expecting %d values\n", sf->expected_vals);
@@ -299,13 +316,58 @@ static char *sf_nexttoken(SpiceStream *sf)
 
 
 /*
- * Read row of values from an ascii spice3 raw file
+ * tellpos and seekpos for ascii spice3 raw files, which are read through
+ * the FILE* a line at a time.  If a row ended part way through a line,
+ * the position is that of the rest of the line; every line read with
+ * fread_line ended in a newline.
  */
 static int
-sf_readrow_s3raw(SpiceStream *sf, double *ivar, double *dvars)
+sf_tellpos_s3raw(SpiceStream *sf, SSCheckpoint *cp)
+{
+	off64_t pos;
+
+	if((pos = ftello64(sf->fp)) < 0)
+		return -1;
+	if(sf->linep && *sf->linep)
+	{
+		pos -= strlen(sf->linep) + 1;
+		cp->lineno--;	/* it will be counted again */
+	}
+	cp->offset = pos;
+	return 0;
+}
+
+static int
+sf_seekpos_s3raw(SpiceStream *sf, SSCheckpoint *cp)
+{
+	if(fseeko64(sf->fp, cp->offset, SEEK_SET) < 0)
+		return -1;
+	sf->linep = NULL;
+	return 0;
+}
+
+/*
+ * Rows not yet read, by the "No. Points:" of the header.  A row of a
+ * complex file has two values for the independent variable, which is
+ * marked by its having two columns.
+ */
+static long long
+sf_estrows_s3raw(SpiceStream *sf)
+{
+	int rowvals = sf->ncols + sf->ivar->ncols - 1;
+
+	return sf->expected_vals / rowvals - sf->read_rows;
+}
+
+/*
+ * Read the row number and independent-variable value that start
+ * a row of an ascii spice3 raw file.
+ * Returns 1 on success, 0 on EOF, -1 on error, or -2 if the
+ * independent variable decreased, indicating the start of another sweep.
+ */
+static int
+sf_getiv_s3raw(SpiceStream *sf, double *ivar)
 {
-	int i;
-	// int frownum;
 	char *tok;
 	double v;
 
@@ -335,7 +397,7 @@ sf_readrow_s3raw(SpiceStream *sf, double *ivar, double *dvars)
 			       sf->filename, sf->lineno);
 			return -1;
 		}
-		v = atof(tok);
+		v = ss_strntod(tok, sf->linep - tok, NULL);
 		if(v < sf->ivval)
 		{
 			/* independent-variable value decreased, this must
@@ -358,35 +420,106 @@ sf_readrow_s3raw(SpiceStream *sf, double *ivar, double *dvars)
 		sf->flags &= ~SSF_PUSHBACK;
 		*ivar = sf->ivval;
 	}
+	return 1;
+}
 
-	for(i = 0; i < sf->ndv; i++)
+/*
+ * Read one (possibly complex) dependent-variable value from an ascii
+ * spice3 raw file into re, and im if the variable has two columns.
+ * If the variable was left out by ss_set_projection, its value is
+ * skipped instead.
+ * Returns 1 on success, -1 on error.
+ */
+static int
+sf_getdv_s3raw(SpiceStream *sf, SpiceVar *dv, double *re, double *im)
+{
+	char *tok;
+
+	tok = sf_nexttoken(sf);
+	if(!tok)
 	{
-		SpiceVar *dv;
-		dv = &sf->dvar[i];
+		ss_msg(ERR, msgid, "%s:%d: expected value",
+		       sf->filename, sf->lineno);
+		return -1;
+	}
+	if(sf->colsel && !sf->colsel[dv->col-1])
+		return 1;
+	*re = ss_strntod(tok, sf->linep - tok, NULL);
 
-		tok = sf_nexttoken(sf);
-		if(!tok)
+	if(dv->ncols > 1)
+	{
+		tok = memchr(tok, ',', sf->linep - tok);
+		if(!tok || tok + 1 == sf->linep)
 		{
-			ss_msg(ERR, msgid, "%s:%d: expected value",
+			ss_msg(ERR, msgid, "%s:%d: expected second value",
 			       sf->filename, sf->lineno);
 			return -1;
 		}
-		dvars[dv->col-1] = atof(tok);
+		tok++;
+		*im = ss_strntod(tok, sf->linep - tok, NULL);
+	}
+	return 1;
+}
+
+/*
+ * Read row of values from an ascii spice3 raw file
+ */
+static int
+sf_readrow_s3raw(SpiceStream *sf, double *ivar, double *dvars)
+{
+	int i, rc;
+	SpiceVar *dv;
+
+	if((rc = sf_getiv_s3raw(sf, ivar)) != 1)
+		return rc;
+
+	for(i = 0; i < sf->ndv; i++)
+	{
+		dv = &sf->dvar[i];
+		if(sf_getdv_s3raw(sf, dv, &dvars[dv->col-1], &dvars[dv->col]) < 0)
+			return -1;
+	}
+	sf->read_rows++;
+	return 1;
+}
 
-		if(dv->ncols > 1)
+/*
+ * Read block of rows from an ascii spice3 raw file into column buffers.
+ * Returns 1 if maxrows rows were read, otherwise the same status as
+ * sf_readrow_s3raw, with the number of rows read in *nrows.
+ */
+static int
+sf_readrows_s3raw(SpiceStream *sf, int maxrows, double *ivbuf,
+                  double **colbufs, int *nrows)
+{
+	int i, n, rc;
+	SpiceVar *dv;
+	double dummy;
+
+	for(n = 0; n < maxrows; n++)
+	{
+		if((rc = sf_getiv_s3raw(sf, &ivbuf[n])) != 1)
+		{
+			*nrows = n;
+			return rc;
+		}
+		for(i = 0; i < sf->ndv; i++)
 		{
-			tok = strchr(tok, ',');
-			if(!tok || !*(tok+1))
+			dv = &sf->dvar[i];
+			if(sf->colsel && !sf->colsel[dv->col-1])
+				rc = sf_getdv_s3raw(sf, dv, &dummy, &dummy);
+			else
+				rc = sf_getdv_s3raw(sf, dv, &colbufs[dv->col-1][n],
+						    dv->ncols > 1 ? &colbufs[dv->col][n] : &dummy);
+			if(rc < 0)
 			{
-				ss_msg(ERR, msgid, "%s:%d: expected second value",
-				       sf->filename, sf->lineno);
+				*nrows = n;
 				return -1;
 			}
-			tok++;
-			dvars[dv->col] = atof(tok);
 		}
+		sf->read_rows++;
 	}
-	sf->read_rows++;
+	*nrows = n;
 	return 1;
 }
 
@@ -399,34 +532,95 @@ static int
 sf_getval_s3bin(SpiceStream *sf, double *dval)
 {
 	off64_t pos;
-	double val;
+	void *p;
 
 	if(sf->read_vals >= sf->expected_vals)
 	{
-		pos = ftello64(sf->fp);
+		pos = ss_inpos(sf);
 		ss_msg(DBG, "sf_getval_s3bin", "past last expected value offset 0x%lx", (long) pos);
 		return 0;
 	}
-	if(fread(&val, sizeof(double), 1, sf->fp) != 1)
+	if((p = ss_getbytes(sf, sizeof(double))) == NULL)
 	{
-		pos = ftello64(sf->fp);
+		pos = ss_inpos(sf);
 		ss_msg(ERR, "sf_getval_s3bin", "unexepected EOF in data at offset 0x%lx", (long) pos);
 		return -1;
 	}
 	sf->read_vals++;
 
-	*dval = val;
+	memcpy(dval, p, sizeof(double));
 	return 1;
 }
 
 
 /*
- * Read row of values from a binay spice3 raw file
+ * Skip over n values in a binary spice3 rawfile.
  */
 static int
-sf_readrow_s3bin(SpiceStream *sf, double *ivar, double *dvars)
+sf_skipvals_s3bin(SpiceStream *sf, int n)
 {
-	int i, rc;
+	off64_t pos;
+
+	if(sf->read_vals + n > sf->expected_vals)
+	{
+		pos = ss_inpos(sf);
+		ss_msg(DBG, "sf_skipvals_s3bin", "past last expected value offset 0x%lx", (long) pos);
+		return 0;
+	}
+	if(!ss_skipbytes(sf, n * sizeof(double)))
+	{
+		ss_msg(ERR, "sf_skipvals_s3bin", "unexepected EOF in data");
+		return -1;
+	}
+	sf->read_vals += n;
+	return 1;
+}
+
+/*
+ * Read the dependent-variable values of one row of a binary spice3 rawfile
+ * into dvars, or into row n of colbufs if colbufs isn't NULL.
+ * Columns left out by ss_set_projection are skipped.
+ * Returns the number of columns read or skipped, which is less than
+ * sf->ncols-1 if EOF or an error was found.
+ */
+static int
+sf_getdvals_s3bin(SpiceStream *sf, double *dvars, double **colbufs, int n)
+{
+	int i, k, c;
+
+	if(sf->projcols == NULL)
+	{
+		for(i = 0; i < sf->ncols-1; i++)
+			if(sf_getval_s3bin(sf, colbufs ? &colbufs[i][n] : &dvars[i]) != 1)
+				return i;
+		return sf->ncols-1;
+	}
+
+	c = 0;
+	for(k = 0; k < sf->nprojcols; k++)
+	{
+		i = sf->projcols[k];
+		if(i > c && sf_skipvals_s3bin(sf, i - c) != 1)
+			return c;
+		if(sf_getval_s3bin(sf, colbufs ? &colbufs[i][n] : &dvars[i]) != 1)
+			return i;
+		c = i + 1;
+	}
+	if(c < sf->ncols-1 && sf_skipvals_s3bin(sf, sf->ncols-1 - c) != 1)
+		return c;
+	return sf->ncols-1;
+}
+
+/*
+ * Read the independent-variable value that starts a row of
+ * a binary spice3 raw file.
+ * Returns 1 on success, 0 on EOF, -1 on error, or -2 if the
+ * independent variable decreased, indicating the start of another sweep.
+ */
+static int
+sf_getiv_s3bin(SpiceStream *sf, double *ivar)
+{
+	int rc;
 	double v;
 	double dummy;
 
@@ -467,16 +661,56 @@ sf_readrow_s3bin(SpiceStream *sf, double *ivar, double *dvars)
 		sf->flags &= ~SSF_PUSHBACK;
 		*ivar = sf->ivval;
 	}
+	return 1;
+}
+
+/*
+ * Read row of values from a binay spice3 raw file
+ */
+static int
+sf_readrow_s3bin(SpiceStream *sf, double *ivar, double *dvars)
+{
+	int i, rc;
+
+	if((rc = sf_getiv_s3bin(sf, ivar)) != 1)
+		return rc;
+
+	if((i = sf_getdvals_s3bin(sf, dvars, NULL, 0)) < sf->ncols-1)
+	{
+		ss_msg(WARN, "sf_readrow_s3bin", "%s: EOF or error reading data field %d in row %d; file is incomplete.", sf->filename, i, sf->read_rows);
+		return 0;
+	}
+
+	sf->read_rows++;
+	return 1;
+}
+
+/*
+ * Read block of rows from a binary spice3 raw file into column buffers.
+ * Returns 1 if maxrows rows were read, otherwise the same status as
+ * sf_readrow_s3bin, with the number of rows read in *nrows.
+ */
+static int
+sf_readrows_s3bin(SpiceStream *sf, int maxrows, double *ivbuf,
+                  double **colbufs, int *nrows)
+{
+	int i, n, rc;
 
-	for(i = 0; i < sf->ncols-1; i++)
+	for(n = 0; n < maxrows; n++)
 	{
-		if(sf_getval_s3bin(sf, &dvars[i]) != 1)
+		if((rc = sf_getiv_s3bin(sf, &ivbuf[n])) != 1)
 		{
-			ss_msg(WARN, "sf_readrow_s3bin", "%s: EOF or error reading data field %d in row %d; file is incomplete.", sf->filename, i, sf->read_rows);
+			*nrows = n;
+			return rc;
+		}
+		if((i = sf_getdvals_s3bin(sf, NULL, colbufs, n)) < sf->ncols-1)
+		{
+			ss_msg(WARN, "sf_readrows_s3bin", "%s: EOF or error reading data field %d in row %d; file is incomplete.", sf->filename, i, sf->read_rows);
+			*nrows = n;
 			return 0;
 		}
+		sf->read_rows++;
 	}
-
-	sf->read_rows++;
+	*nrows = n;
 	return 1;
 }
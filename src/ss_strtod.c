@@ -0,0 +1,670 @@
+/*
+ * ss_strtod.c: fast conversion between decimal text and double for SpiceStream
+ *
+ * Reading the ascii formats is mostly a matter of converting numbers,
+ * and atof is slow: it handles locales, hex floats and arbitrarily long
+ * inputs on every call.  ss_strtod handles the plain decimal numbers that
+ * simulators write, always with '.' as the decimal point, and returns the
+ * correctly rounded double, the same as strtod in the C locale.
+ *
+ * Up to 19 significant digits are collected into a 64-bit integer w,
+ * giving a value of w * 10^q.  If w and 10^q are both exact doubles, one
+ * multiply or divide does it (Clinger's fast path).  Otherwise w is
+ * multiplied by a 128-bit approximation of 5^q from a table, which
+ * gives the correctly rounded result for any w (the Eisel-Lemire
+ * algorithm; see D. Lemire, "Number Parsing at a Gigabyte per Second",
+ * and N. Mushtak and D. Lemire, "Fast Number Parsing Without Fallback").
+ * Only numbers with more than 19 significant digits that land too close
+ * to a rounding boundary, and things like "inf" and "nan", are handed
+ * to strtod.
+ *
+ * Writing text is mostly a matter of printf("%.*g"), which is slower
+ * still; ss_fmtg does the same job with the same table, below.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include "ssintern.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+
+#include "glib.h"
+#include "spicestream.h"
+#include "ss_pow5tab.h"
+
+typedef unsigned long long ss_u64;
+
+#define SS_MAXDIGITS 19		/* significant digits that fit in a ss_u64 */
+
+static double ss_strtod_slow(const char *s, const char *end, char **endp);
+
+/* powers of ten that are exact doubles */
+static const double ss_pow10[] =
+{
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+	1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19,
+	1e20, 1e21, 1e22
+};
+
+#define ss_isdigit(c) ((unsigned)((c) - '0') < 10)
+#define ss_isspace(c) ((c) == ' ' || ((c) >= '\t' && (c) <= '\r'))
+
+/*
+ * high and low 64 bits of the product of a and b
+ */
+static inline ss_u64
+ss_mul128(ss_u64 a, ss_u64 b, ss_u64 *lo)
+{
+#if defined(__SIZEOF_INT128__)
+	unsigned __int128 r = (unsigned __int128) a * b;
+	*lo = (ss_u64) r;
+	return (ss_u64) (r >> 64);
+#else
+	ss_u64 a0 = a & 0xffffffff, a1 = a >> 32;
+	ss_u64 b0 = b & 0xffffffff, b1 = b >> 32;
+	ss_u64 p00 = a0 * b0, p01 = a0 * b1, p10 = a1 * b0, p11 = a1 * b1;
+	ss_u64 mid = (p00 >> 32) + (p01 & 0xffffffff) + (p10 & 0xffffffff);
+
+	*lo = (mid << 32) | (p00 & 0xffffffff);
+	return p11 + (p01 >> 32) + (p10 >> 32) + (mid >> 32);
+#endif
+}
+
+static inline int
+ss_clz64(ss_u64 x)
+{
+#if defined(__GNUC__)
+	return __builtin_clzll(x);
+#else
+	int n = 0;
+	while(!(x & 0x8000000000000000ULL))
+	{
+		x <<= 1;
+		n++;
+	}
+	return n;
+#endif
+}
+
+/*
+ * Compute the IEEE double bit pattern, less the sign, of the correctly
+ * rounded value of w * 10^q, where w is nonzero.
+ */
+static ss_u64
+ss_eisel_lemire(ss_u64 w, int q)
+{
+	ss_u64 hi, lo, hi2, lo2, mant;
+	int lz, upperbit, shift, power2;
+
+	if(q < SS_POW5_MINQ)
+		return 0;
+	if(q > SS_POW5_MAXQ)
+		return 0x7ffULL << 52;
+
+	lz = ss_clz64(w);
+	w <<= lz;
+
+	/* we need 55 good bits: the 53-bit mantissa, a rounding bit, and
+	 * the bit that tells if the product's top bit is set.  If the bits
+	 * below those in the first product are all ones, a carry from the
+	 * low half of the power of five could still change them. */
+	hi = ss_mul128(w, ss_pow5tab[q - SS_POW5_MINQ][0], &lo);
+	if((hi & 0x1ff) == 0x1ff)
+	{
+		hi2 = ss_mul128(w, ss_pow5tab[q - SS_POW5_MINQ][1], &lo2);
+		lo += hi2;
+		if(hi2 > lo)
+			hi++;
+	}
+
+	upperbit = (int)(hi >> 63);
+	shift = upperbit + 64 - 52 - 3;
+	mant = hi >> shift;
+	/* binary exponent: floor(log2(10^q)) + 63, adjusted and biased */
+	power2 = (((152170 + 65536) * q) >> 16) + 63 + upperbit - lz + 1023;
+
+	if(power2 <= 0)
+	{
+		/* subnormal, or underflow to zero */
+		if(-power2 + 1 >= 64)
+			return 0;
+		mant >>= -power2 + 1;
+		mant += (mant & 1);
+		mant >>= 1;
+		power2 = (mant < (1ULL << 52)) ? 0 : 1;
+		return ((ss_u64) power2 << 52) | (mant & ((1ULL << 52) - 1));
+	}
+
+	/* exactly halfway between two doubles: round to even.  This can
+	 * only happen for small powers of ten, when the product is exact. */
+	if(lo <= 1 && q >= -4 && q <= 23 && (mant & 3) == 1
+	   && (mant << shift) == hi)
+		mant &= ~1ULL;
+
+	mant += (mant & 1);
+	mant >>= 1;
+	if(mant >= (2ULL << 52))
+	{
+		mant = 1ULL << 52;
+		power2++;
+	}
+	mant &= ~(1ULL << 52);
+	if(power2 >= 0x7ff)
+		return 0x7ffULL << 52;
+	return ((ss_u64) power2 << 52) | mant;
+}
+
+/*
+ * Convert the number at the start of the n bytes at s, which need not be
+ * nul-terminated, and return its value.
+ * Leading whitespace, a sign, digits with an optional decimal point, and
+ * an optional exponent are accepted.  If endp is not NULL, *endp is set
+ * to the first character after the number, or to s if there was none;
+ * with no number, the result is 0.
+ * Unlike atof and strtod, the decimal point is always '.', whatever the
+ * locale, and errno is not set on overflow or underflow.
+ */
+double
+ss_strntod(const char *s, size_t n, char **endp)
+{
+	const char *p = s;
+	const char *end = s + n;
+	const char *q;
+	ss_u64 w = 0;
+	ss_u64 bits, bits2;
+	int ndigits = 0;	/* significant digits in w */
+	int dropped = 0;	/* nonzero digits that didn't fit in w */
+	int any = 0;		/* seen any digits at all */
+	long exp10 = 0;
+	long e;
+	int neg = 0;
+	int eneg;
+	double d;
+
+	while(p < end && ss_isspace(*p))
+		p++;
+	if(p < end && (*p == '-' || *p == '+'))
+	{
+		neg = (*p == '-');
+		p++;
+	}
+	if(p == end || (!ss_isdigit(*p) && *p != '.')
+	   || (*p == '0' && p + 1 < end && (p[1] == 'x' || p[1] == 'X')))
+		return ss_strtod_slow(s, end, endp);	/* inf, nan, hex */
+
+	while(p < end && *p == '0')
+	{
+		p++;
+		any = 1;
+	}
+	for(; p < end && ss_isdigit(*p); p++)
+	{
+		if(ndigits < SS_MAXDIGITS)
+		{
+			w = w * 10 + (*p - '0');
+			ndigits++;
+		}
+		else
+		{
+			exp10++;
+			if(*p != '0')
+				dropped = 1;
+		}
+		any = 1;
+	}
+	if(p < end && *p == '.')
+	{
+		p++;
+		if(ndigits == 0)
+		{
+			for(; p < end && *p == '0'; p++)
+			{
+				exp10--;
+				any = 1;
+			}
+		}
+		for(; p < end && ss_isdigit(*p); p++)
+		{
+			if(ndigits < SS_MAXDIGITS)
+			{
+				w = w * 10 + (*p - '0');
+				ndigits++;
+				exp10--;
+			}
+			else if(*p != '0')
+				dropped = 1;
+			any = 1;
+		}
+	}
+	if(!any)
+	{
+		if(endp)
+			*endp = (char *) s;
+		return 0.0;
+	}
+	if(p < end && (*p == 'e' || *p == 'E'))
+	{
+		q = p + 1;
+		eneg = 0;
+		if(q < end && (*q == '-' || *q == '+'))
+		{
+			eneg = (*q == '-');
+			q++;
+		}
+		if(q < end && ss_isdigit(*q))
+		{
+			for(e = 0; q < end && ss_isdigit(*q); q++)
+			{
+				if(e < 100000)
+					e = e * 10 + (*q - '0');
+			}
+			exp10 += eneg ? -e : e;
+			p = q;
+		}
+	}
+	if(endp)
+		*endp = (char *) p;
+
+	if(w == 0)
+		return neg ? -0.0 : 0.0;
+	if(exp10 < -100000)
+		exp10 = -100000;
+	else if(exp10 > 100000)
+		exp10 = 100000;
+
+	if(!dropped)
+		return ss_scale10(w, (int) exp10, neg);
+
+	/* the true value is between w and w+1 times 10^exp10;
+	 * if both round the same way, so does it. */
+	bits = ss_eisel_lemire(w, (int) exp10);
+	bits2 = ss_eisel_lemire(w + 1, (int) exp10);
+	if(bits != bits2)
+		return ss_strtod_slow(s, end, endp);
+	if(neg)
+		bits |= 1ULL << 63;
+	memcpy(&d, &bits, sizeof(d));
+	return d;
+}
+
+/*
+ * Return the correctly rounded value of w * 10^q, negated if neg is set.
+ * For readers that pick the digits out of fixed-format fields themselves.
+ */
+double
+ss_scale10(unsigned long long w, int q, int neg)
+{
+	ss_u64 bits;
+	double d;
+
+	if(w == 0)
+		return neg ? -0.0 : 0.0;
+#if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD == 0
+	if(w <= (1ULL << 53) && q >= -22 && q <= 22)
+	{
+		/* both exact, so one rounding gives the right answer */
+		d = (double) w;
+		if(q < 0)
+			d /= ss_pow10[-q];
+		else
+			d *= ss_pow10[q];
+		return neg ? -d : d;
+	}
+#endif
+	bits = ss_eisel_lemire(w, q);
+	if(neg)
+		bits |= 1ULL << 63;
+	memcpy(&d, &bits, sizeof(d));
+	return d;
+}
+
+/*
+ * Convert the number at the start of the nul-terminated string s,
+ * as ss_strntod does.
+ */
+double
+ss_strtod(const char *s, char **endp)
+{
+	return ss_strntod(s, strlen(s), endp);
+}
+
+/*
+ * Slow path: let strtod do it.  So that the locale's decimal point
+ * doesn't matter, a decimal number is rewritten as an integer with an
+ * exponent.  Anything else is copied so that it is nul-terminated.
+ */
+static double
+ss_strtod_slow(const char *s, const char *end, char **endp)
+{
+	char sbuf[128];
+	char *buf = sbuf;
+	char *bp, *ep;
+	const char *p = s;
+	size_t n = end - s;
+	long exp10 = 0;
+	long e;
+	int eneg;
+	int seen_point = 0;
+	double d;
+
+	while(p < end && ss_isspace(*p))
+		p++;
+	if(p < end && (*p == '-' || *p == '+'))
+		p++;
+	if(p < end && (ss_isdigit(*p) || *p == '.')
+	   && !(*p == '0' && p + 1 < end && (p[1] == 'x' || p[1] == 'X')))
+	{
+		if(n + 32 > sizeof(sbuf))
+			buf = g_new(char, n + 32);
+		bp = buf;
+		if(p > s && p[-1] == '-')
+			*bp++ = '-';
+		for(; p < end && (ss_isdigit(*p) || (*p == '.' && !seen_point)); p++)
+		{
+			if(*p == '.')
+				seen_point = 1;
+			else
+			{
+				*bp++ = *p;
+				if(seen_point)
+					exp10--;
+			}
+		}
+		if(p < end && (*p == 'e' || *p == 'E'))
+		{
+			const char *q = p + 1;
+			eneg = 0;
+			if(q < end && (*q == '-' || *q == '+'))
+			{
+				eneg = (*q == '-');
+				q++;
+			}
+			if(q < end && ss_isdigit(*q))
+			{
+				for(e = 0; q < end && ss_isdigit(*q); q++)
+				{
+					if(e < 100000000)
+						e = e * 10 + (*q - '0');
+				}
+				exp10 += eneg ? -e : e;
+				p = q;
+			}
+		}
+		sprintf(bp, "e%ld", exp10);
+		d = strtod(buf, NULL);
+		ep = (char *) p;
+	}
+	else
+	{
+		/* inf, nan, or hex; none of these are very long */
+		if(n > sizeof(sbuf) - 1)
+			n = sizeof(sbuf) - 1;
+		memcpy(buf, s, n);
+		buf[n] = 0;
+		d = strtod(buf, &bp);
+		ep = (char *) s + (bp - buf);
+	}
+	if(endp)
+		*endp = ep;
+	if(buf != sbuf)
+		g_free(buf);
+	return d;
+}
+
+/*
+ * The other direction: formatting doubles the way printf's "%.*g" does.
+ *
+ * For up to SS_GMAXDIGITS significant digits, v * 10^k is formed from
+ * the same 128-bit powers of five, with k chosen to leave the wanted
+ * number of digits in the integer part.  The error in the power of five
+ * only reaches the low bits of the fraction, so the rounding can be
+ * decided from its top 64 bits unless they are within one unit of a
+ * half.  For 0 <= k <= 55 the power of five is exact, and so are ties.
+ * Near-ties for other k, subnormals, and anything with more digits are
+ * left to snprintf, which rounds the exact binary value, half to even.
+ */
+
+#define SS_GMAXDIGITS 17
+
+static const ss_u64 ss_upow10[] =
+{
+	1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL,
+	10000000ULL, 100000000ULL, 1000000000ULL, 10000000000ULL,
+	100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+	100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+	100000000000000000ULL, 1000000000000000000ULL
+};
+
+static const char ss_digit_pairs[] =
+	"00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+	"40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
+
+/*
+ * Find the ndigits-digit decimal integer *np, and exponent *xp, such that
+ * *np * 10^(*xp - ndigits + 1) is v correctly rounded to ndigits
+ * significant digits.  v must be positive, and 1 <= ndigits <= 17.
+ * Returns 0 if the caller has to get the digits some other way.
+ */
+static int
+ss_gdigits(double v, int ndigits, ss_u64 *np, int *xp)
+{
+	ss_u64 bits, m, hi, mid, lo, mid2, f, n;
+	int e, x, k, s, tries;
+
+	memcpy(&bits, &v, sizeof(bits));
+	e = (int) (bits >> 52) & 0x7ff;
+	if(e == 0 || e == 0x7ff)
+		return 0;	/* subnormal, inf or nan */
+	m = ((bits & ((1ULL << 52) - 1)) | (1ULL << 52)) << 11;
+	e -= 1075;	/* v = (m >> 11) * 2^e */
+
+	/* floor(log10(v)), or one less */
+	x = ((e + 52) * 78913) >> 18;
+	for(tries = 0; tries < 2; tries++)
+	{
+		k = ndigits - 1 - x;
+		if(k < SS_POW5_MINQ || k > SS_POW5_MAXQ)
+			return 0;
+
+		/* the 192-bit product hi:mid:lo of m and the power of five
+		 * is v * 10^k * 2^s */
+		hi = ss_mul128(m, ss_pow5tab[k - SS_POW5_MINQ][0], &mid);
+		mid2 = ss_mul128(m, ss_pow5tab[k - SS_POW5_MINQ][1], &lo);
+		mid += mid2;
+		if(mid < mid2)
+			hi++;
+		s = 138 - e - (((152170 + 65536) * k) >> 16);
+		if(s < 128 + 4 || s >= 192)
+			return 0;
+		s -= 128;
+		n = hi >> s;
+		if(n >= ss_upow10[ndigits])
+		{
+			x++;	/* log10 estimate was one low */
+			continue;
+		}
+		f = (hi << (64 - s)) | (mid >> s);
+		if(k >= 0 && k <= 55)
+		{
+			/* the power of five is exact, and so is the
+			 * product: break ties to even, as printf does */
+			if(f > (1ULL << 63) || (f == (1ULL << 63)
+			   && ((mid << (64 - s)) != 0 || lo != 0 || (n & 1))))
+				n++;
+		}
+		else if(f > (1ULL << 63) + 1)
+			n++;
+		else if(f >= (1ULL << 63) - 1)
+			return 0;	/* too close to call */
+		if(n == ss_upow10[ndigits])
+		{
+			n = ss_upow10[ndigits - 1];
+			x++;
+		}
+		*np = n;
+		*xp = x;
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * Lay out the nd-digit integer n with decimal exponent x as "%.*g" does
+ * with nd digits of precision, at buf.  Returns the length.
+ */
+static int
+ss_glayout(char *buf, int neg, ss_u64 n, int nd, int x)
+{
+	char d[SS_GMAXDIGITS + 1];
+	char *p = buf;
+	int i, nz;
+
+	for(i = nd; i >= 2; i -= 2)
+	{
+		memcpy(&d[i - 2], &ss_digit_pairs[2 * (n % 100)], 2);
+		n /= 100;
+	}
+	if(i == 1)
+		d[0] = (char) ('0' + n);
+
+	/* trailing zeros are dropped, as without the '#' flag */
+	for(nz = nd; nz > 1 && d[nz - 1] == '0'; nz--)
+		;
+
+	if(neg)
+		*p++ = '-';
+	if(x < -4 || x >= nd)
+	{
+		*p++ = d[0];
+		if(nz > 1)
+		{
+			*p++ = '.';
+			memcpy(p, &d[1], nz - 1);
+			p += nz - 1;
+		}
+		*p++ = 'e';
+		if(x < 0)
+		{
+			*p++ = '-';
+			x = -x;
+		}
+		else
+			*p++ = '+';
+		if(x >= 100)
+		{
+			*p++ = (char) ('0' + x / 100);
+			x %= 100;
+		}
+		memcpy(p, &ss_digit_pairs[2 * x], 2);
+		p += 2;
+	}
+	else if(x >= 0)
+	{
+		memcpy(p, d, x + 1);
+		p += x + 1;
+		if(nz > x + 1)
+		{
+			*p++ = '.';
+			memcpy(p, &d[x + 1], nz - x - 1);
+			p += nz - x - 1;
+		}
+	}
+	else
+	{
+		*p++ = '0';
+		*p++ = '.';
+		for(i = -1; i > x; i--)
+			*p++ = '0';
+		memcpy(p, d, nz);
+		p += nz;
+	}
+	*p = 0;
+	return (int) (p - buf);
+}
+
+/*
+ * Format v into buf with ndigits significant digits, byte for byte as
+ * printf("%.*g", ndigits, v) would in the C locale, and return the length.
+ * If ndigits is 0, use the fewest digits that ss_strtod will convert back
+ * to exactly v.  buf must have room for ndigits + 32 bytes.
+ */
+int
+ss_fmtg(char *buf, double v, int ndigits)
+{
+	ss_u64 n;
+	int neg, x, nd;
+	double a;
+
+	neg = signbit(v) != 0;
+	if(v == 0)
+	{
+		if(neg)
+		{
+			memcpy(buf, "-0", 3);
+			return 2;
+		}
+		memcpy(buf, "0", 2);
+		return 1;
+	}
+	a = neg ? -v : v;
+
+	if(ndigits == 0)
+	{
+		/* 17 digits always read back exactly.  Fewer digits are
+		 * found by bisection, on the grounds that if nd digits
+		 * read back, so do nd+1. */
+		if(ss_gdigits(a, SS_GMAXDIGITS, &n, &x))
+		{
+			ss_u64 n2;
+			int x2, lo = 0, hi = SS_GMAXDIGITS;
+
+			while(hi - lo > 1)
+			{
+				nd = (lo + hi) / 2;
+				if(!ss_gdigits(a, nd, &n2, &x2))
+					break;
+				if(ss_scale10(n2, x2 - nd + 1, 0) == a)
+				{
+					hi = nd;
+					n = n2;
+					x = x2;
+				}
+				else
+					lo = nd;
+			}
+			if(hi - lo == 1)
+				return ss_glayout(buf, neg, n, hi, x);
+		}
+		/* the hard way */
+		for(nd = 1; nd < SS_GMAXDIGITS; nd++)
+		{
+			snprintf(buf, 32, "%.*g", nd, v);
+			if(ss_strtod(buf, NULL) == v)
+				return (int) strlen(buf);
+		}
+		return snprintf(buf, 32, "%.*g", SS_GMAXDIGITS, v);
+	}
+
+	if(ndigits < 0)
+		ndigits = 6;
+	if(ndigits <= SS_GMAXDIGITS && ss_gdigits(a, ndigits, &n, &x))
+		return ss_glayout(buf, neg, n, ndigits, x);
+	return snprintf(buf, ndigits + 32, "%.*g", ndigits, v);
+}
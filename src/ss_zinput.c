@@ -0,0 +1,628 @@
+/*
+ * ss_zinput.c: reading of compressed waveform files.
+ *
+ * A file compressed with gzip or zstd is recognized by its magic bytes
+ * when it is opened, and decompressed on a thread of its own into a
+ * small ring of buffers.  The readers get the decompressed data through
+ * an ordinary FILE*, made with fopencookie, so none of them need know.
+ * Such a stream can't be mapped into memory, and seeking in it is slow:
+ * forward seeks decompress and drop the data in between, and backward
+ * seeks start again from the beginning of the file, except within the
+ * first SSZ_HEAD bytes, which are kept so that the header readers can
+ * go back over them cheaply.
+ *
+ * gzip support needs zlib and HAVE_ZLIB, and zstd support needs libzstd
+ * and HAVE_ZSTD, defined at build time.  Without them, a compressed file
+ * is still recognized, so that a useful message can be printed.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#define _GNU_SOURCE 1
+#include "ssintern.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "glib.h"
+#include "spicestream.h"
+
+#if defined(_POSIX_THREADS) && _POSIX_THREADS > 0 \
+	&& (defined(HAVE_ZLIB) || defined(HAVE_ZSTD))
+#include <pthread.h>
+#define SSZ_THREADS 1
+#endif
+
+#ifdef SSZ_THREADS
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#endif
+
+#define SSZ_NONE 0
+#define SSZ_GZIP 1
+#define SSZ_ZSTD 2
+
+static char *ssz_names[] = { "uncompressed", "gzip", "zstd" };
+
+/*
+ * Return the kind of compression that the first n bytes of a file show.
+ */
+static int
+ssz_kind(const unsigned char *buf, size_t n)
+{
+	if(n >= 2 && buf[0] == 0x1f && buf[1] == 0x8b)
+		return SSZ_GZIP;
+	if(n >= 4 && buf[0] == 0x28 && buf[1] == 0xb5 && buf[2] == 0x2f
+	   && buf[3] == 0xfd)
+		return SSZ_ZSTD;
+	return SSZ_NONE;
+}
+
+#ifdef SSZ_THREADS
+
+#define SSZ_NBUFS 4	/* buffers in the ring */
+#define SSZ_BUFSIZE (256*1024)	/* decompressed bytes per buffer */
+#define SSZ_INSIZE (64*1024)	/* compressed bytes read at a time */
+#define SSZ_HEAD (64*1024)	/* bytes at the start kept for seeking back */
+
+typedef struct {
+	FILE *src;	/* the compressed file */
+	char *filename;
+	int kind;
+
+	/* decompressor state, used only by the thread */
+	unsigned char *inbuf;
+	int done;	/* no more output to come */
+#ifdef HAVE_ZLIB
+	z_stream zs;
+	int zs_init;
+	int zs_member_end;	/* at the end of a gzip member */
+#endif
+#ifdef HAVE_ZSTD
+	ZSTD_DStream *zd;
+	ZSTD_inBuffer zin;
+	size_t zd_ret;	/* 0 at the end of a frame */
+#endif
+
+	/* the ring; slots from rd to wr are full */
+	pthread_t thread;
+	int running;
+	pthread_mutex_t lock;
+	pthread_cond_t filled;	/* a buffer was filled, or the thread ended */
+	pthread_cond_t emptied;	/* a buffer was freed, or it is time to quit */
+	char *bufs[SSZ_NBUFS];
+	size_t lens[SSZ_NBUFS];
+	int rd, wr, nfull;
+	int eof;	/* set by the thread when it ends: 1, or -1 on error */
+	int quit;
+
+	/* reading side */
+	size_t curpos;	/* bytes of bufs[rd] handed out so far */
+	off64_t spos;	/* offset of the next byte to come from the ring */
+	off64_t rpos;	/* offset of the next byte to hand out; less than
+			 * spos only after a seek back into head */
+	char *head;	/* copy of the first SSZ_HEAD bytes */
+	size_t headlen;
+} SSZInput;
+
+/*
+ * Set up the decompressor for the start of the file.
+ * Returns 0 on success, -1 on failure.
+ */
+static int
+ssz_decode_init(SSZInput *z)
+{
+	z->done = 0;
+	switch(z->kind)
+	{
+#ifdef HAVE_ZLIB
+	case SSZ_GZIP:
+		if(z->zs_init)
+			inflateEnd(&z->zs);
+		memset(&z->zs, 0, sizeof(z->zs));
+		if(inflateInit2(&z->zs, 15 + 16) != Z_OK)
+			return -1;
+		z->zs_init = 1;
+		z->zs_member_end = 0;
+		return 0;
+#endif
+#ifdef HAVE_ZSTD
+	case SSZ_ZSTD:
+		if(z->zd == NULL && (z->zd = ZSTD_createDStream()) == NULL)
+			return -1;
+		if(ZSTD_isError(ZSTD_initDStream(z->zd)))
+			return -1;
+		z->zin.src = z->inbuf;
+		z->zin.size = 0;
+		z->zin.pos = 0;
+		z->zd_ret = 0;
+		return 0;
+#endif
+	}
+	return -1;
+}
+
+static void
+ssz_decode_free(SSZInput *z)
+{
+#ifdef HAVE_ZLIB
+	if(z->zs_init)
+		inflateEnd(&z->zs);
+	z->zs_init = 0;
+#endif
+#ifdef HAVE_ZSTD
+	if(z->zd)
+		ZSTD_freeDStream(z->zd);
+	z->zd = NULL;
+#endif
+}
+
+#ifdef HAVE_ZLIB
+/*
+ * Decompress up to n bytes of gzip data into out.  Files made of
+ * several gzip members, as by cat, are read through to the end;
+ * anything after the last member that isn't another one is ignored.
+ * Returns the number of bytes, 0 at the end, or -1 on error.
+ */
+static int
+ssz_gzip_fill(SSZInput *z, char *out, size_t n)
+{
+	size_t k;
+	int rc;
+
+	z->zs.next_out = (unsigned char *) out;
+	z->zs.avail_out = n;
+	while(z->zs.avail_out > 0 && !z->done)
+	{
+		if(z->zs.avail_in == 0)
+		{
+			k = fread(z->inbuf, 1, SSZ_INSIZE, z->src);
+			if(k == 0)
+			{
+				if(ferror(z->src))
+				{
+					ss_msg(ERR, "ss_zinput", "%s: %s", z->filename, strerror(errno));
+					return -1;
+				}
+				if(!z->zs_member_end)
+					ss_msg(ERR, "ss_zinput", "%s: unexpected end of gzip data", z->filename);
+				z->done = 1;
+				break;
+			}
+			z->zs.next_in = z->inbuf;
+			z->zs.avail_in = k;
+		}
+		if(z->zs_member_end)
+		{
+			if(z->zs.next_in[0] != 0x1f)
+			{
+				z->done = 1;
+				break;
+			}
+			inflateReset(&z->zs);
+			z->zs_member_end = 0;
+		}
+		rc = inflate(&z->zs, Z_NO_FLUSH);
+		if(rc == Z_STREAM_END)
+			z->zs_member_end = 1;
+		else if(rc != Z_OK && rc != Z_BUF_ERROR)
+		{
+			ss_msg(ERR, "ss_zinput", "%s: bad gzip data: %s", z->filename,
+			       z->zs.msg ? z->zs.msg : "error");
+			return -1;
+		}
+	}
+	return n - z->zs.avail_out;
+}
+#endif
+
+#ifdef HAVE_ZSTD
+/*
+ * Decompress up to n bytes of zstd data into out, going on through
+ * any number of frames.
+ * Returns the number of bytes, 0 at the end, or -1 on error.
+ */
+static int
+ssz_zstd_fill(SSZInput *z, char *out, size_t n)
+{
+	ZSTD_outBuffer zout;
+	size_t k;
+
+	zout.dst = out;
+	zout.size = n;
+	zout.pos = 0;
+	while(zout.pos < n && !z->done)
+	{
+		if(z->zin.pos >= z->zin.size)
+		{
+			k = fread(z->inbuf, 1, SSZ_INSIZE, z->src);
+			if(k == 0)
+			{
+				if(ferror(z->src))
+				{
+					ss_msg(ERR, "ss_zinput", "%s: %s", z->filename, strerror(errno));
+					return -1;
+				}
+				if(z->zd_ret != 0)
+					ss_msg(ERR, "ss_zinput", "%s: unexpected end of zstd data", z->filename);
+				z->done = 1;
+				break;
+			}
+			z->zin.size = k;
+			z->zin.pos = 0;
+		}
+		z->zd_ret = ZSTD_decompressStream(z->zd, &zout, &z->zin);
+		if(ZSTD_isError(z->zd_ret))
+		{
+			ss_msg(ERR, "ss_zinput", "%s: bad zstd data: %s", z->filename,
+			       ZSTD_getErrorName(z->zd_ret));
+			return -1;
+		}
+	}
+	return zout.pos;
+}
+#endif
+
+static int
+ssz_decode(SSZInput *z, char *out, size_t n)
+{
+	switch(z->kind)
+	{
+#ifdef HAVE_ZLIB
+	case SSZ_GZIP:
+		return ssz_gzip_fill(z, out, n);
+#endif
+#ifdef HAVE_ZSTD
+	case SSZ_ZSTD:
+		return ssz_zstd_fill(z, out, n);
+#endif
+	}
+	return -1;
+}
+
+/*
+ * The decompression thread: fill free buffers in the ring until the
+ * data runs out or it is told to quit.
+ */
+static void *
+ssz_thread(void *arg)
+{
+	SSZInput *z = arg;
+	int w, n;
+
+	for(;;)
+	{
+		pthread_mutex_lock(&z->lock);
+		while(z->nfull == SSZ_NBUFS && !z->quit)
+			pthread_cond_wait(&z->emptied, &z->lock);
+		if(z->quit)
+		{
+			pthread_mutex_unlock(&z->lock);
+			return NULL;
+		}
+		w = z->wr;
+		pthread_mutex_unlock(&z->lock);
+
+		n = ssz_decode(z, z->bufs[w], SSZ_BUFSIZE);
+
+		pthread_mutex_lock(&z->lock);
+		if(n > 0)
+		{
+			z->lens[w] = n;
+			z->wr = (w + 1) % SSZ_NBUFS;
+			z->nfull++;
+		}
+		else
+			z->eof = (n < 0) ? -1 : 1;
+		pthread_cond_signal(&z->filled);
+		pthread_mutex_unlock(&z->lock);
+		if(n <= 0)
+			return NULL;
+	}
+}
+
+static void
+ssz_stop(SSZInput *z)
+{
+	if(!z->running)
+		return;
+	pthread_mutex_lock(&z->lock);
+	z->quit = 1;
+	pthread_cond_signal(&z->emptied);
+	pthread_mutex_unlock(&z->lock);
+	pthread_join(z->thread, NULL);
+	z->running = 0;
+}
+
+/*
+ * Start decompressing from the beginning of the file.
+ * Returns 0 on success, -1 on failure.
+ */
+static int
+ssz_start(SSZInput *z)
+{
+	ssz_stop(z);
+	if(fseeko64(z->src, 0, SEEK_SET) < 0)
+	{
+		ss_msg(ERR, "ss_zinput", "%s: can't go back to the start: %s", z->filename, strerror(errno));
+		return -1;
+	}
+	if(ssz_decode_init(z) < 0)
+	{
+		ss_msg(ERR, "ss_zinput", "%s: can't set up %s decompression", z->filename, ssz_names[z->kind]);
+		return -1;
+	}
+	z->rd = z->wr = z->nfull = 0;
+	z->eof = 0;
+	z->quit = 0;
+	z->curpos = 0;
+	z->spos = 0;
+	z->rpos = 0;
+	if(pthread_create(&z->thread, NULL, ssz_thread, z) != 0)
+	{
+		ss_msg(ERR, "ss_zinput", "%s: can't start decompression thread", z->filename);
+		return -1;
+	}
+	z->running = 1;
+	return 0;
+}
+
+/*
+ * Take up to n bytes from the ring into buf, or just drop them if buf
+ * is NULL.  Returns the number of bytes, 0 at the end, or -1 on error.
+ */
+static ssize_t
+ssz_take(SSZInput *z, char *buf, size_t n)
+{
+	size_t k, total;
+	char *p;
+
+	total = 0;
+	while(total < n)
+	{
+		pthread_mutex_lock(&z->lock);
+		while(z->nfull == 0 && z->eof == 0)
+			pthread_cond_wait(&z->filled, &z->lock);
+		if(z->nfull == 0)
+		{
+			pthread_mutex_unlock(&z->lock);
+			if(z->eof < 0 && total == 0)
+				return -1;
+			break;
+		}
+		pthread_mutex_unlock(&z->lock);
+
+		p = z->bufs[z->rd] + z->curpos;
+		k = z->lens[z->rd] - z->curpos;
+		if(k > n - total)
+			k = n - total;
+		if(buf)
+			memcpy(buf + total, p, k);
+		if(z->spos < SSZ_HEAD)
+		{
+			size_t h = k;
+			if(z->spos + h > SSZ_HEAD)
+				h = SSZ_HEAD - z->spos;
+			memcpy(z->head + z->spos, p, h);
+			z->headlen = z->spos + h;
+		}
+		z->curpos += k;
+		z->spos += k;
+		total += k;
+		if(z->curpos == z->lens[z->rd])
+		{
+			pthread_mutex_lock(&z->lock);
+			z->rd = (z->rd + 1) % SSZ_NBUFS;
+			z->nfull--;
+			z->curpos = 0;
+			pthread_cond_signal(&z->emptied);
+			pthread_mutex_unlock(&z->lock);
+		}
+	}
+	return total;
+}
+
+/*
+ * fopencookie read function.
+ */
+static ssize_t
+ssz_read(void *cookie, char *buf, size_t n)
+{
+	SSZInput *z = cookie;
+	size_t k;
+	ssize_t rc;
+
+	k = 0;
+	if(z->rpos < z->spos)
+	{
+		/* going over the start again, after a seek back */
+		k = z->spos - z->rpos;
+		if(k > n)
+			k = n;
+		memcpy(buf, z->head + z->rpos, k);
+		z->rpos += k;
+		if(k == n)
+			return k;
+	}
+	rc = ssz_take(z, buf + k, n - k);
+	if(rc < 0)
+		return k ? (ssize_t) k : -1;
+	z->rpos += rc;
+	return k + rc;
+}
+
+/*
+ * fopencookie seek function.
+ */
+static int
+ssz_seek(void *cookie, off64_t *offset, int whence)
+{
+	SSZInput *z = cookie;
+	off64_t target;
+	ssize_t rc;
+
+	switch(whence)
+	{
+	case SEEK_SET:
+		target = *offset;
+		break;
+	case SEEK_CUR:
+		target = z->rpos + *offset;
+		break;
+	default:
+		errno = EINVAL;
+		return -1;	/* the length isn't known */
+	}
+	if(target < 0)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	if(target < z->spos && z->spos > (off64_t) z->headlen)
+	{
+		/* not all kept; go back to the beginning */
+		if(ssz_start(z) < 0)
+		{
+			errno = EIO;
+			return -1;
+		}
+	}
+	if(target <= z->spos)
+		z->rpos = target;
+	else
+	{
+		z->rpos = z->spos;
+		while(z->spos < target)
+		{
+			rc = ssz_take(z, NULL, target - z->spos);
+			if(rc <= 0)
+			{
+				errno = EINVAL;
+				return -1;	/* past the end */
+			}
+		}
+		z->rpos = z->spos;
+	}
+	*offset = z->rpos;
+	return 0;
+}
+
+/*
+ * fopencookie close function.
+ */
+static int
+ssz_close(void *cookie)
+{
+	SSZInput *z = cookie;
+	int i;
+
+	ssz_stop(z);
+	ssz_decode_free(z);
+	pthread_mutex_destroy(&z->lock);
+	pthread_cond_destroy(&z->filled);
+	pthread_cond_destroy(&z->emptied);
+	for(i = 0; i < SSZ_NBUFS; i++)
+		g_free(z->bufs[i]);
+	g_free(z->head);
+	g_free(z->inbuf);
+	g_free(z->filename);
+	fclose(z->src);
+	g_free(z);
+	return 0;
+}
+
+/*
+ * Make a FILE* that reads the decompressed data of src.
+ * Returns NULL on failure, with src closed.
+ */
+static FILE *
+ssz_open(FILE *src, char *filename, int kind)
+{
+	static cookie_io_functions_t iofuncs = {
+		ssz_read, NULL, ssz_seek, ssz_close
+	};
+	SSZInput *z;
+	FILE *fp;
+	int i;
+
+	z = g_new0(SSZInput, 1);
+	z->src = src;
+	z->filename = g_strdup(filename);
+	z->kind = kind;
+	z->inbuf = g_new(unsigned char, SSZ_INSIZE);
+	z->head = g_new(char, SSZ_HEAD);
+	for(i = 0; i < SSZ_NBUFS; i++)
+		z->bufs[i] = g_new(char, SSZ_BUFSIZE);
+	pthread_mutex_init(&z->lock, NULL);
+	pthread_cond_init(&z->filled, NULL);
+	pthread_cond_init(&z->emptied, NULL);
+
+	if(ssz_start(z) < 0 || (fp = fopencookie(z, "r", iofuncs)) == NULL)
+	{
+		ssz_close(z);
+		return NULL;
+	}
+	return fp;
+}
+
+#endif /* SSZ_THREADS */
+
+/*
+ * Given a newly-opened file, check whether it is compressed.  If so,
+ * return a FILE* that reads the decompressed data, which takes
+ * over fp; otherwise return fp as it was.
+ * Returns NULL, with fp closed, if the file is compressed in a way that
+ * this build can't read.
+ */
+FILE *
+ss_zopen(FILE *fp, char *filename)
+{
+	unsigned char magic[4];
+	off64_t pos;
+	size_t n;
+	int kind;
+
+	if((pos = ftello64(fp)) < 0)
+		return fp;
+	n = fread(magic, 1, sizeof(magic), fp);
+	if(fseeko64(fp, pos, SEEK_SET) < 0)
+		return fp;
+	kind = ssz_kind(magic, n);
+	if(kind == SSZ_NONE)
+		return fp;
+
+	ss_msg(DBG, "ss_zopen", "%s: %s compressed", filename, ssz_names[kind]);
+	switch(kind)
+	{
+#if defined(SSZ_THREADS) && defined(HAVE_ZLIB)
+	case SSZ_GZIP:
+		return ssz_open(fp, filename, kind);
+#endif
+#if defined(SSZ_THREADS) && defined(HAVE_ZSTD)
+	case SSZ_ZSTD:
+		return ssz_open(fp, filename, kind);
+#endif
+	default:
+		ss_msg(ERR, "ss_zopen", "%s: %s compressed files aren't supported by this build", filename, ssz_names[kind]);
+		fclose(fp);
+		return NULL;
+	}
+}
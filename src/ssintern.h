@@ -40,3 +40,43 @@
 /* wish there was a way to portably printf either a 64-bit or 32-bit off_t
  * without cluttering the rest of the source with #ifdefs.
  */
+
+/*
+ * Input helpers for the readers, in spicestream.c.
+ * ss_getbytes returns a pointer to the next n bytes of input and advances
+ * past them, or NULL at EOF.  When the file is memory-mapped, the pointer
+ * is into the mapping and nothing is copied; otherwise the bytes are read
+ * into a buffer that is reused by the next call.  The pointer need not
+ * be aligned.
+ * ss_skipbytes advances past n bytes without reading them, if it can;
+ * it returns 0 if it finds that there were fewer than n bytes left,
+ * but when seeking in an unmapped file, EOF shows up on the next read.
+ * ss_readline returns the next line without its newline, and its length;
+ * when mapped the line is left in place and isn't nul-terminated.
+ */
+struct _SpiceStream;
+extern void *ss_readbytes(struct _SpiceStream *sf, size_t n);
+extern void *ss_getbytes_avail(struct _SpiceStream *sf, size_t *np);
+extern int ss_skipbytes(struct _SpiceStream *sf, size_t n);
+extern off64_t ss_inpos(struct _SpiceStream *sf);
+extern off64_t ss_input_size(struct _SpiceStream *sf);
+extern void ss_map_input(struct _SpiceStream *sf);
+extern void ss_unmap_input(struct _SpiceStream *sf);
+extern char *ss_readline(struct _SpiceStream *sf, int *lenp);
+
+/*
+ * ss_setpos moves the input to a file offset, for the seekpos functions.
+ * ss_tellpos_bytes and ss_seekpos_bytes serve as tellpos and seekpos
+ * for readers that use only ss_getbytes and ss_skipbytes.
+ */
+struct _SSCheckpoint;
+extern int ss_setpos(struct _SpiceStream *sf, off64_t pos);
+extern int ss_tellpos_bytes(struct _SpiceStream *sf, struct _SSCheckpoint *cp);
+extern int ss_seekpos_bytes(struct _SpiceStream *sf, struct _SSCheckpoint *cp);
+
+/* in ss_strtod.c: correctly rounded w * 10^q, for fixed-format fields */
+extern double ss_scale10(unsigned long long w, int q, int neg);
+
+#define ss_getbytes(sf, n) \
+	(((sf)->mapbase && (size_t)((sf)->mapend - (sf)->mapp) >= (n)) \
+	 ? (void *)(((sf)->mapp += (n)) - (n)) : ss_readbytes((sf), (n)))
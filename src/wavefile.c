@@ -19,11 +19,15 @@
  *
  */
 
+#define _GNU_SOURCE 1	/* for mremap */
 #include "ssintern.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
+#include <float.h>
+#include <limits.h>
+#include <sys/mman.h>
 // #include <config.h>
 #include "glib.h"
 #include "wavefile.h"
@@ -59,12 +63,32 @@ regexp_compile(char *str)
 #define regexp_compile(s) regcomp(s)
 #endif
 
-WaveFile *wf_finish_read(SpiceStream *ss);
-WvTable *wf_read_table(SpiceStream *ss, WaveFile *wf, int *statep, double *ivalp, double *dvals);
-void wf_init_dataset(WDataSet *ds);
+/* a block of rows read from the SpiceStream but not yet stored,
+ * and which of them to store */
+typedef struct
+{
+	int maxrows;
+	int nrows;	/* number of rows in the buffers */
+	int pos;	/* index of first row not yet stored */
+	double *ivals;
+	double **cols;
+	double begin_val;	/* rows outside of begin_val to end_val */
+	double end_val;		/* are left out */
+	SSIndex *index;	/* for skipping those rows, or NULL */
+	int table;	/* number of the SpiceStream's table being read */
+} WfRowBlock;
+
+WaveFile *wf_finish_read(SpiceStream *ss, double begin_val, double end_val,
+                         int opts);
+WvTable *wf_read_table(SpiceStream *ss, WaveFile *wf, int *statep, WfRowBlock *blk);
+static WaveFile *wf_finish_read_spc(SpiceStream *ss, double begin_val,
+                                    double end_val, int store);
+static void wf_add_table(WaveFile *wf, WvTable *wt);
+void wf_init_dataset(WDataSet *ds, int store);
 inline void wf_set_point(WDataSet *ds, int n, double val);
 void wf_free_dataset(WDataSet *ds);
-WvTable *wvtable_new(WaveFile *wf);
+WvTable *wvtable_new(WaveFile *wf, int nrows);
+static void wt_trim(WvTable *wt);
 void wt_free(WvTable *wt);
 
 typedef struct
@@ -86,6 +110,7 @@ static DFormat format_tab[] =
 	{"cazm", "\\.[BNW]$" },
 	{"spice3raw", "\\.raw$" },
 	{"spice2raw", "\\.rawspice$" },
+	{"spc", "\\.spc$" },
 	{"nsout", "\\.out$" },
 	{"ascii", "\\.(asc|acs|ascii)$" }, /* ascii / ACS format */
 };
@@ -94,31 +119,83 @@ static const int NFormats = sizeof(format_tab)/sizeof(DFormat);
 /*
  * Read a waveform data file.
  *  If the format name is non-NULL, only tries reading in specified format.
- *  If format not specified, tries to guess based on filename, and if
- *  that fails, tries all of the readers until one sucedes.
+ *  If format not specified, tries to guess from the contents of the
+ *  file, then based on filename, and if that fails, tries all of the
+ *  readers until one sucedes.
  *  Returns NULL on failure after printing an error message.
  *
  * TODO: use some kind of callback or exception so that client
  * can put the error messages in a GUI or somthing.
  */
 WaveFile *wf_read(char *name, char *format)
+{
+	return wf_read_range(name, format, -DBL_MAX, DBL_MAX);
+}
+
+/*
+ * Read the part of a waveform data file with independent-variable values
+ * from begin_val to end_val, in each table.  If that isn't all of it,
+ * formats with fixed-size rows go straight to the rows wanted with
+ * ss_seek_ival; others are read from the start, unless wf_read_opts is
+ * asked to use a seek index.  Otherwise the same as wf_read.  Like
+ * wf_read, keeps the values as doubles, so that wds_data gets at them.
+ */
+WaveFile *wf_read_range(char *name, char *format, double begin_val, double end_val)
+{
+	return wf_read_opts(name, format, begin_val, end_val, WF_STORE_F64);
+}
+
+/*
+ * The same as wf_read_range, with options: WF_STORE_F64 or WF_STORE_F32
+ * to keep the values as doubles or as floats.  With neither, the format
+ * of the file chooses: files that hold single-precision values, such as
+ * HSPICE binary files, are kept as floats, which wds_data_f32 gets at
+ * and wds_data doesn't.  WF_USE_INDEX finds the start of a range in
+ * files without fixed-size rows through a seek index kept next to the
+ * file (see ss_index_open).  Building the index takes a pass over the
+ * whole file the first time, and writes file.ssidx, so it only pays
+ * for files that are read a piece at a time, again and again.
+ */
+WaveFile *wf_read_opts(char *name, char *format, double begin_val,
+                       double end_val, int opts)
 {
 	FILE *fp;
+	SSPipe *ssp;
 	SpiceStream *ss;
 	int i;
 
 	unsigned int tried = 0; /* bitmask of formats. */
 
 	g_assert(NFormats <= 8*sizeof(tried));
-	fp = fopen64(name, "r");
+	if(strcmp(name, "-") == 0)
+		fp = stdin;
+	else
+		fp = fopen64(name, "r");
 	if(fp == NULL)
 	{
 		perror(name);
 		return NULL;
 	}
+	if((fp = ss_pipeopen(fp, name, &ssp)) == NULL)
+		return NULL;
+	if((fp = ss_zopen(fp, name)) == NULL)
+		return NULL;
 
 	if(format == NULL)
 	{
+		/* usually the contents give the format away */
+		ss = ss_open_internal(fp, name, "auto");
+		if(ss)
+		{
+			ss_msg(INFO, "wf_read", "%s: read with format \"%s\"", name, ss_filetype_name(ss->filetype));
+			ss_pipe_headerdone(ssp);
+			return wf_finish_read(ss, begin_val, end_val, opts);
+		}
+		if(fseek(fp, 0L, SEEK_SET) < 0)
+		{
+			perror(name);
+			return NULL;
+		}
 		for(i = 0; i < NFormats; i++)
 		{
 			if(!format_tab[i].creg)
@@ -132,7 +209,8 @@ WaveFile *wf_read(char *name, char *format)
 				if(ss)
 				{
 					ss_msg(INFO, "wf_read", "%s: read with format \"%s\"", name, format_tab[i].name);
-					return wf_finish_read(ss);
+					ss_pipe_headerdone(ssp);
+					return wf_finish_read(ss, begin_val, end_val, opts);
 				}
 
 				if(fseek(fp, 0L, SEEK_SET) < 0)
@@ -154,7 +232,10 @@ WaveFile *wf_read(char *name, char *format)
 			{
 				ss = ss_open_internal(fp, name, format_tab[i].name);
 				if(ss)
-					return wf_finish_read(ss);
+				{
+					ss_pipe_headerdone(ssp);
+					return wf_finish_read(ss, begin_val, end_val, opts);
+				}
 				tried |= 1<<i;
 				if(fseek(fp, 0L, SEEK_SET) < 0)
 				{
@@ -170,45 +251,71 @@ WaveFile *wf_read(char *name, char *format)
 	{
 		ss = ss_open_internal(fp, name, format);
 		if(ss)
-			return wf_finish_read(ss);
+		{
+			ss_pipe_headerdone(ssp);
+			return wf_finish_read(ss, begin_val, end_val, opts);
+		}
 		else
 			return NULL;
 	}
 }
 
 /*
- * read all of the data from a SpiceStream and store it in the WaveFile
- * structure.
+ * read the data from a SpiceStream, from begin_val to end_val, and store
+ * it in the WaveFile structure, as floats or doubles as opts says.
  */
-WaveFile *wf_finish_read(SpiceStream *ss)
+WaveFile *wf_finish_read(SpiceStream *ss, double begin_val, double end_val,
+                         int opts)
 {
 	WaveFile *wf;
-	double ival;
-	double *dvals;
+	WfRowBlock blk;
 	WvTable *wt;
+	int store;
 	int state;
-	double *spar = NULL;
+	int i;
+
+	if(opts & WF_STORE_F32)
+		store = WF_STORE_F32;
+	else if(opts & WF_STORE_F64)
+		store = WF_STORE_F64;
+	else
+		store = (ss->flags & SSF_SINGLE) ? WF_STORE_F32 : WF_STORE_F64;
+
+	if(strcmp(ss_filetype_name(ss->filetype), "spc") == 0
+	   && (wf = wf_finish_read_spc(ss, begin_val, end_val, store)) != NULL)
+		return wf;
 
 	wf = g_new0(WaveFile, 1);
 	wf->ss = ss;
 	wf->tables = g_ptr_array_new();
-	dvals = g_new(double, ss->ncols);
+	wf->store = store;
+
+	/* read about a megabyte of data at a time */
+	blk.maxrows = (1 << 20) / (sizeof(double) * ss->ncols);
+	if(blk.maxrows < 1)
+		blk.maxrows = 1;
+	blk.nrows = 0;
+	blk.pos = 0;
+	blk.ivals = g_new(double, blk.maxrows);
+	blk.cols = g_new(double *, ss->ncols);
+	for(i = 0; i < ss->ncols-1; i++)
+		blk.cols[i] = g_new(double, blk.maxrows);
+	blk.begin_val = begin_val;
+	blk.end_val = end_val;
+	blk.index = NULL;
+	blk.table = 0;
+	if((begin_val > -DBL_MAX || end_val < DBL_MAX)
+	   && ss_seek_ival(ss, begin_val) < 0 && (opts & WF_USE_INDEX))
+		blk.index = ss_index_open(ss, 0);
 
 	state = 0;
 	do
 	{
-		wt = wf_read_table(ss, wf, &state, &ival, dvals);
+		wt = wf_read_table(ss, wf, &state, &blk);
 		if(wt)
 		{
 			ss_msg(DBG, "wf_finish_read", "table with %d rows; state=%d", wt->nvalues, state);
-			wt->swindex = wf->wf_ntables;
-			g_ptr_array_add(wf->tables, wt);
-			if(!wt->name)
-			{
-				char tmp[128];
-				sprintf(tmp, "tbl%d", wf->wf_ntables);
-				wt->name = g_strdup(tmp);
-			}
+			wf_add_table(wf, wt);
 		}
 		else
 		{
@@ -217,8 +324,12 @@ WaveFile *wf_finish_read(SpiceStream *ss)
 	}
 	while(state > 0);
 
-	g_free(dvals);
-	g_free(spar);
+	for(i = 0; i < ss->ncols-1; i++)
+		g_free(blk.cols[i]);
+	g_free(blk.cols);
+	g_free(blk.ivals);
+	if(blk.index)
+		ss_index_free(blk.index);
 	ss_close(ss);
 
 	if(state < 0)
@@ -233,10 +344,201 @@ WaveFile *wf_finish_read(SpiceStream *ss)
 }
 
 /*
- * read data for a single table (sweep or segment) from spicestream.
+ * Add a table that has been read to a WaveFile, naming it if
+ * the file didn't.
+ */
+static void
+wf_add_table(WaveFile *wf, WvTable *wt)
+{
+	wt->swindex = wf->wf_ntables;
+	g_ptr_array_add(wf->tables, wt);
+	if(!wt->name)
+	{
+		char tmp[128];
+		sprintf(tmp, "tbl%d", wf->wf_ntables);
+		wt->name = g_strdup(tmp);
+	}
+}
+
+/*
+ * Map column col of table t of an spc file into a new dataset, a chunk
+ * at a time, so that its values are contiguous but only the pages that
+ * get looked at are ever read.  A chunk that doesn't start on a page
+ * boundary in the file, as in the last chunk of a table, is copied.
+ * A table of only one chunk is used where it is in the SpiceStream's
+ * own mapping, which then has to stay open; the dataset has no storage
+ * of its own.
+ * Returns 1 if the dataset uses the SpiceStream's mapping, 0 if it has
+ * its own, or -1, leaving it as it was, if the chunks aren't a whole
+ * number of pages long.
+ */
+static int
+wf_map_dataset(WDataSet *ds, SpiceStream *ss, int t, int col, int nrows,
+               int chunkrows, double **blocks)
+{
+	long pagesize = sysconf(_SC_PAGESIZE);
+	size_t chunksize = (size_t) chunkrows * sizeof(double);
+	char *base;
+	off_t off;
+	int k, n, nch;
+
+	if(nrows == 0)
+		return -1;
+	if(nrows <= chunkrows)
+	{
+		ss_spc_column(ss, t, col, blocks, &ds->min, &ds->max);
+		ds->data = blocks[0];
+		ds->npoints = nrows;
+		return 1;
+	}
+	if(chunksize % pagesize != 0)
+		return -1;
+	wf_expand_dset(ds, nrows);
+	base = (char *) ds->data;
+	nch = ss_spc_column(ss, t, col, blocks, &ds->min, &ds->max);
+	for(k = 0; k < nch; k++)
+	{
+		n = (k < nch - 1) ? chunkrows : nrows - k * chunkrows;
+		off = (char *) blocks[k] - ss->mapbase;
+		if(off % pagesize != 0
+		   || mmap(base + k * chunksize, n * sizeof(double),
+		           PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED,
+		           fileno(ss->fp), off) == MAP_FAILED)
+			memcpy(base + k * chunksize, blocks[k], n * sizeof(double));
+	}
+	ds->npoints = nrows;
+	return 0;
+}
+
+/*
+ * Copy rows lo to hi of column col of table t of an spc file
+ * into a dataset.
+ */
+static void
+wf_copy_dataset(WDataSet *ds, SpiceStream *ss, int t, int col,
+                double **blocks, int chunkrows, int lo, int hi)
+{
+	double min, max;
+	int row;
+
+	ss_spc_column(ss, t, col, blocks, &min, &max);
+	wf_expand_dset(ds, hi - lo);
+	for(row = lo; row < hi; row++)
+		wf_set_point(ds, row - lo, blocks[row / chunkrows][row % chunkrows]);
+}
+
+/*
+ * Fill in a dataset from column col of table t of an spc file, mapping
+ * it if the whole table is wanted as doubles.  Returns 1 if it is left in the
+ * SpiceStream's mapping, else 0.
+ */
+static int
+wf_spc_dataset(WDataSet *ds, SpiceStream *ss, int t, int col, double **blocks,
+               int nrows, int chunkrows, int lo, int hi)
+{
+	int rc = -1;
+
+	if(lo == 0 && hi == nrows && !ds->f32)
+		rc = wf_map_dataset(ds, ss, t, col, nrows, chunkrows, blocks);
+	if(rc < 0)
+		wf_copy_dataset(ds, ss, t, col, blocks, chunkrows, lo, hi);
+	return rc == 1;
+}
+
+/*
+ * wf_finish_read for spc files.  Their columns are already stored a
+ * chunk at a time, with their min and max worked out, so tables that
+ * are wanted whole are mapped from the file (see wf_map_dataset), and
+ * only the pages of the signals that are looked at get read.  If some
+ * are used in the SpiceStream's own mapping, the file stays open until
+ * wf_free.  Only the rows wanted are copied out of other tables.
+ * Returns NULL, leaving ss as it was, for files that have to be read
+ * the usual way: those with tables that wf_read_table would split where
+ * the independent variable goes back.
+ */
+static WaveFile *
+wf_finish_read_spc(SpiceStream *ss, double begin_val, double end_val, int store)
+{
+	WaveFile *wf;
+	WvTable *wt;
+	WaveVar *dv;
+	double **blocks;
+	double *swvals;
+	double min, max;
+	int nrows, chunkrows, sorted;
+	int inplace = 0;
+	int t, i, j, lo, hi, mid;
+
+	if(ss->nsweepparam > 1)
+		return NULL;
+	for(t = 0; t < ss->ntables; t++)
+	{
+		if(ss_spc_table(ss, t, &nrows, &chunkrows, &sorted, &swvals) < 0
+		   || !sorted)
+			return NULL;
+	}
+
+	wf = g_new0(WaveFile, 1);
+	wf->ss = ss;
+	wf->tables = g_ptr_array_new();
+	wf->store = store;
+	for(t = 0; t < ss->ntables; t++)
+	{
+		ss_spc_table(ss, t, &nrows, &chunkrows, &sorted, &swvals);
+		blocks = g_new(double *, nrows / chunkrows + 1);
+		ss_spc_column(ss, t, 0, blocks, &min, &max);
+
+		/* the rows from begin_val to end_val */
+		for(lo = 0, hi = nrows; lo < hi; )
+		{
+			mid = lo + (hi - lo) / 2;
+			if(blocks[mid / chunkrows][mid % chunkrows] < begin_val)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		for(hi = nrows, i = lo; i < hi; )
+		{
+			mid = i + (hi - i) / 2;
+			if(blocks[mid / chunkrows][mid % chunkrows] <= end_val)
+				i = mid + 1;
+			else
+				hi = mid;
+		}
+
+		wt = wvtable_new(wf, 0);
+		if(ss->nsweepparam == 1)
+		{
+			wt->swval = swvals[0];
+			wt->name = g_strdup(ss->spar[0].name);
+		}
+		wt->nvalues = hi - lo;
+		inplace |= wf_spc_dataset(wt->iv->wds, ss, t, 0, blocks,
+		                          nrows, chunkrows, lo, hi);
+		for(i = 0; i < wt->wt_ndv; i++)
+		{
+			dv = &wt->dv[i];
+			for(j = 0; j < dv->wv_ncols; j++)
+				inplace |= wf_spc_dataset(&dv->wds[j], ss, t, dv->sv->col + j,
+				                          blocks, nrows, chunkrows, lo, hi);
+		}
+		g_free(blocks);
+		ss_msg(DBG, "wf_finish_read_spc", "table %d: rows %d to %d of %d",
+		       t, lo, hi, nrows);
+		wf_add_table(wf, wt);
+	}
+	if(!inplace)
+		ss_close(ss);
+	return wf;
+}
+
+/*
+ * read data for a single table (sweep or segment) from spicestream,
+ * a block of rows at a time, keeping the rows from blk->begin_val to
+ * blk->end_val.
  * on entry:
- *	state=0: no previous data; dvals is allocated but garbage
- *	state=1: first row of data is in *ivalp, and vals[].
+ *	state=0: no previous data; blk is allocated but empty
+ *	state=2: rows of this table starting at blk->pos are in blk.
  * on exit:
  *	return NULL: fatal error, *statep=-1
  *	return non-NULL: valid wvtable*
@@ -246,17 +548,20 @@ WaveFile *wf_finish_read(SpiceStream *ss)
  * 	state=1:  finished table but more tables remain,
  *			none of the next table has yet been read
  * 	state=2:  finished table but more tables remain and
- *		*ivalp,dvals[] contain first row of next table.
+ *		blk contains rows of the next table starting at blk->pos.
  */
 WvTable *
 wf_read_table(SpiceStream *ss, WaveFile *wf,
-              int *statep, double *ivalp, double *dvals)
+              int *statep, WfRowBlock *blk)
 {
 	WvTable *wt;
-	int row;
+	int row, nseen;
+	int pastend;
 	WaveVar *dv;
+	double ival;
 	double last_ival;
 	double spar;
+	long long nrows;
 	int rc, i, j;
 
 	if(ss->nsweepparam > 0)
@@ -276,7 +581,17 @@ wf_read_table(SpiceStream *ss, WaveFile *wf,
 			return NULL;
 		}
 	}
-	wt = wvtable_new(wf);
+	/* tables of a sweep are usually the same length; otherwise, share
+	 * out what the reader expects among the tables it says are left */
+	if(wf->wf_ntables > 0)
+		nrows = (wf_wtable(wf, wf->wf_ntables - 1))->nvalues;
+	else
+	{
+		nrows = ss_estimate_rows(ss);
+		if(ss->ntables > 1)
+			nrows /= ss->ntables;
+	}
+	wt = wvtable_new(wf, nrows < INT_MAX ? nrows : INT_MAX);
 	if(ss->nsweepparam == 1)
 	{
 		wt->swval = spar;
@@ -287,59 +602,84 @@ wf_read_table(SpiceStream *ss, WaveFile *wf,
 		wt->swval = 0;
 	}
 
-	if(*statep == 2)
+	row = 0;
+	nseen = 0;
+	pastend = 0;
+	wt->nvalues = 0;
+	last_ival = -1.0e29;
+	if(*statep != 2)
 	{
-		wf_set_point(wt->iv->wds, row, *ivalp);
-		for(i = 0; i < wt->wt_ndv; i++)
-		{
-			dv = &wt->dv[i];
-			for(j = 0; j < dv->wv_ncols; j++)
-				wf_set_point(&dv->wds[j], row,
-				             dvals[dv->sv->col - 1 + j ]);
-		}
-		row = 1;
-		wt->nvalues = 1;
-		last_ival = *ivalp;
-	}
-	else
-	{
-		row = 0;
-		wt->nvalues = 0;
-		last_ival = -1.0e29;
+		blk->nrows = blk->pos = 0;
+		if(blk->index)
+			ss_index_seek(blk->index, ss, blk->table, blk->begin_val);
+		else if(blk->begin_val > -DBL_MAX)
+			ss_seek_ival(ss, blk->begin_val);
 	}
 
-	while((rc = ss_readrow(ss, ivalp, dvals)) > 0)
+	for(;;)
 	{
-		if(row > 0 && *ivalp < last_ival)
+		if(blk->pos >= blk->nrows)
 		{
-			if(row == 1)
+			if(pastend && blk->index
+			   && ss_index_next_table(blk->index, ss, blk->table))
 			{
-				ss_msg(ERR, "wavefile_read", "independent variable is not nondecreasing at row %d; ival=%g last_ival=%g\n", row, *ivalp, last_ival);
-				wt_free(wt);
-				*statep = -1;
-				return NULL;
+				rc = -2;
+				break;
+			}
+			if(pastend && !blk->index)
+				ss_seek_ival(ss, DBL_MAX);
+			rc = ss_readblock(ss, blk->maxrows, blk->ivals, blk->cols);
+			if(rc <= 0)
+				break;
+			blk->nrows = rc;
+			blk->pos = 0;
+		}
+		for(; blk->pos < blk->nrows; blk->pos++)
+		{
+			ival = blk->ivals[blk->pos];
+			if(nseen > 0 && ival < last_ival)
+			{
+				if(nseen == 1)
+				{
+					ss_msg(ERR, "wavefile_read", "independent variable is not nondecreasing at row %d; ival=%g last_ival=%g\n", nseen, ival, last_ival);
+					wt_free(wt);
+					*statep = -1;
+					return NULL;
 
+				}
+				else
+				{
+					*statep = 2;
+					wt_trim(wt);
+					return wt;
+				}
 			}
-			else
+			last_ival = ival;
+			nseen++;
+			if(ival < blk->begin_val)
+				continue;
+			if(ival > blk->end_val)
 			{
-				*statep = 2;
-				return wt;
+				pastend = 1;
+				continue;
 			}
+			wf_set_point(wt->iv->wds, row, ival);
+			for(i = 0; i < wt->wt_ndv; i++)
+			{
+				dv = &wt->dv[i];
+				for(j = 0; j < dv->wv_ncols; j++)
+					wf_set_point(&dv->wds[j], row,
+					             blk->cols[dv->sv->col - 1 + j][blk->pos]);
+			}
+			row++;
+			wt->nvalues++;
 		}
-		last_ival = *ivalp;
-		wf_set_point(wt->iv->wds, row, *ivalp);
-		for(i = 0; i < wt->wt_ndv; i++)
-		{
-			dv = &wt->dv[i];
-			for(j = 0; j < dv->wv_ncols; j++)
-				wf_set_point(&dv->wds[j], row,
-				             dvals[dv->sv->col - 1 + j ]);
-		}
-		row++;
-		wt->nvalues++;
 	}
 	if(rc == -2)
+	{
 		*statep = 1;
+		blk->table++;
+	}
 	else if(rc < 0)
 	{
 		wt_free(wt);
@@ -350,6 +690,7 @@ wf_read_table(SpiceStream *ss, WaveFile *wf,
 	{
 		*statep = 0;
 	}
+	wt_trim(wt);
 	return wt;
 }
 
@@ -374,11 +715,16 @@ wf_free(WaveFile *wf)
 
 void wt_free(WvTable *wt)
 {
-	int i;
+	int i, j;
 	for(i = 0; i < wt->wt_ndv; i++)
-		wf_free_dataset(wt->dv[i].wds);
+	{
+		for(j = 0; j < wt->dv[i].wv_ncols; j++)
+			wf_free_dataset(&wt->dv[i].wds[j]);
+		g_free(wt->dv[i].wds);
+	}
 	g_free(wt->dv);
 	wf_free_dataset(wt->iv->wds);
+	g_free(wt->iv->wds);
 	g_free(wt->iv);
 	if(wt->name)
 		g_free(wt->name);
@@ -386,10 +732,79 @@ void wt_free(WvTable *wt)
 }
 
 /*
- * create a new, empty WvTable for a WaveFile
+ * Bytes of whole pages that it takes to hold n values of a dataset.
+ */
+static size_t
+wds_pages(WDataSet *ds, int n)
+{
+	long pagesize = sysconf(_SC_PAGESIZE);
+
+	return ((size_t) n * wds_elsize(ds) + pagesize - 1) / pagesize * pagesize;
+}
+
+/*
+ * Reserve room for n rows in all of the datasets of a new table, with
+ * one mmap for the lot.  Each dataset gets a whole number of pages, so
+ * that it can be grown or trimmed by itself later; pages that never get
+ * used cost only address space.
+ */
+static void
+wt_reserve(WvTable *wt, int n)
+{
+	size_t ivsize, dvsize, total;
+	char *p;
+	int i, j;
+
+	ivsize = wds_pages(wt->iv->wds, n);
+	dvsize = 0;
+	total = ivsize;
+	for(i = 0; i < wt->wt_ndv; i++)
+	{
+		dvsize = wds_pages(&wt->dv[i].wds[0], n);
+		total += wt->dv[i].wv_ncols * dvsize;
+	}
+	p = mmap(NULL, total, PROT_READ | PROT_WRITE,
+	         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(p == MAP_FAILED)
+		return;	/* they'll grow as they're filled in */
+#ifdef MADV_HUGEPAGE
+	if(dvsize >= DS_HUGESIZE)
+		madvise(p, total, MADV_HUGEPAGE);
+#endif
+	wt->iv->wds->data = p;
+	wt->iv->wds->size = ivsize;
+	p += ivsize;
+	for(i = 0; i < wt->wt_ndv; i++)
+	{
+		for(j = 0; j < wt->dv[i].wv_ncols; j++)
+		{
+			wt->dv[i].wds[j].data = p;
+			wt->dv[i].wds[j].size = dvsize;
+			p += dvsize;
+		}
+	}
+}
+
+/*
+ * Trim the storage of all of a table's datasets, once it has been read.
+ */
+static void
+wt_trim(WvTable *wt)
+{
+	int i, j;
+
+	wf_trim_dset(wt->iv->wds);
+	for(i = 0; i < wt->wt_ndv; i++)
+		for(j = 0; j < wt->dv[i].wv_ncols; j++)
+			wf_trim_dset(&wt->dv[i].wds[j]);
+}
+
+/*
+ * create a new, empty WvTable for a WaveFile, with room for nrows rows
+ * reserved in its datasets if nrows is more than 0.
  */
 WvTable *
-wvtable_new(WaveFile *wf)
+wvtable_new(WaveFile *wf, int nrows)
 {
 	WvTable *wt;
 	SpiceStream *ss = wf->ss;
@@ -401,7 +816,9 @@ wvtable_new(WaveFile *wf)
 	wt->iv->sv = ss->ivar;
 	wt->iv->wtable = wt;
 	wt->iv->wds = g_new0(WDataSet, 1);
-	wf_init_dataset(wt->iv->wds);
+	/* interpolation divides by differences of independent-variable
+	 * values, so they are always kept as doubles */
+	wf_init_dataset(wt->iv->wds, WF_STORE_F64);
 
 	wt->dv = g_new0(WaveVar, wf->ss->ndv);
 	for(i = 0; i < wf->wf_ndv; i++)
@@ -410,26 +827,28 @@ wvtable_new(WaveFile *wf)
 		wt->dv[i].sv = &ss->dvar[i];
 		wt->dv[i].wds = g_new0(WDataSet, wt->dv[i].sv->ncols);
 		for(j = 0; j < wt->dv[i].sv->ncols; j++)
-			wf_init_dataset(&wt->dv[i].wds[j]);
+			wf_init_dataset(&wt->dv[i].wds[j], wf->store);
 	}
+	if(nrows > 0)
+		wt_reserve(wt, nrows);
 	return wt;
 }
 
 
 /*
- * initialize common elements of WDataSet structure
+ * initialize common elements of WDataSet structure, for values to be
+ * stored as store says
  */
 void
-wf_init_dataset(WDataSet *ds)
+wf_init_dataset(WDataSet *ds, int store)
 {
 	ds->min = G_MAXDOUBLE;
 	ds->max = -G_MAXDOUBLE;
 
-	ds->bpsize = DS_INBLKS;
-	ds->bptr = g_new0(double *, ds->bpsize);
-	ds->bptr[0] = g_new(double, DS_DBLKSIZE);
-	ds->bpused = 1;
-	ds->nreallocs = 0;
+	ds->data = NULL;
+	ds->npoints = 0;
+	ds->size = 0;
+	ds->f32 = (store == WF_STORE_F32);
 }
 
 /*
@@ -438,12 +857,10 @@ wf_init_dataset(WDataSet *ds)
 void
 wf_free_dataset(WDataSet *ds)
 {
-	int i;
-	for(i = 0; i < ds->bpused; i++)
-		if(ds->bptr[i])
-			g_free(ds->bptr[i]);
-	g_free(ds->bptr);
-	g_free(ds);
+	if(ds->size > 0)
+		munmap(ds->data, ds->size);
+	ds->data = NULL;
+	ds->size = 0;
 }
 
 /*
@@ -469,52 +886,98 @@ wf_foreach_wavevar(WaveFile *wf, GFunc func, gpointer *p)
 }
 
 /*
- * expand dataset's storage to add one more block.
+ * expand dataset's storage to hold at least n values, doubling it until
+ * it does.  mremap can usually just extend the mapping, and otherwise
+ * moves the pages rather than copying them.
  */
 void
-wf_expand_dset(WDataSet *ds)
+wf_expand_dset(WDataSet *ds, int n)
 {
-	if(ds->bpused >= ds->bpsize)
+	size_t size;
+	void *p;
+
+	if((size_t) n * wds_elsize(ds) <= ds->size)
+		return;
+	size = ds->size ? ds->size : DS_INITSIZE;
+	while(size < (size_t) n * wds_elsize(ds))
+		size *= 2;
+	if(!ds->data)
+		p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	else
 	{
-		ds->bpsize *= 2;
-		ds->bptr = g_realloc(ds->bptr, ds->bpsize * sizeof(double*));
-		ds->nreallocs++;
+#ifdef MREMAP_MAYMOVE
+		p = mremap(ds->data, ds->size, size, MREMAP_MAYMOVE);
+#else
+		p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if(p != MAP_FAILED)
+		{
+			memcpy(p, ds->data, ds->size);
+			munmap(ds->data, ds->size);
+		}
+#endif
+	}
+	if(p == MAP_FAILED)
+	{
+		ss_msg(ERR, "wf_expand_dset", "can't get %lu bytes for data: %s",
+		       (unsigned long) size, strerror(errno));
+		exit(1);
 	}
-	ds->bptr[ds->bpused++] = g_new(double, DS_DBLKSIZE);
+#ifdef MADV_HUGEPAGE
+	if(size >= DS_HUGESIZE)
+		madvise(p, size, MADV_HUGEPAGE);
+#endif
+	ds->data = p;
+	ds->size = size;
 }
 
 /*
- * set single value in dataset.   Probably can be inlined.
+ * Give back the storage of a dataset past the page of its last value,
+ * if that is more than a quarter of it, as when it was reserved from a
+ * high estimate of the number of rows.  Each trim can leave the kernel
+ * another mapping to keep track of, so a little slack isn't worth it;
+ * nor is it a problem if the kernel won't do it.
  */
 void
-wf_set_point(WDataSet *ds, int n, double val)
+wf_trim_dset(WDataSet *ds)
 {
-	int blk, off;
-	blk = ds_blockno(n);
-	off = ds_offset(n);
-	while(blk >= ds->bpused)
-		wf_expand_dset(ds);
+	size_t size;
 
-	ds->bptr[blk][off] = val;
-	if(val < ds->min)
-		ds->min = val;
-	if(val > ds->max)
-		ds->max = val;
+	if(ds->size == 0)
+		return;
+	size = wds_pages(ds, ds->npoints);
+	if(size > ds->size - ds->size / 4)
+		return;
+	if(munmap((char *) ds->data + size, ds->size - size) < 0)
+		return;
+	ds->size = size;
+	if(size == 0)
+		ds->data = NULL;
 }
 
 /*
- * get single point from dataset.   Probably can be inlined.
+ * set single value in dataset.   Probably can be inlined.
  */
-double
-wds_get_point(WDataSet *ds, int n)
+void
+wf_set_point(WDataSet *ds, int n, double val)
 {
-	int blk, off;
-	blk = ds_blockno(n);
-	off = ds_offset(n);
-	g_assert(blk <= ds->bpused);
-	g_assert(off < DS_DBLKSIZE);
+	if((size_t) n >= ds->size / wds_elsize(ds))
+		wf_expand_dset(ds, n + 1);
 
-	return ds->bptr[blk][off];
+	if(ds->f32)
+	{
+		((float *) ds->data)[n] = val;
+		val = ((float *) ds->data)[n];	/* min and max as stored */
+	}
+	else
+		((double *) ds->data)[n] = val;
+	if(n >= ds->npoints)
+		ds->npoints = n + 1;
+	if(val < ds->min)
+		ds->min = val;
+	if(val > ds->max)
+		ds->max = val;
 }
 
 /*
@@ -33,34 +33,36 @@ typedef struct _WDataSet WDataSet;
 typedef struct _WvTable WvTable;
 
 /* Wave Data Set -
- * an array of double-precision floating-point values,  used to store a
- * column of values.  Organized as a block structure because we don't know
- * how many entries there will be without reading the file, and we don't
- * want to read the whole thing twice.
- *
- * Depending on what the memory allocator does, this might even
- * end up being relatively cache-friendly.  TODO: think more about this.
+ * an array of floating-point values,  used to store a column of values.
+ * They are doubles, or single-precision floats if wf_read_opts was asked
+ * for WF_STORE_F32 or left the choice to the file, which takes half the
+ * memory; wds_get_point gives
+ * back a double either way.  We don't know how many entries there will be
+ * without reading the file, and we don't want to read the whole thing
+ * twice, so the array lives in memory of its own from mmap, which
+ * wf_expand_dset grows with mremap: the values stay contiguous without
+ * being copied as it grows, and big arrays are given huge pages.
+ * Code that works on a whole column at once can get at the array with
+ * wds_data or wds_data_f32.
  */
 
-#define DS_DBLKSIZE	8192
-#define DS_INBLKS	1024
-#define ds_blockno(n) ((n) / DS_DBLKSIZE)
-#define ds_offset(n) ((n) % DS_DBLKSIZE)
+#define DS_INITSIZE	4096		/* bytes of storage to start with */
+#define DS_HUGESIZE	(2 << 20)	/* ask for huge pages from this size */
 
 struct _WDataSet
 {
 	double min;
 	double max;
 
-	/* remaining stuff is an array storage structure
-	 * that could be abstracted out and/or replaced with somthing else */
-	/* pointer to array of pointers to blocks of doubles */
-	double **bptr;
-	int bpsize; /* size of array of pointers */
-	int bpused; /* number of blocks actually allocated */
-	int nreallocs;
+	void *data;	/* the values, from mmap; NULL until there are some */
+	int npoints;	/* number of values stored */
+	size_t size;	/* bytes of storage at data; 0 if it is in
+			 * a mapped spc file, not allocated */
+	int f32;	/* values are floats, not doubles */
 };
 
+#define wds_elsize(ds)	((ds)->f32 ? sizeof(float) : sizeof(double))
+
 /* Wave Variable - used for independent or dependent variable.
  */
 struct _WaveVar
@@ -105,8 +107,19 @@ struct _WaveFile
 	SpiceStream *ss;
 	GPtrArray *tables;  /* array of WvTable* */
 	void *udata;
+	int store;	/* WF_STORE_F64 or WF_STORE_F32 */
 };
 
+/* options for wf_read_opts: how to store the values.  With neither,
+ * files that hold single-precision values, such as HSPICE binary files,
+ * are stored as floats, since nothing is lost, and others as doubles;
+ * code that uses wds_data must then check for NULL and fall back on
+ * wds_data_f32.  wf_read and wf_read_range always store doubles. */
+#define WF_STORE_F64	1
+#define WF_STORE_F32	2
+/* with a range, find its start through file.ssidx, making it if need be */
+#define WF_USE_INDEX	4
+
 #define wf_filename	ss->filename
 #define wf_ndv		ss->ndv
 #define wf_ncols	ss->ncols
@@ -116,11 +129,48 @@ struct _WaveFile
 
 /* defined in wavefile.c */
 extern WaveFile *wf_read(char *name, char *format);
+extern WaveFile *wf_read_range(char *name, char *format,
+                               double begin_val, double end_val);
+extern WaveFile *wf_read_opts(char *name, char *format,
+                              double begin_val, double end_val, int opts);
 extern double wv_interp_value(WaveVar *dv, double ival);
 extern int wf_find_point(WaveVar *iv, double ival);
-extern double wds_get_point(WDataSet *ds, int n);
+extern void wf_expand_dset(WDataSet *ds, int n);
+extern void wf_trim_dset(WDataSet *ds);
 extern void wf_free(WaveFile *df);
 extern WaveVar *wf_find_variable(WaveFile *wf, char *varname, int swpno);
 extern void wf_foreach_wavevar(WaveFile *wf, GFunc func, gpointer *p);
 
+/*
+ * get single point from dataset.
+ */
+static inline double
+wds_get_point(WDataSet *ds, int n)
+{
+	if(ds->f32)
+		return ((float *) ds->data)[n];
+	return ((double *) ds->data)[n];
+}
+
+/*
+ * get all of a dataset's values, and how many there are; NULL if they
+ * are stored as floats.
+ */
+static inline double *
+wds_data(WDataSet *ds, int *npoints)
+{
+	*npoints = ds->npoints;
+	return ds->f32 ? NULL : (double *) ds->data;
+}
+
+/*
+ * the same, for datasets stored as floats; NULL if they aren't.
+ */
+static inline float *
+wds_data_f32(WDataSet *ds, int *npoints)
+{
+	*npoints = ds->npoints;
+	return ds->f32 ? (float *) ds->data : NULL;
+}
+
 #endif /* WAVEFILE_H */
@@ -0,0 +1,270 @@
+/*
+ * arrow - read back an Arrow IPC stream from sp2sp -c arrow.
+ *
+ * usage: arrow file
+ *
+ * Checks that the file is a well-formed stream of the kind sp2sp
+ * writes: a Schema of non-nullable float64 fields in the byte order of
+ * this machine, RecordBatches whose field nodes and buffers fit their
+ * bodies, and the end-of-stream marker.  Then prints the columns as
+ * sp2sp ascii output does, the field names and then a line for each
+ * row, with every value in full, for comparing with sp2sp -d 0 output.
+ * Exits 1 if the stream is not what it should be, after saying why.
+ *
+ * The metadata is read with a few routines that follow FlatBuffers
+ * offsets by hand, so that no Arrow or FlatBuffers library is needed.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARROW_V5 4	/* MetadataVersion */
+#define ARROW_SCHEMA 1	/* MessageHeader */
+#define ARROW_RECORDBATCH 3
+#define ARROW_FLOATINGPOINT 3	/* Type */
+#define ARROW_DOUBLE 2	/* Precision */
+
+static char *progname;
+static char *filename;
+
+/* the metadata of the message being read */
+static unsigned char *meta;
+static size_t metalen;
+
+static void
+bad(char *what)
+{
+	printf("%s: %s\n", filename, what);
+	exit(1);
+}
+
+/*
+ * Get the little-endian integer of n bytes at pos in the metadata.
+ */
+static unsigned long long
+get(size_t pos, int n)
+{
+	unsigned long long v = 0;
+
+	if(pos > metalen || n > metalen - pos)
+		bad("offset out of the metadata");
+	while(n-- > 0)
+		v = (v << 8) | meta[pos + n];
+	return v;
+}
+
+/*
+ * Where field id of the table at t is, or 0 if it isn't there.
+ */
+static size_t
+fb_field(size_t t, int id)
+{
+	size_t vt;
+	int off;
+
+	vt = t - (int) get(t, 4);
+	if(vt >= metalen)
+		bad("vtable out of the metadata");
+	if(4 + 2 * id >= (int) get(vt, 2))
+		return 0;
+	off = get(vt + 4 + 2 * id, 2);
+	return off ? t + off : 0;
+}
+
+/*
+ * The value of a scalar field, or def if it isn't there.
+ */
+static long long
+fb_scalar(size_t t, int id, int n, long long def)
+{
+	size_t p = fb_field(t, id);
+	unsigned long long v;
+
+	if(p == 0)
+		return def;
+	v = get(p, n);
+	if(n < 8 && (v >> (8 * n - 1)))
+		v -= 1ULL << (8 * n);	/* sign-extend */
+	return v;
+}
+
+/*
+ * Where the object that field id of the table at t points to is, or 0
+ * if the field isn't there.
+ */
+static size_t
+fb_ref(size_t t, int id)
+{
+	size_t p = fb_field(t, id);
+
+	return p ? p + get(p, 4) : 0;
+}
+
+/*
+ * The length of the vector at v, whose elements start at v + 4.
+ */
+static int
+fb_veclen(size_t v, int elsize)
+{
+	int n = get(v, 4);
+
+	if(n < 0 || (size_t) n * elsize > metalen - v - 4)
+		bad("vector out of the metadata");
+	return n;
+}
+
+/*
+ * Read n bytes, or fail with a message about what was being read.
+ */
+static void
+read_bytes(FILE *fp, void *p, size_t n, char *what)
+{
+	if(fread(p, 1, n, fp) != n)
+		bad(what);
+}
+
+/*
+ * Read the next message.  Returns its root table, its header type in
+ * *typep and the length of its body in *bodylenp, or 0 at the end of
+ * the stream.
+ */
+static size_t
+read_message(FILE *fp, int *typep, long long *bodylenp)
+{
+	unsigned char hdr[8];
+	size_t msg;
+
+	read_bytes(fp, hdr, 8, "EOF before the end-of-stream marker");
+	if(memcmp(hdr, "\377\377\377\377", 4) != 0)
+		bad("message without the continuation marker");
+	metalen = hdr[4] | hdr[5] << 8 | hdr[6] << 16 | (size_t) hdr[7] << 24;
+	if(metalen == 0)
+		return 0;
+	if(metalen % 8 != 0)
+		bad("metadata not padded to 8 bytes");
+	meta = realloc(meta, metalen);
+	read_bytes(fp, meta, metalen, "EOF in metadata");
+	msg = get(0, 4);
+	if(fb_scalar(msg, 0, 2, 0) != ARROW_V5)
+		bad("not metadata version 5");
+	*typep = fb_scalar(msg, 1, 1, 0);
+	*bodylenp = fb_scalar(msg, 3, 8, 0);
+	if(*bodylenp < 0 || *bodylenp % 8 != 0)
+		bad("body length not a multiple of 8");
+	return msg;
+}
+
+int
+main(int argc, char **argv)
+{
+	unsigned int one = 1;
+	FILE *fp;
+	size_t msg, sch, fields, f, name, type, nodes, bufs;
+	long long bodylen, nrows, off, len;
+	char **names;
+	double **cols;
+	unsigned char *body = NULL;
+	int type_type, nfields, i, r;
+
+	progname = argv[0];
+	if(argc != 2)
+	{
+		fprintf(stderr, "usage: %s file\n", progname);
+		exit(2);
+	}
+	filename = argv[1];
+	if((fp = fopen(filename, "rb")) == NULL)
+	{
+		perror(filename);
+		exit(2);
+	}
+
+	msg = read_message(fp, &type_type, &bodylen);
+	if(msg == 0 || type_type != ARROW_SCHEMA || bodylen != 0)
+		bad("doesn't start with a schema");
+	sch = fb_ref(msg, 2);
+	if(fb_scalar(sch, 0, 2, 0) != ((*(unsigned char *) &one == 1) ? 0 : 1))
+		bad("not in the byte order of this machine");
+	fields = fb_ref(sch, 1);
+	nfields = fields ? fb_veclen(fields, 4) : 0;
+	names = calloc(nfields + 1, sizeof(char *));
+	cols = calloc(nfields + 1, sizeof(double *));
+	for(i = 0; i < nfields; i++)
+	{
+		f = fields + 4 + 4 * i;
+		f += get(f, 4);
+		name = fb_ref(f, 0);
+		if(name == 0)
+			bad("field without a name");
+		len = fb_veclen(name, 1);
+		names[i] = calloc(len + 1, 1);
+		memcpy(names[i], meta + name + 4, len);
+		if(fb_scalar(f, 1, 1, 0) != 0)
+			bad("nullable field");
+		type = fb_ref(f, 3);
+		if(fb_scalar(f, 2, 1, 0) != ARROW_FLOATINGPOINT || type == 0
+		   || fb_scalar(type, 0, 2, 0) != ARROW_DOUBLE)
+			bad("field that isn't float64");
+		if(fb_ref(f, 5) && fb_veclen(fb_ref(f, 5), 4) != 0)
+			bad("field with children");
+	}
+
+	for(i = 0; i < nfields; i++)
+		printf("%s%s", i ? " " : "", names[i]);
+	printf("\n");
+
+	while((msg = read_message(fp, &type_type, &bodylen)) != 0)
+	{
+		if(type_type != ARROW_RECORDBATCH)
+			bad("message that isn't a record batch");
+		body = realloc(body, bodylen + 1);
+		read_bytes(fp, body, bodylen, "EOF in a record batch body");
+		msg = fb_ref(msg, 2);
+		nrows = fb_scalar(msg, 0, 8, 0);
+		nodes = fb_ref(msg, 1);
+		bufs = fb_ref(msg, 2);
+		if(nrows < 0 || nodes == 0 || bufs == 0
+		   || fb_veclen(nodes, 16) != nfields
+		   || fb_veclen(bufs, 16) != 2 * nfields)
+			bad("record batch doesn't match the schema");
+		for(i = 0; i < nfields; i++)
+		{
+			if((long long) get(nodes + 4 + 16 * i, 8) != nrows
+			   || get(nodes + 4 + 16 * i + 8, 8) != 0)
+				bad("field node with the wrong length or nulls");
+			if(get(bufs + 4 + 32 * i + 8, 8) != 0)
+				bad("validity bitmap in a non-nullable field");
+			off = get(bufs + 4 + 32 * i + 16, 8);
+			len = get(bufs + 4 + 32 * i + 24, 8);
+			if(off < 0 || off % 8 != 0 || len != nrows * 8
+			   || off > bodylen || len > bodylen - off)
+				bad("data buffer out of the body");
+			cols[i] = (double *) (body + off);
+		}
+		for(r = 0; r < nrows; r++)
+		{
+			for(i = 0; i < nfields; i++)
+				printf("%s%.17g", i ? " " : "", cols[i][r]);
+			printf("\n");
+		}
+	}
+	if(fgetc(fp) != EOF)
+		bad("data after the end-of-stream marker");
+	exit(0);
+}
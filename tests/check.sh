@@ -0,0 +1,484 @@
+#!/bin/sh
+#
+# Tests for sp2sp and the spicestream readers, run by "make check".
+#
+# usage: check.sh sp2sp bindir
+#
+# sp2sp is the program to test, and bindir is where the test programs
+# were built.  The input files are in tests/data.
+
+SP2SP=$1
+BIN=$2
+DATA=`dirname "$0"`/data
+TMP=`mktemp -d` || exit 1
+trap 'rm -rf "$TMP"' 0
+failed=0
+
+fail()
+{
+	echo "FAIL: $*"
+	failed=1
+}
+
+# ss_fmtg against printf("%.*g")
+"$BIN/fmtg" > "$TMP/fmtg" || { cat "$TMP/fmtg"; fail "ss_fmtg"; }
+
+# run name args...
+#
+# Run sp2sp with args, leaving its output in $TMP/name and what it says
+# on stderr in $TMP/name.err.
+run()
+{
+	name=$1
+	shift
+	"$SP2SP" "$@" > "$TMP/$name" 2> "$TMP/$name.err"
+}
+
+# same what name1 name2
+#
+# Check that two runs gave the same output and the same messages.
+same()
+{
+	cmp -s "$TMP/$2" "$TMP/$3" && cmp -s "$TMP/$2.err" "$TMP/$3.err" \
+		|| fail "$1"
+}
+
+# ascii and cazm input big enough to be parsed in many chunks, with the
+# end of the data marked by a blank line in the ascii file, and with a
+# short row part way through a copy of it
+awk 'BEGIN {
+	print "time v0 v1 v2 v3"
+	for(i = 0; i < 60000; i++)
+		printf "%.6e %g %g %d %d\n", i * 1e-9, sin(i / 100), cos(i / 77), i % 13, -i
+	print ""
+	print "1 2 3 4 5"
+}' > "$TMP/big.asc"
+awk 'BEGIN {
+	print "* cazm"
+	print ""
+	print "TRANSIENT ANALYSIS"
+	print "TIME v0 v1 v2"
+	for(i = 0; i < 60000; i++)
+		printf "%.6e %g %g %d\n", i * 1e-9, sin(i / 100), cos(i / 77), i % 13
+}' > "$TMP/big.N"
+awk 'NR == 30001 { print "1e-5 2 3"; next } { print }' "$TMP/big.asc" \
+	> "$TMP/short.asc"
+
+for f in big.asc:ascii big.N:cazm short.asc:ascii
+do
+	run j1 -t "${f#*:}" -j 1 "$TMP/${f%:*}"
+	run j4 -t "${f#*:}" -j 4 "$TMP/${f%:*}"
+	same "${f%:*}: parsed differently on 4 threads" j1 j4
+done
+[ `wc -l < "$TMP/j1"` = 30000 ] || fail "short.asc: rows after the short one"
+grep -q "short.asc:30001: data field 2 missing" "$TMP/j1.err" \
+	|| fail "short.asc: short row not reported"
+run j4 -t ascii -j 4 "$TMP/big.asc"
+[ `wc -l < "$TMP/j4"` = 60001 ] || fail "big.asc: data past the blank line"
+
+# the sample files in tests/data, and their types
+SAMPLES="tran.tr0:hspice sweep.tr0:hspice sweepb.tr0:hspice
+	tran.raw:spice3raw ac.raw:spice3raw tranb.raw:spice3raw
+	acb.raw:spice3raw tran.s2:spice2raw"
+
+# output formatted on 4 threads is the same as on one
+for f in $SAMPLES
+do
+	for opts in "-d 0" "-d 4 -c nohead" "-c cazm" "-s head" "-s none" \
+		"-b 2e-8 -e 5e-5" "-n 2,0"
+	do
+		run j1 -t "${f#*:}" $opts -j 1 "$DATA/${f%:*}"
+		run j4 -t "${f#*:}" $opts -j 4 "$DATA/${f%:*}"
+		same "${f%:*}: $opts: formatted differently on 4 threads" j1 j4
+	done
+done
+for f in big.asc:ascii big.N:cazm
+do
+	run j1 -t "${f#*:}" -d 0 -c cazm -j 1 "$TMP/${f%:*}"
+	run j4 -t "${f#*:}" -d 0 -c cazm -j 4 "$TMP/${f%:*}"
+	same "${f%:*}: formatted differently on 4 threads" j1 j4
+done
+
+# seek file type [nthreads]
+#
+# Check that ss_seek to each checkpoint that ss_tell gave reads the rest
+# of file again as it was read the first time.
+seek()
+{
+	"$BIN/seek" "$@" > "$TMP/seek" 2>&1 \
+		|| { cat "$TMP/seek"; fail "`basename "$1"`: seek"; }
+}
+
+# ascii input through stdio, binary input mapped, and ascii and cazm
+# input parsed on threads
+for f in $SAMPLES
+do
+	seek "$DATA/${f%:*}" "${f#*:}"
+done
+seek "$TMP/big.asc" ascii 3
+seek "$TMP/big.N" cazm 3
+
+# -b and -e with a seek index give the same output as without, both when
+# the index is written and when it is used
+for f in tran.tr0:hspice sweep.tr0:hspice tran.raw:spice3raw
+do
+	cp "$DATA/${f%:*}" "$TMP/idx.${f%:*}"
+	for opts in "-b 2e-8 -e 5e-8" "-b 1e-9" "-e 3e-8"
+	do
+		run noidx -t "${f#*:}" -d 0 $opts "$TMP/idx.${f%:*}"
+		rm -f "$TMP/idx.${f%:*}.ssidx"
+		run idx -t "${f#*:}" -d 0 -i $opts "$TMP/idx.${f%:*}"
+		same "${f%:*}: $opts: writing an index" noidx idx
+		[ -f "$TMP/idx.${f%:*}.ssidx" ] \
+			|| fail "${f%:*}: $opts: no index written"
+		run idx -t "${f#*:}" -d 0 -i $opts "$TMP/idx.${f%:*}"
+		same "${f%:*}: $opts: using an index" noidx idx
+	done
+done
+
+# with SS_INDEX_DIR the index goes there, named for the path of the
+# file, and an index that can't be written is reported; a directory in
+# the way of its temporary file stands in for a tree that can't be
+# written, since permissions don't stop root
+mkdir "$TMP/ixdir"
+run noidx -t hspice -d 0 -b 2e-8 "$TMP/idx.sweep.tr0"
+rm -f "$TMP/idx.sweep.tr0.ssidx"
+mkdir "$TMP/idx.sweep.tr0.ssidx.tmp"
+run idx -t hspice -d 0 -i -b 2e-8 "$TMP/idx.sweep.tr0"
+cmp -s "$TMP/noidx" "$TMP/idx" || fail "sweep.tr0: index not written: output differs"
+grep -q "can't write seek index" "$TMP/idx.err" \
+	|| fail "sweep.tr0: index not written: not reported"
+for i in 1 2
+do
+	SS_INDEX_DIR=$TMP/ixdir "$SP2SP" -t hspice -d 0 -i -b 2e-8 \
+		"$TMP/idx.sweep.tr0" > "$TMP/idx" 2> "$TMP/idx.err"
+	same "sweep.tr0: index in SS_INDEX_DIR, run $i" noidx idx
+done
+ls "$TMP/ixdir" | grep -q '^%.*%idx\.sweep\.tr0\.ssidx$' \
+	|| fail "sweep.tr0: no index in SS_INDEX_DIR"
+[ -f "$TMP/idx.sweep.tr0.ssidx" ] && fail "sweep.tr0: index written next to the file"
+rmdir "$TMP/idx.sweep.tr0.ssidx.tmp"
+
+# ss_seek_ival on fixed-size rows, and -b and -e on a spice3 binary file
+# against the same data in an ascii one
+for f in tranb.raw:spice3raw acb.raw:spice3raw tran.s2:spice2raw
+do
+	"$BIN/ival" "$DATA/${f%:*}" "${f#*:}" > "$TMP/ival" 2>&1 \
+		|| { cat "$TMP/ival"; fail "${f%:*}: ss_seek_ival"; }
+done
+for opts in "-b 0" "-b 1e-9" "-b 2e-8 -e 5e-8" "-b 1e-7" "-e 1e-8"
+do
+	run ascii -t spice3raw -d 0 $opts "$DATA/tran.raw"
+	run binary -t spice3raw -d 0 $opts "$DATA/tranb.raw"
+	same "tranb.raw: $opts: not as from tran.raw" ascii binary
+done
+
+# ss_skip_table against reading each table through
+for f in sweep.tr0:hspice sweepb.tr0:hspice tran.tr0:hspice tran.raw:spice3raw
+do
+	"$BIN/skip" "$DATA/${f%:*}" "${f#*:}" > "$TMP/skip" 2>&1 \
+		|| { cat "$TMP/skip"; fail "${f%:*}: ss_skip_table"; }
+done
+
+# rejects what args...
+#
+# Check that sp2sp fails cleanly with args, with a message.
+rejects()
+{
+	what=$1
+	shift
+	"$SP2SP" "$@" > /dev/null 2> "$TMP/err"
+	status=$?
+	if [ $status = 0 ] || [ $status -ge 128 ] || [ ! -s "$TMP/err" ]
+	then
+		fail "$what: not rejected cleanly (exit status $status)"
+	fi
+}
+
+# -t auto reads each file as its own type would
+for f in $SAMPLES
+do
+	run typed -t "${f#*:}" -d 0 "$DATA/${f%:*}"
+	run auto -t auto -d 0 "$DATA/${f%:*}"
+	same "${f%:*}: -t auto not the same as -t ${f#*:}" typed auto
+done
+for f in big.asc:ascii big.N:cazm
+do
+	run typed -t "${f#*:}" "$TMP/${f%:*}"
+	run auto -t auto "$TMP/${f%:*}"
+	same "${f%:*}: -t auto not the same as -t ${f#*:}" typed auto
+done
+printf '\001\002\003\004\377\376junk\000\000' > "$TMP/junk"
+: > "$TMP/empty"
+rejects "-t auto on junk" -t auto "$TMP/junk"
+rejects "-t auto on an empty file" -t auto "$TMP/empty"
+
+# gzip'd input reads as the file does, with -t auto and with its type,
+# and seeks through the decompressing stream
+for f in $SAMPLES big.asc:ascii big.N:cazm
+do
+	in=$DATA/${f%:*}
+	[ -f "$in" ] || in=$TMP/${f%:*}
+	gzip -c "$in" > "$TMP/z.${f%:*}.gz"
+	for opts in "-d 0" "-b 2e-8 -e 5e-8" "-s head" "-j 3"
+	do
+		run plain -t "${f#*:}" $opts "$in"
+		run gz -t auto $opts "$TMP/z.${f%:*}.gz"
+		same "${f%:*}.gz: $opts: -t auto not as from the file" plain gz
+		run gz -t "${f#*:}" $opts "$TMP/z.${f%:*}.gz"
+		same "${f%:*}.gz: $opts: -t ${f#*:} not as from the file" plain gz
+	done
+done
+for f in $SAMPLES
+do
+	seek "$TMP/z.${f%:*}.gz" "${f#*:}"
+done
+
+# a truncated stream gives what it holds, and says that it was cut short
+head -c 100000 "$TMP/z.big.asc.gz" > "$TMP/cut.gz"
+"$SP2SP" -t ascii "$TMP/cut.gz" > "$TMP/cut" 2> "$TMP/cut.err"
+status=$?
+if [ $status -ge 128 ] || [ ! -s "$TMP/cut.err" ] || [ ! -s "$TMP/cut" ]
+then
+	fail "cut.gz: truncated stream not reported (exit status $status)"
+fi
+
+# input from a pipe reads as the file does, gzip'd or not; the files
+# are copied so that -i writes its index in $TMP
+for f in $SAMPLES big.asc:ascii
+do
+	in=$TMP/p.${f%:*}
+	cp "$DATA/${f%:*}" "$in" 2> /dev/null || cp "$TMP/${f%:*}" "$in"
+	for opts in "-d 0" "-b 2e-8 -e 5e-8" "-i -b 2e-8" "-j 3"
+	do
+		run plain -t "${f#*:}" $opts "$in"
+		cat "$in" | run pipe -t "${f#*:}" $opts -
+		same "${f%:*}: $opts: stdin not as from the file" plain pipe
+		cat "$in" | run pipe -t auto $opts -
+		same "${f%:*}: $opts: -t auto on stdin not as from the file" \
+			plain pipe
+		gzip -c "$in" | run pipe -t auto $opts -
+		same "${f%:*}: $opts: gzip'd stdin not as from the file" \
+			plain pipe
+	done
+done
+[ -f ./-.ssidx ] && fail "stdin: -i wrote -.ssidx"
+
+# a header of more than a megabyte can be read again from a pipe: the
+# ascii reader reads all of the first line of this cazm file before
+# rejecting it, and wf_read goes back to the start to try the others
+awk 'BEGIN {
+	printf "*"
+	for(i = 0; i < 200000; i++)
+		printf " c%d", i
+	printf " \001\n\nTRANSIENT ANALYSIS\nTIME v0 v1\n"
+	for(i = 0; i < 100; i++)
+		printf "%.6e %g %d\n", i * 1e-9, sin(i / 10), i % 13
+}' > "$TMP/wide.N"
+"$BIN/wf" "$TMP/wide.N" > "$TMP/plain" 2>&1 \
+	|| { cat "$TMP/plain"; fail "wide.N: WaveFile checks"; }
+cat "$TMP/wide.N" | "$BIN/wf" - > "$TMP/pipe" 2>&1
+cmp -s "$TMP/plain" "$TMP/pipe" || fail "wide.N: stdin not as from the file"
+
+# roundtrip intype file outtype readtype reltol
+#
+# Convert file to outtype, read the result back as readtype, and compare
+# that with the input, both printed with -d 0 so that nothing is lost in
+# the printing, to within reltol.
+roundtrip()
+{
+	out=$TMP/`basename "$2"`.$3
+	if ! "$SP2SP" -t "$1" -c "$3" -o "$out" "$DATA/$2"; then
+		fail "$2: writing $3"
+		return
+	fi
+	"$SP2SP" -t "$1" -d 0 "$DATA/$2" > "$TMP/want" \
+		|| { fail "$2: reading $1"; return; }
+	"$SP2SP" -t "$4" -d 0 "$out" > "$TMP/got" \
+		|| { fail "$2: reading back $3"; return; }
+	"$BIN/numcmp" "$5" "$TMP/want" "$TMP/got" \
+		|| fail "$2: $3 doesn't read back as written"
+}
+
+# spice3 rawfiles hold doubles, real or complex
+roundtrip spice3raw tran.raw spice3raw spice3raw 0
+roundtrip spice3raw ac.raw spice3raw spice3raw 0
+roundtrip hspice tran.tr0 spice3raw spice3raw 0
+roundtrip spice2raw tran.s2 spice3raw spice3raw 0
+
+# HSPICE binary files hold floats
+roundtrip hspice tran.tr0 hsbinary hsbinary 1.2e-7
+roundtrip hspice sweep.tr0 hsbinary hsbinary 1.2e-7
+roundtrip spice3raw tran.raw hsbinary hsbinary 1.2e-7
+
+# .spc files read back exactly as written, sweeps and all
+for f in $SAMPLES
+do
+	"$SP2SP" -t "${f#*:}" -c spc -o "$TMP/${f%:*}.spc" "$DATA/${f%:*}" \
+		|| { fail "${f%:*}: writing spc"; continue; }
+	for opts in "-d 0" "-d 0 -s head" "-b 2e-8 -e 5e-8"
+	do
+		run want -t "${f#*:}" $opts "$DATA/${f%:*}"
+		run got -t spc $opts "$TMP/${f%:*}.spc"
+		same "${f%:*}: $opts: spc doesn't read back as written" want got
+	done
+done
+
+# damage offset bytes what
+#
+# Check that a copy of tran.tr0.spc with bytes written at offset in its
+# header is rejected.
+damage()
+{
+	cp "$TMP/tran.tr0.spc" "$TMP/bad.spc"
+	printf "$2" | dd of="$TMP/bad.spc" bs=1 seek=$1 conv=notrunc 2> /dev/null
+	rejects "spc with $3" -t spc "$TMP/bad.spc"
+}
+
+damage 0 'X' "a bad magic number"
+damage 8 '\143' "an unknown version"
+damage 19 '\200' "a negative variable count"
+damage 23 '\177' "a huge column count"
+damage 35 '\177' "huge variable descriptions"
+damage 28 '\000\000\000\000' "no rows in a chunk"
+head -c 100 "$TMP/tran.tr0.spc" > "$TMP/bad.spc"
+rejects "a truncated spc file" -t spc "$TMP/bad.spc"
+damage 19 '\177' "a huge variable count"
+damage 19 '\020' "more variables than columns"
+damage 27 '\177' "a huge sweep parameter count"
+damage 16 '\001\000\000\000' "more columns than variables can have"
+
+# npz archives and npy files load back, with a name of its own for each
+# array, even where variables share a name with each other or with the
+# arrays that sp2sp adds
+printf 'time v v rows sweep x/y\n0 1 2 3 4 5\n1 6 7 8 9 10\n' > "$TMP/names.asc"
+cat > "$TMP/names.want" <<'EOF'
+time: (2,): 0 1
+v: (2,): 1 6
+v_1: (2,): 2 7
+rows_1: (2,): 3 8
+sweep_1: (2,): 4 9
+x_y: (2,): 5 10
+EOF
+"$SP2SP" -t ascii -c npz -o "$TMP/names.npz" "$TMP/names.asc" \
+	&& "$BIN/npz" "$TMP/names.npz" > "$TMP/names" \
+	&& cmp -s "$TMP/names.want" "$TMP/names" \
+	|| { cat "$TMP/names"; fail "names.asc: npz array names"; }
+"$SP2SP" -t hspice -c npz -o "$TMP/sweep.npz" "$DATA/sweep.tr0" \
+	&& "$BIN/npz" "$TMP/sweep.npz" > "$TMP/sweep" \
+	&& grep -qx "rows: (3,): 25 25 25" "$TMP/sweep" \
+	&& grep -qx "sweep: (3, 1): 1.5 2.5 3.5" "$TMP/sweep" \
+	&& grep -qx "sweep_names: (1,): swp0" "$TMP/sweep" \
+	|| fail "sweep.tr0: npz rows and sweep arrays"
+for f in $SAMPLES
+do
+	for opts in "" "-s none" "-n 2,0" "-b 2e-8 -e 5e-8"
+	do
+		"$SP2SP" -t "${f#*:}" -c npz $opts -o "$TMP/npz" "$DATA/${f%:*}" \
+			|| { fail "${f%:*}: $opts: writing npz"; continue; }
+		"$BIN/npz" "$TMP/npz" > "$TMP/got" \
+			|| { cat "$TMP/got"; fail "${f%:*}: $opts: bad npz archive"; continue; }
+		rm -rf "$TMP/npy"
+		"$SP2SP" -t "${f#*:}" -c npy $opts -o "$TMP/npy" "$DATA/${f%:*}" \
+			&& "$BIN/npz" "$TMP"/npy/*.npy > "$TMP/npy.got" \
+			|| { cat "$TMP/npy.got"; fail "${f%:*}: $opts: bad npy files"; continue; }
+		sort "$TMP/got" > "$TMP/want"
+		sort "$TMP/npy.got" | cmp -s - "$TMP/want" \
+			|| fail "${f%:*}: $opts: npy files not as the npz archive"
+		"$SP2SP" -t "${f#*:}" -c npz $opts "$DATA/${f%:*}" \
+			| cmp -s - "$TMP/npz" \
+			|| fail "${f%:*}: $opts: npz to a pipe not as to a file"
+	done
+done
+
+# a table cut short is padded with NaN to the length of the others
+head -c 1300 "$DATA/sweepb.tr0" > "$TMP/short.tr0"
+"$SP2SP" -t hspice -c npz -o "$TMP/short.npz" "$TMP/short.tr0" 2> /dev/null
+"$BIN/npz" "$TMP/short.npz" > "$TMP/short" \
+	&& grep -qx "rows: (3,): 25 25 9" "$TMP/short" \
+	&& awk '$2 == "(3," && $3 == "25):" {
+		for(i = 4; i <= NF; i++)
+			if(($i == "nan") != (i >= 4 + 2 * 25 + 9))
+				bad = 1
+		n++
+	}
+	END { exit bad || n != 4 }' "$TMP/short" \
+	|| fail "short.tr0: npz padding"
+
+# Arrow streams read back as the ascii output, and are the same written
+# to a pipe as to a file
+for f in $SAMPLES
+do
+	for opts in "" "-s none" "-n 2,0" "-b 1e-8 -e 2e-8"
+	do
+		"$SP2SP" -t "${f#*:}" -c arrow $opts -o "$TMP/arrow" \
+			"$DATA/${f%:*}" || { fail "${f%:*}: $opts: writing arrow"; continue; }
+		"$SP2SP" -t "${f#*:}" -d 0 $opts "$DATA/${f%:*}" > "$TMP/want"
+		"$BIN/arrow" "$TMP/arrow" > "$TMP/got" \
+			|| { cat "$TMP/got"; fail "${f%:*}: $opts: bad arrow stream"; continue; }
+		"$BIN/numcmp" 0 "$TMP/want" "$TMP/got" \
+			|| fail "${f%:*}: $opts: arrow doesn't read back as written"
+		"$SP2SP" -t "${f#*:}" -c arrow $opts "$DATA/${f%:*}" \
+			| cmp -s - "$TMP/arrow" \
+			|| fail "${f%:*}: $opts: arrow to a pipe not as to a file"
+	done
+done
+
+# wf file type [opts] [reltol]
+#
+# Check that a WaveFile read from file holds what sp2sp reads, in storage
+# of the right size, to within reltol.
+wf()
+{
+	"$BIN/wf" $3 "$1" "$2" > "$TMP/wf" \
+		|| { cat "$TMP/wf"; fail "`basename "$1"`: $3: WaveFile checks"; return; }
+	"$SP2SP" -t "$2" -c nohead -d 0 "$1" > "$TMP/want"
+	"$BIN/numcmp" "${4:-0}" "$TMP/want" "$TMP/wf" \
+		|| fail "`basename "$1"`: $3: WaveFile not as sp2sp reads it"
+}
+
+# WaveFiles from each format, and from a part of the file, which must be
+# what the whole holds in that part
+for f in $SAMPLES
+do
+	wf "$DATA/${f%:*}" "${f#*:}"
+	wf "$TMP/${f%:*}.spc" spc
+	"$BIN/wf" -r -b 2e-8 -e 5e-8 "$DATA/${f%:*}" "${f#*:}" > "$TMP/part" \
+		|| { cat "$TMP/part"; fail "${f%:*}: WaveFile from part of the file"; }
+	"$BIN/wf" -b 2e-8 -e 5e-8 "$DATA/${f%:*}" "${f#*:}" > "$TMP/whole"
+	cmp -s "$TMP/part" "$TMP/whole" \
+		|| fail "${f%:*}: WaveFile from part of the file not as the whole"
+done
+
+# storage reserved from estimates of the rows, which are too many for a
+# truncated file and not known for a pipe, is trimmed to fit
+head -c 3000 "$DATA/sweepb.tr0" > "$TMP/cut.tr0"
+wf "$TMP/cut.tr0" hspice
+wf "$TMP/big.asc" ascii
+wf "$TMP/big.N" cazm
+cat "$DATA/sweepb.tr0" | "$BIN/wf" - hspice > "$TMP/wf" \
+	|| { cat "$TMP/wf"; fail "sweepb.tr0: WaveFile from a pipe"; }
+
+# float and double storage, and the choice by wf_read_opts of float for
+# HSPICE binary files, which hold nothing more; wf_read keeps doubles
+for f in $SAMPLES
+do
+	wf "$DATA/${f%:*}" "${f#*:}" "-4 -x 4" 6e-8
+	wf "$DATA/${f%:*}" "${f#*:}" "-8 -x 8"
+done
+wf "$DATA/sweepb.tr0" hspice "-r -x 4" 6e-8
+wf "$DATA/sweepb.tr0" hspice "-x 8"
+wf "$DATA/tran.tr0" hspice "-r -x 8"
+wf "$DATA/tran.raw" spice3raw "-r -x 8"
+
+# wf_read only writes a seek index when asked to
+cp "$DATA/tran.raw" "$TMP/wfidx.raw"
+"$BIN/wf" -r -b 2e-8 "$TMP/wfidx.raw" spice3raw > /dev/null
+[ -f "$TMP/wfidx.raw.ssidx" ] && fail "wf_read_range wrote an index unasked"
+"$BIN/wf" -r -i -b 2e-8 "$TMP/wfidx.raw" spice3raw > /dev/null
+[ -f "$TMP/wfidx.raw.ssidx" ] || fail "wf_read_opts didn't write an index"
+
+if [ $failed = 0 ]; then
+	echo "all tests passed"
+fi
+exit $failed
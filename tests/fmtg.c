@@ -0,0 +1,192 @@
+/*
+ * fmtg - check ss_fmtg against the C library.
+ *
+ * usage: fmtg [count]
+ *
+ * ss_fmtg(buf, v, n) must give byte for byte what printf("%.*g", n, v)
+ * does, and with n = 0 the shortest string that ss_strtod converts back
+ * to v.  This tries the special values, random bit patterns, subnormals,
+ * and numbers that lie exactly halfway between two roundings, at the
+ * precisions sp2sp -d allows and some beyond, count (default 50000)
+ * of each kind.  Exits 1 if any differ, after showing the first few.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+
+#include "glib.h"
+#include "spicestream.h"
+
+#define MAXDIGITS 40
+#define MAXBAD 10
+
+static unsigned long long state = 88172645463325252ULL;
+static long nchecks;
+static int nbad;
+
+/* xorshift64, so that every run checks the same numbers */
+static unsigned long long
+rnd(void)
+{
+	state ^= state << 13;
+	state ^= state >> 7;
+	state ^= state << 17;
+	return state;
+}
+
+static double
+from_bits(unsigned long long b)
+{
+	double v;
+
+	memcpy(&v, &b, sizeof(v));
+	return v;
+}
+
+static void
+bad(double v, int ndigits, char *got, char *want)
+{
+	if(nbad++ < MAXBAD)
+		printf("ss_fmtg(%a, %d): got \"%s\", want \"%s\"\n",
+		       v, ndigits, got, want);
+}
+
+/*
+ * Check v with ndigits significant digits.
+ */
+static void
+check(double v, int ndigits)
+{
+	char got[MAXDIGITS + 32], want[MAXDIGITS + 400];
+	int n;
+
+	nchecks++;
+	n = ss_fmtg(got, v, ndigits);
+	snprintf(want, sizeof(want), "%.*g", ndigits, v);
+	if(strcmp(got, want) != 0 || n != (int) strlen(want))
+		bad(v, ndigits, got, want);
+}
+
+/*
+ * Check the shortest round-trip form of v: it must convert back to v,
+ * be what %.*g gives with that many digits, and have no more digits
+ * than it needs.
+ */
+static void
+check_shortest(double v)
+{
+	char got[64], want[400];
+	char *p;
+	int nd, started;
+
+	nchecks++;
+	ss_fmtg(got, v, 0);
+	if(isnan(v))
+	{
+		snprintf(want, sizeof(want), "%g", v);
+		if(strcmp(got, want) != 0)
+			bad(v, 0, got, want);
+		return;
+	}
+	if(ss_strtod(got, NULL) != v)
+	{
+		bad(v, 0, got, "a string that converts back");
+		return;
+	}
+	nd = 0;
+	started = 0;
+	for(p = got; *p && *p != 'e'; p++)
+	{
+		if(*p >= '1' && *p <= '9')
+			started = 1;
+		if(started && *p >= '0' && *p <= '9')
+			nd++;
+	}
+	if(nd == 0)
+		nd = 1;
+	snprintf(want, sizeof(want), "%.*g", nd, v);
+	if(strcmp(got, want) != 0)
+		bad(v, 0, got, want);
+	else if(nd > 1)
+	{
+		snprintf(want, sizeof(want), "%.*g", nd - 1, v);
+		if(strtod(want, NULL) == v)
+			bad(v, 0, got, want);
+	}
+}
+
+int
+main(int argc, char **argv)
+{
+	static const double special[] = {
+		0.0, -0.0, INFINITY, -INFINITY, NAN, 1.0, -1.0, 0.5, 0.1, 0.3,
+		2.5, 3.5, 125, 1e-5, 1e-4, 9.9999995e-5, 999999.5, 9999995,
+		1e22, 1e23, 1e100, 1e-300, DBL_MAX, -DBL_MAX, DBL_MIN,
+		DBL_MIN / 2, 4.9e-324, 5e-324, 123456789012345678.0,
+	};
+	long count, i;
+	double v;
+	int k, n, e;
+
+	count = (argc > 1) ? atol(argv[1]) : 50000;
+
+	for(k = 0; k < (int) (sizeof(special) / sizeof(special[0])); k++)
+	{
+		for(n = 1; n <= MAXDIGITS; n++)
+			check(special[k], n);
+		check_shortest(special[k]);
+	}
+
+	for(i = 0; i < count; i++)
+	{
+		/* any bit pattern, at the precisions sp2sp -d takes */
+		v = from_bits(rnd());
+		check(v, 1 + rnd() % 21);
+		check_shortest(v);
+
+		/* subnormals */
+		v = from_bits(rnd() & 0x800fffffffffffffULL);
+		check(v, 1 + rnd() % 21);
+		check_shortest(v);
+
+		/* halfway cases: multiples of 1/8 and of 1/2 end in 5, so
+		 * with too few digits for all of them they round from
+		 * exactly halfway, to even as printf does */
+		v = (double) ((long long) (rnd() % 2000000) - 1000000) / 8;
+		e = (int) (rnd() % 61) - 30;
+		check(v, 1 + rnd() % 8);
+		check(ldexp(v, e), 1 + rnd() % 17);
+		v = (rnd() % 100000) + 0.5;
+		for(n = 1; n <= 8; n++)
+			check(v, n);
+
+		/* short decimals, and floats, as HSPICE files hold */
+		v = (double) ((long long) (rnd() % 2000000) - 1000000)
+			* pow(10, (int) (rnd() % 40) - 20);
+		check(v, 1 + rnd() % 17);
+		check((float) v, 1 + rnd() % 17);
+		check_shortest(v);
+		check_shortest((float) v);
+	}
+
+	printf("%ld checks, %d bad\n", nchecks, nbad);
+	exit(nbad != 0);
+}
@@ -0,0 +1,193 @@
+/*
+ * ival - check ss_seek_ival against reading the rows one by one.
+ *
+ * usage: ival file type
+ *
+ * Reads every row of the file, which must hold one table in order of
+ * the independent variable and have rows that ss_seek_ival can search.
+ * Then, from the start and from several rows on, goes to the first row
+ * at or after each independent-variable value in the file, each value
+ * halfway between two of them, and values before and after them all,
+ * and checks that the rows that follow are the ones from the first
+ * reading.  Exits 1 if anything differs, after saying what.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "glib.h"
+#include "spicestream.h"
+
+#define MAXBAD 10
+
+static SpiceStream *sf;
+static double *rows;	/* ncols values for each row */
+static int nrows;
+static SSCheckpoint *cp;	/* before each row, and after the last */
+static int nbad;
+
+/*
+ * From the checkpoint before row from, skip to ival, and check that the
+ * rows that follow are the ones from row want on.
+ */
+static void
+check(int from, double ival, int want)
+{
+	double *row;
+	int rc, r;
+
+	nbad++;
+	row = g_new(double, sf->ncols);
+	if(ss_seek(sf, &cp[from]) < 0)
+	{
+		printf("ss_seek to row %d failed\n", from);
+		goto out;
+	}
+	rc = ss_seek_ival(sf, ival);
+	if(rc != (want > from))
+	{
+		printf("from row %d to %.17g: ss_seek_ival returned %d\n",
+		       from, ival, rc);
+		goto out;
+	}
+	for(r = want; r < nrows; r++)
+	{
+		if(ss_readrow(sf, &row[0], &row[1]) <= 0
+		   || memcmp(row, rows + (size_t) r * sf->ncols,
+		             sf->ncols * sizeof(double)) != 0)
+		{
+			printf("from row %d to %.17g: row %d differs\n",
+			       from, ival, r);
+			goto out;
+		}
+	}
+	if(ss_readrow(sf, &row[0], &row[1]) != 0)
+	{
+		printf("from row %d to %.17g: no EOF after the last row\n",
+		       from, ival);
+		goto out;
+	}
+	nbad--;
+out:
+	g_free(row);
+	if(nbad >= MAXBAD)
+		exit(1);
+}
+
+/*
+ * The first row from row from on whose independent variable is at least
+ * ival, or nrows if there is none.
+ */
+static int
+first_at(int from, double ival)
+{
+	int r;
+
+	for(r = from; r < nrows; r++)
+		if(rows[(size_t) r * sf->ncols] >= ival)
+			break;
+	return r;
+}
+
+/*
+ * Check skipping to each value, from row from.
+ */
+static void
+check_from(int from)
+{
+	double ival;
+	int r;
+
+	for(r = -1; r < nrows; r++)
+	{
+		if(r < 0)
+			ival = rows[0] - 1;
+		else
+			ival = rows[(size_t) r * sf->ncols];
+		check(from, ival, first_at(from, ival));
+		if(r >= 0 && r + 1 < nrows)
+			ival = (ival + rows[(size_t) (r + 1) * sf->ncols]) / 2;
+		else if(r >= 0)
+			ival += 1;
+		check(from, ival, first_at(from, ival));
+	}
+}
+
+int
+main(int argc, char **argv)
+{
+	int size, rc;
+
+	if(argc != 3)
+	{
+		fprintf(stderr, "usage: ival file type\n");
+		exit(2);
+	}
+	sf = ss_open(argv[1], argv[2]);
+	if(sf == NULL)
+	{
+		printf("%s: can't open as %s\n", argv[1], argv[2]);
+		exit(1);
+	}
+	if(sf->nsweepparam > 0)
+	{
+		printf("%s: has sweep parameters\n", argv[1]);
+		exit(1);
+	}
+
+	size = 64;
+	rows = g_new(double, (size_t) size * sf->ncols);
+	cp = g_new(SSCheckpoint, size + 1);
+	nrows = 0;
+	for(;;)
+	{
+		if(nrows == size)
+		{
+			size *= 2;
+			rows = g_realloc(rows, (size_t) size * sf->ncols
+			                 * sizeof(double));
+			cp = g_realloc(cp, (size + 1) * sizeof(SSCheckpoint));
+		}
+		if(ss_tell(sf, &cp[nrows]) < 0)
+		{
+			printf("%s: ss_tell failed at row %d\n", argv[1], nrows);
+			exit(1);
+		}
+		rc = ss_readrow(sf, &rows[(size_t) nrows * sf->ncols],
+		                &rows[(size_t) nrows * sf->ncols + 1]);
+		if(rc <= 0)
+			break;
+		nrows++;
+	}
+	if(rc < 0 || nrows == 0)
+	{
+		printf("%s: %s\n", argv[1], rc < 0 ? "read error" : "no rows");
+		exit(1);
+	}
+
+	check_from(0);
+	check_from(1);
+	check_from(nrows / 2);
+	check_from(nrows - 1);
+	check_from(nrows);
+
+	printf("%s: %d rows, %s\n", argv[1], nrows, nbad ? "FAILED" : "ok");
+	ss_close(sf);
+	exit(nbad != 0);
+}
@@ -0,0 +1,305 @@
+/*
+ * npz - read back NumPy output from sp2sp -c npz and -c npy.
+ *
+ * usage: npz file...
+ *
+ * Each file is a .npz archive, or a .npy file.  Checks that an archive
+ * is a well-formed zip of the kind sp2sp writes: members stored, with
+ * the CRC-32 and sizes of each in its data descriptor and the central
+ * directory, and no two with the same name.  Checks that each array has
+ * a version 1.0 header whose data starts on a 64-byte boundary and
+ * whose shape fits the data.  Then prints a line for each array, its
+ * name, its shape and its values in full, for comparing with what was
+ * written; complex values are printed as their two parts.  Exits 1 if a
+ * file is not what it should be, after saying why.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAXDIM 8
+
+static char *filename;
+
+static void
+bad(char *what)
+{
+	printf("%s: %s\n", filename, what);
+	exit(1);
+}
+
+/*
+ * The little-endian integer of n bytes at p.
+ */
+static unsigned long long
+get(const unsigned char *p, int n)
+{
+	unsigned long long v = 0;
+
+	while(n-- > 0)
+		v = (v << 8) | p[n];
+	return v;
+}
+
+/*
+ * The CRC-32 of zip files, a bit at a time.
+ */
+static unsigned long
+crc32_bits(const unsigned char *p, size_t n)
+{
+	unsigned long crc = 0xffffffff;
+	int k;
+
+	while(n-- > 0)
+	{
+		crc ^= *p++;
+		for(k = 0; k < 8; k++)
+			crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+	}
+	return crc ^ 0xffffffff;
+}
+
+/*
+ * Read all of a file.
+ */
+static unsigned char *
+read_file(char *name, size_t *lenp)
+{
+	FILE *fp;
+	unsigned char *buf = NULL;
+	size_t len = 0, size = 0, n;
+
+	if((fp = fopen(name, "rb")) == NULL)
+	{
+		perror(name);
+		exit(2);
+	}
+	do {
+		if(len == size)
+		{
+			size = size ? 2 * size : 65536;
+			buf = realloc(buf, size);
+		}
+		n = fread(buf + len, 1, size - len, fp);
+		len += n;
+	} while(n > 0);
+	fclose(fp);
+	*lenp = len;
+	return buf;
+}
+
+/*
+ * The value of key in a .npy header dictionary, up to the quote or
+ * parenthesis that ends it, or NULL if it isn't there.
+ */
+static char *
+dict_value(char *hdr, char *key, char *end, int *lenp)
+{
+	char *p, *q;
+
+	p = strstr(hdr, key);
+	if(p == NULL)
+		return NULL;
+	p += strlen(key);
+	q = strpbrk(p, end);
+	if(q == NULL)
+		return NULL;
+	*lenp = q - p;
+	return p;
+}
+
+/*
+ * Check the .npy data of n bytes at p, and print its array as name.
+ */
+static void
+print_array(char *name, const unsigned char *p, size_t n)
+{
+	char hdr[65536], descr[16];
+	char *v, *s;
+	long long shape[MAXDIM], count, i;
+	int hlen, vlen, ndim, size, big, k;
+	const unsigned char *d;
+	union { double f; long long i; unsigned long long u; } u;
+
+	if(n < 10 || memcmp(p, "\223NUMPY\001\000", 8) != 0)
+		bad("array without a version 1.0 .npy header");
+	hlen = get(p + 8, 2);
+	if(10 + (size_t) hlen > n || (10 + hlen) % 64 != 0 || p[9 + hlen] != '\n')
+		bad("array header not ended at a multiple of 64 bytes");
+	memcpy(hdr, p + 10, hlen);
+	hdr[hlen] = 0;
+
+	v = dict_value(hdr, "'descr': '", "'", &vlen);
+	if(v == NULL || vlen < 3 || vlen >= (int) sizeof(descr))
+		bad("array without a descr");
+	memcpy(descr, v, vlen);
+	descr[vlen] = 0;
+	size = atoi(descr + 2);
+	big = (descr[0] == '>');
+	if(strstr(hdr, "'fortran_order': False") == NULL)
+		bad("array in fortran order");
+	if((descr[1] == 'f' && size != 8) || (descr[1] == 'c' && size != 16)
+	   || (descr[1] == 'i' && size != 8) || strchr("fciS", descr[1]) == NULL
+	   || size < 1)
+		bad("array of a type sp2sp doesn't write");
+
+	v = dict_value(hdr, "'shape': (", ")", &vlen);
+	if(v == NULL)
+		bad("array without a shape");
+	v[vlen] = 0;
+	ndim = 0;
+	count = 1;
+	for(s = v; *s; )
+	{
+		if(ndim == MAXDIM)
+			bad("array of too many dimensions");
+		shape[ndim] = strtoll(s, &s, 10);
+		if(shape[ndim] < 0)
+			bad("array with a negative dimension");
+		count *= shape[ndim++];
+		while(*s == ',' || *s == ' ')
+			s++;
+	}
+	if(10 + hlen + count * size != (long long) n)
+		bad("array whose shape doesn't fit its data");
+
+	printf("%s: (", name);
+	for(k = 0; k < ndim; k++)
+		printf("%s%lld", k ? ", " : "", shape[k]);
+	printf(ndim == 1 ? ",):" : "):");
+	d = p + 10 + hlen;
+	for(i = 0; i < count; i++, d += size)
+	{
+		if(descr[1] == 'S')
+		{
+			printf(" %.*s", (int) strnlen((char *) d, size), d);
+			continue;
+		}
+		for(k = 0; k < size; k += 8)
+		{
+			u.u = 0;
+			for(vlen = 0; vlen < 8; vlen++)
+				u.u = (u.u << 8) | d[k + (big ? vlen : 7 - vlen)];
+			if(descr[1] == 'i')
+				printf(" %lld", u.i);
+			else
+				printf(" %.17g", u.f);
+		}
+	}
+	printf("\n");
+}
+
+/*
+ * Check an archive and print its arrays.
+ */
+static void
+read_npz(const unsigned char *buf, size_t len)
+{
+	const unsigned char *eocd, *cd, *lh, *dd;
+	size_t nmembers, cdoff, cdsize, off, size, nlen, i, j;
+	unsigned long crc;
+	char **names;
+
+	if(len < 22)
+		bad("too short for a zip archive");
+	for(eocd = buf + len - 22; eocd > buf && get(eocd, 4) != 0x06054b50; eocd--)
+		;
+	if(get(eocd, 4) != 0x06054b50)
+		bad("no end of central directory record");
+	nmembers = get(eocd + 10, 2);
+	cdsize = get(eocd + 12, 4);
+	cdoff = get(eocd + 16, 4);
+	if(nmembers == 0xffff || cdoff == 0xffffffff)
+		bad("zip64 archive, which this doesn't read");
+	if(cdoff > len || cdsize > len - cdoff)
+		bad("central directory out of the file");
+
+	names = calloc(nmembers + 1, sizeof(char *));
+	cd = buf + cdoff;
+	for(i = 0; i < nmembers; i++)
+	{
+		if(cd + 46 > buf + cdoff + cdsize || get(cd, 4) != 0x02014b50)
+			bad("bad central directory entry");
+		if(get(cd + 10, 2) != 0)
+			bad("member that isn't stored");
+		crc = get(cd + 16, 4);
+		size = get(cd + 24, 4);
+		if(get(cd + 20, 4) != size)
+			bad("member whose sizes differ");
+		nlen = get(cd + 28, 2);
+		off = get(cd + 42, 4);
+		if(nlen < 5 || memcmp(cd + 46 + nlen - 4, ".npy", 4) != 0)
+			bad("member that isn't a .npy file");
+		names[i] = calloc(nlen - 3, 1);
+		memcpy(names[i], cd + 46, nlen - 4);
+		for(j = 0; j < i; j++)
+			if(strcmp(names[i], names[j]) == 0)
+				bad("two members with the same name");
+
+		lh = buf + off;
+		if(off > len - 30 || get(lh, 4) != 0x04034b50
+		   || get(lh + 26, 2) != nlen || memcmp(lh + 30, cd + 46, nlen) != 0)
+			bad("local header not as in the central directory");
+		off += 30 + nlen + get(lh + 28, 2);
+		if(off > len || size > len - off || len - off - size < 16)
+			bad("member data out of the file");
+		if(crc32_bits(buf + off, size) != crc)
+			bad("member whose CRC-32 is wrong");
+		dd = buf + off + size;
+		if(get(dd, 4) != 0x08074b50 || get(dd + 4, 4) != crc
+		   || get(dd + 8, 4) != size || get(dd + 12, 4) != size)
+			bad("data descriptor not as in the central directory");
+		print_array(names[i], buf + off, size);
+
+		cd += 46 + nlen + get(cd + 30, 2) + get(cd + 32, 2);
+	}
+}
+
+int
+main(int argc, char **argv)
+{
+	unsigned char *buf;
+	size_t len, n;
+	char *name, *s;
+	int i;
+
+	if(argc < 2)
+	{
+		fprintf(stderr, "usage: %s file...\n", argv[0]);
+		exit(2);
+	}
+	for(i = 1; i < argc; i++)
+	{
+		filename = argv[i];
+		buf = read_file(filename, &len);
+		n = strlen(filename);
+		if(n > 4 && strcmp(filename + n - 4, ".npy") == 0)
+		{
+			s = strrchr(filename, '/');
+			name = strdup(s ? s + 1 : filename);
+			name[strlen(name) - 4] = 0;
+			print_array(name, buf, len);
+			free(name);
+		}
+		else
+			read_npz(buf, len);
+		free(buf);
+	}
+	exit(0);
+}
@@ -0,0 +1,110 @@
+/*
+ * numcmp - compare two sp2sp ascii outputs, allowing numbers to differ
+ * by a relative tolerance.
+ *
+ * usage: numcmp reltol file1 file2
+ *
+ * The files must have the same lines, each with the same fields.  Fields
+ * that are both numbers must agree to within reltol times the larger of
+ * the two in magnitude; other fields must be the same.  Exits 0 if the
+ * files match, 1 if they don't, after saying where, and 2 on errors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define LINESIZE 65536
+
+/*
+ * Return 1 if the fields a and b match.
+ */
+static int
+field_match(char *a, char *b, double reltol)
+{
+	double x, y;
+	char *ea, *eb;
+
+	x = strtod(a, &ea);
+	y = strtod(b, &eb);
+	if(ea == a || *ea != '\0' || eb == b || *eb != '\0')
+		return strcmp(a, b) == 0;
+	if(isnan(x) || isnan(y))
+		return isnan(x) && isnan(y);
+	if(x == y)
+		return 1;
+	return fabs(x - y) <= reltol * fmax(fabs(x), fabs(y));
+}
+
+int
+main(int argc, char **argv)
+{
+	FILE *fa, *fb;
+	char *la, *lb, *ga, *gb;
+	char *sa, *sb, *pa, *pb;
+	double reltol;
+	int lineno, field;
+
+	if(argc != 4)
+	{
+		fprintf(stderr, "usage: numcmp reltol file1 file2\n");
+		exit(2);
+	}
+	reltol = atof(argv[1]);
+	if((fa = fopen(argv[2], "r")) == NULL)
+	{
+		perror(argv[2]);
+		exit(2);
+	}
+	if((fb = fopen(argv[3], "r")) == NULL)
+	{
+		perror(argv[3]);
+		exit(2);
+	}
+	la = malloc(LINESIZE);
+	lb = malloc(LINESIZE);
+
+	for(lineno = 1; ; lineno++)
+	{
+		ga = fgets(la, LINESIZE, fa);
+		gb = fgets(lb, LINESIZE, fb);
+		if(ga == NULL || gb == NULL)
+		{
+			if(ga == gb)
+				break;
+			printf("%s:%d: %s ends first\n", argv[2], lineno,
+			       ga ? argv[3] : argv[2]);
+			exit(1);
+		}
+		pa = strtok_r(la, " \t\n", &sa);
+		pb = strtok_r(lb, " \t\n", &sb);
+		for(field = 1; pa || pb; field++)
+		{
+			if(pa == NULL || pb == NULL || !field_match(pa, pb, reltol))
+			{
+				printf("%s:%d: field %d: \"%s\" vs \"%s\"\n", argv[2],
+				       lineno, field, pa ? pa : "", pb ? pb : "");
+				exit(1);
+			}
+			pa = strtok_r(NULL, " \t\n", &sa);
+			pb = strtok_r(NULL, " \t\n", &sb);
+		}
+	}
+	exit(0);
+}
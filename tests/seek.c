@@ -0,0 +1,304 @@
+/*
+ * seek - check that reading carries on correctly from a checkpoint.
+ *
+ * usage: seek file type [nthreads]
+ *
+ * Reads the whole file twice, a few rows at a time with ss_readblock and
+ * then a row at a time with ss_readrow, taking a checkpoint with ss_tell
+ * before every call, sweep parameters included.  Then goes back to each
+ * checkpoint, last to first, with ss_seek and checks that everything
+ * read from there to the end of the file is the same as the first time,
+ * bit for bit.  In big files only some of the checkpoints are tried, and
+ * only the next MAXEVENTS steps after each are compared.  With nthreads, the reader may use that many threads, as
+with sp2sp -j.  Exits 1 if anything differs, after saying what.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "glib.h"
+#include "spicestream.h"
+
+#define BLOCKROWS 7	/* rows for each ss_readblock call */
+#define MAXCHECKS 200	/* checkpoints to try */
+#define MAXEVENTS 1000	/* steps to compare after each */
+
+/* what a step of reading gave */
+#define EV_ROW 0	/* a row: the independent variable, then the columns */
+#define EV_SWEEP 1	/* sweep parameter values */
+#define EV_STATUS 2	/* the end of a table, of the file, or an error */
+
+typedef struct {
+	int kind;
+	int rc;		/* EV_STATUS */
+	long vals;	/* where its values start in the log */
+} Event;
+
+typedef struct {
+	Event *ev;
+	int nev;
+	int evsize;
+	double *vals;
+	long nvals;
+	long valsize;
+} Log;
+
+typedef struct {
+	SpiceStream *sf;
+	int rowmode;
+	int tablestart;	/* next step reads the sweep parameters */
+	double *ivals;
+	double **cols;
+	double *row;
+} Reader;
+
+static void
+log_add(Log *lg, int kind, int rc, double *v, int n)
+{
+	if(lg->nev == lg->evsize)
+	{
+		lg->evsize = lg->evsize ? 2 * lg->evsize : 1024;
+		lg->ev = g_realloc(lg->ev, lg->evsize * sizeof(Event));
+	}
+	while(lg->nvals + n > lg->valsize)
+	{
+		lg->valsize = lg->valsize ? 2 * lg->valsize : 4096;
+		lg->vals = g_realloc(lg->vals, lg->valsize * sizeof(double));
+	}
+	lg->ev[lg->nev].kind = kind;
+	lg->ev[lg->nev].rc = rc;
+	lg->ev[lg->nev].vals = lg->nvals;
+	lg->nev++;
+	memcpy(lg->vals + lg->nvals, v, n * sizeof(double));
+	lg->nvals += n;
+}
+
+/*
+ * Do one step of reading, and add what it gave to lg.  Returns 1 if
+ * there is more to read, 0 at the end of the file or on an error.
+ */
+static int
+step(Reader *rd, Log *lg)
+{
+	SpiceStream *sf = rd->sf;
+	int ncols = sf->ncols;
+	int rc, r, c;
+
+	if(rd->tablestart && sf->nsweepparam > 0)
+	{
+		rd->tablestart = 0;
+		rc = ss_readsweep(sf, rd->row);
+		if(rc <= 0)
+		{
+			log_add(lg, EV_STATUS, rc, NULL, 0);
+			return 0;
+		}
+		log_add(lg, EV_SWEEP, 0, rd->row, sf->nsweepparam);
+		return 1;
+	}
+	rd->tablestart = 0;
+	if(rd->rowmode)
+	{
+		rc = ss_readrow(sf, &rd->row[0], &rd->row[1]);
+		if(rc > 0)
+		{
+			log_add(lg, EV_ROW, 0, rd->row, ncols);
+			return 1;
+		}
+	}
+	else
+	{
+		rc = ss_readblock(sf, BLOCKROWS, rd->ivals, rd->cols);
+		if(rc > 0)
+		{
+			for(r = 0; r < rc; r++)
+			{
+				rd->row[0] = rd->ivals[r];
+				for(c = 1; c < ncols; c++)
+					rd->row[c] = rd->cols[c-1][r];
+				log_add(lg, EV_ROW, 0, rd->row, ncols);
+			}
+			return 1;
+		}
+	}
+	log_add(lg, EV_STATUS, rc, NULL, 0);
+	if(rc == -2)
+	{
+		rd->tablestart = 1;
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * Compare what was read after a seek, in got, with the log of the first
+ * reading from event first on, as far as got goes, which must be to the
+ * end or MAXEVENTS events.  Returns 0 if they're the same.
+ */
+static int
+compare(Log *want, int first, Log *got, SpiceStream *sf, char *what)
+{
+	Event *w, *g;
+	int i, n;
+
+	for(i = 0; i < got->nev && first + i < want->nev; i++)
+	{
+		w = &want->ev[first + i];
+		g = &got->ev[i];
+		n = 0;
+		if(w->kind == EV_ROW)
+			n = sf->ncols;
+		else if(w->kind == EV_SWEEP)
+			n = sf->nsweepparam;
+		if(w->kind != g->kind || w->rc != g->rc
+		   || memcmp(want->vals + w->vals, got->vals + g->vals,
+		             n * sizeof(double)) != 0)
+		{
+			printf("%s, from event %d: event %d differs\n",
+			       what, first, first + i);
+			return -1;
+		}
+	}
+	n = want->nev - first;
+	if(n > MAXEVENTS)
+		n = MAXEVENTS;
+	if(got->nev != n)
+	{
+		printf("%s, from event %d: %d events, expected %d\n",
+		       what, first, got->nev, n);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Read the file through in one mode, then check every checkpoint.
+ * Returns the number of checkpoints that failed.
+ */
+static int
+check(char *file, char *type, int nthreads, int rowmode)
+{
+	char *what = rowmode ? "ss_readrow" : "ss_readblock";
+	SSCheckpoint *cp = NULL;
+	int *cpev = NULL;	/* event number at each checkpoint */
+	int *cpstart = NULL;	/* tablestart at each checkpoint */
+	int ncp = 0, cpsize = 0;
+	Reader rd;
+	Log first, again;
+	int k, c, more, nbad, stride;
+
+	memset(&rd, 0, sizeof(rd));
+	memset(&first, 0, sizeof(first));
+	memset(&again, 0, sizeof(again));
+	rd.sf = ss_open(file, type);
+	if(rd.sf == NULL)
+	{
+		printf("%s: can't open as %s\n", file, type);
+		return 1;
+	}
+	ss_set_threads(rd.sf, nthreads);
+	rd.rowmode = rowmode;
+	rd.tablestart = 1;
+	rd.ivals = g_new(double, BLOCKROWS);
+	rd.cols = g_new(double *, rd.sf->ncols);
+	for(c = 0; c < rd.sf->ncols - 1; c++)
+		rd.cols[c] = g_new(double, BLOCKROWS);
+	rd.row = g_new(double, rd.sf->ncols + rd.sf->nsweepparam);
+
+	do
+	{
+		if(ncp == cpsize)
+		{
+			cpsize = cpsize ? 2 * cpsize : 256;
+			cp = g_realloc(cp, cpsize * sizeof(SSCheckpoint));
+			cpev = g_realloc(cpev, cpsize * sizeof(int));
+			cpstart = g_realloc(cpstart, cpsize * sizeof(int));
+		}
+		if(ss_tell(rd.sf, &cp[ncp]) < 0)
+		{
+			printf("%s: ss_tell failed at event %d\n", file, first.nev);
+			return 1;
+		}
+		cpev[ncp] = first.nev;
+		cpstart[ncp] = rd.tablestart;
+		ncp++;
+		more = step(&rd, &first);
+	}
+	while(more);
+	if(first.ev[first.nev - 1].rc != 0)
+	{
+		printf("%s: read error\n", file);
+		return 1;
+	}
+
+	nbad = 0;
+	stride = ncp / MAXCHECKS + 1;
+	for(k = ncp - 1; k >= 0; k -= stride)
+	{
+		if(ss_seek(rd.sf, &cp[k]) < 0)
+		{
+			printf("%s: ss_seek to event %d failed\n", file, cpev[k]);
+			nbad++;
+			continue;
+		}
+		again.nev = 0;
+		again.nvals = 0;
+		rd.tablestart = cpstart[k];
+		while(again.nev < MAXEVENTS && step(&rd, &again))
+			;
+		if(again.nev > MAXEVENTS)
+			again.nev = MAXEVENTS;	/* a block can go past */
+		if(compare(&first, cpev[k], &again, rd.sf, what) < 0)
+			nbad++;
+	}
+	printf("%s: %s: %d events, %d of %d checkpoints, %s\n", file, what,
+	       first.nev, (ncp + stride - 1) / stride, ncp,
+	       nbad ? "FAILED" : "ok");
+
+	for(c = 0; c < rd.sf->ncols - 1; c++)
+		g_free(rd.cols[c]);
+	ss_close(rd.sf);
+	g_free(rd.cols);
+	g_free(rd.ivals);
+	g_free(rd.row);
+	g_free(first.ev);
+	g_free(first.vals);
+	g_free(again.ev);
+	g_free(again.vals);
+	g_free(cp);
+	g_free(cpev);
+	g_free(cpstart);
+	return nbad;
+}
+
+int
+main(int argc, char **argv)
+{
+	int nthreads, nbad;
+
+	if(argc < 3 || argc > 4)
+	{
+		fprintf(stderr, "usage: seek file type [nthreads]\n");
+		exit(2);
+	}
+	nthreads = (argc > 3) ? atoi(argv[3]) : 1;
+	nbad = check(argv[1], argv[2], nthreads, 0);
+	nbad += check(argv[1], argv[2], nthreads, 1);
+	exit(nbad != 0);
+}
@@ -0,0 +1,194 @@
+/*
+ * skip - check ss_skip_table against reading the tables through.
+ *
+ * usage: skip file type [nthreads]
+ *
+ * Reads the file a table at a time with ss_readblock, alongside a second
+ * stream of the same file that reads only the first few rows of each
+ * table and then passes over the rest with ss_skip_table.  The rows it
+ * does read, the status that ends each table and the sweep parameters
+ * of the next must be the same as from the full reading.  This is done
+ * reading 0, 1, 7 and 100 rows of each table before skipping.  Exits 1
+ * if anything differs, after saying what.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "glib.h"
+#include "spicestream.h"
+
+#define BLOCKROWS 64
+
+typedef struct {
+	SpiceStream *sf;
+	double *ivals;
+	double **cols;
+	double *spar;
+} Reader;
+
+static int
+rd_open(Reader *rd, char *file, char *type, int nthreads)
+{
+	int c;
+
+	rd->sf = ss_open(file, type);
+	if(rd->sf == NULL)
+		return -1;
+	ss_set_threads(rd->sf, nthreads);
+	rd->ivals = g_new(double, BLOCKROWS);
+	rd->cols = g_new(double *, rd->sf->ncols);
+	for(c = 0; c < rd->sf->ncols - 1; c++)
+		rd->cols[c] = g_new(double, BLOCKROWS);
+	rd->spar = g_new(double, rd->sf->nsweepparam + 1);
+	return 0;
+}
+
+static void
+rd_close(Reader *rd)
+{
+	int c;
+
+	for(c = 0; c < rd->sf->ncols - 1; c++)
+		g_free(rd->cols[c]);
+	ss_close(rd->sf);
+	g_free(rd->cols);
+	g_free(rd->ivals);
+	g_free(rd->spar);
+}
+
+/*
+ * Is row r of a's last block the same as row s of b's?
+ */
+static int
+same_row(Reader *a, int r, Reader *b, int s)
+{
+	int c;
+
+	if(a->ivals[r] != b->ivals[s])
+		return 0;
+	for(c = 0; c < a->sf->ncols - 1; c++)
+		if(a->cols[c][r] != b->cols[c][s])
+			return 0;
+	return 1;
+}
+
+/*
+ * Read k rows of each table through b and skip the rest, checking them
+ * against a full reading through a.  Returns 0 if all is well.
+ */
+static int
+check(char *file, char *type, int nthreads, int k)
+{
+	Reader a, b;
+	int table, nb, ra, rb, r, want, nread;
+
+	if(rd_open(&a, file, type, nthreads) < 0
+	   || rd_open(&b, file, type, nthreads) < 0)
+	{
+		printf("%s: can't open as %s\n", file, type);
+		return 1;
+	}
+	for(table = 0; ; table++)
+	{
+		if(a.sf->nsweepparam > 0)
+		{
+			ra = ss_readsweep(a.sf, a.spar);
+			rb = ss_readsweep(b.sf, b.spar);
+			if(ra != rb || (ra > 0 && memcmp(a.spar, b.spar,
+			                 a.sf->nsweepparam * sizeof(double)) != 0))
+			{
+				printf("%s: table %d: sweep parameters differ\n",
+				       file, table);
+				goto bad;
+			}
+			if(ra <= 0)
+				break;
+		}
+
+		/* the rows that b reads must match the first k that a reads */
+		nread = 0;
+		nb = 0;
+		ra = rb = 0;
+		while((ra = ss_readblock(a.sf, BLOCKROWS, a.ivals, a.cols)) > 0)
+		{
+			for(r = 0; r < ra && nread < k; r++, nread++)
+			{
+				if(nb == rb)
+				{
+					want = k - nread;
+					if(want > BLOCKROWS)
+						want = BLOCKROWS;
+					rb = ss_readblock(b.sf, want, b.ivals, b.cols);
+					nb = 0;
+					if(rb <= 0)
+					{
+						printf("%s: table %d: ended early, at row %d\n",
+						       file, table, nread);
+						goto bad;
+					}
+				}
+				if(!same_row(&a, r, &b, nb++))
+				{
+					printf("%s: table %d: row %d differs\n",
+					       file, table, nread);
+					goto bad;
+				}
+			}
+		}
+		if(nread < k)
+			rb = ss_readblock(b.sf, 1, b.ivals, b.cols);
+		else
+			rb = ss_skip_table(b.sf);
+		if(ra != rb)
+		{
+			printf("%s: table %d: %s returned %d, not %d\n", file, table,
+			       nread < k ? "ss_readblock" : "ss_skip_table", rb, ra);
+			goto bad;
+		}
+		if(ra != -2)
+			break;
+	}
+	rd_close(&a);
+	rd_close(&b);
+	return 0;
+bad:
+	rd_close(&a);
+	rd_close(&b);
+	return 1;
+}
+
+int
+main(int argc, char **argv)
+{
+	static const int nrows[] = { 0, 1, 7, 100 };
+	int nthreads, nbad, i;
+
+	if(argc < 3 || argc > 4)
+	{
+		fprintf(stderr, "usage: skip file type [nthreads]\n");
+		exit(2);
+	}
+	nthreads = (argc > 3) ? atoi(argv[3]) : 1;
+	nbad = 0;
+	for(i = 0; i < (int) (sizeof(nrows) / sizeof(nrows[0])); i++)
+		nbad += check(argv[1], argv[2], nthreads, nrows[i]);
+	printf("%s: %s\n", argv[1], nbad ? "FAILED" : "ok");
+	exit(nbad != 0);
+}
@@ -0,0 +1,202 @@
+/*
+ * wf - read a file into a WaveFile and print what it holds.
+ *
+ * usage: wf [-r] [-b begin] [-e end] [-i] [-4 | -8] [-x 4|8] file [format]
+ *
+ * Reads the file with wf_read, or with -r with wf_read_opts over the
+ * range from begin to end, and prints the rows of each table from begin
+ * to end, in the form of sp2sp -c nohead output: the sweep value if the
+ * file has sweep parameters, then the independent variable and each
+ * column, with every value in full.  -i lets wf_read_opts use a seek
+ * index, and -4 and -8 ask it for float or double storage.
+ *
+ * Checks on the way that each column's values are where wds_data or
+ * wds_data_f32 says, that its min and max are right, and that it holds
+ * no more than a quarter of its storage, or a page, unused.  With -x,
+ * also checks that the dependent variables are stored as floats (4) or
+ * doubles (8).  Exits 1 if a check fails, after saying which.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <float.h>
+
+#include "wavefile.h"
+
+static char *progname;
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: %s [-r] [-b begin] [-e end] [-i] [-4 | -8] [-x 4|8] file [format]\n", progname);
+	exit(2);
+}
+
+/*
+ * Check a column of a table; elsize is the size its values should be
+ * stored as, or 0 if either will do.
+ */
+static void
+check_dset(WvTable *wt, WDataSet *ds, char *what, int elsize)
+{
+	double min, max, v;
+	double *d;
+	float *f;
+	int n, r;
+
+	d = wds_data(ds, &n);
+	f = wds_data_f32(ds, &n);
+	/* there is no storage for an empty table */
+	if(n != wt->nvalues || (n > 0 && (ds->f32 ? f == NULL || d != NULL
+	                                          : d == NULL || f != NULL)))
+	{
+		printf("table %d, %s: wds_data doesn't match its storage\n",
+		       wt->swindex, what);
+		exit(1);
+	}
+	if(elsize && (int) wds_elsize(ds) != elsize)
+	{
+		printf("table %d, %s: stored as %d-byte values\n",
+		       wt->swindex, what, (int) wds_elsize(ds));
+		exit(1);
+	}
+	min = DBL_MAX;
+	max = -DBL_MAX;
+	for(r = 0; r < n; r++)
+	{
+		v = ds->f32 ? f[r] : d[r];
+		if(v != wds_get_point(ds, r))
+		{
+			printf("table %d, %s: row %d isn't in wds_data\n",
+			       wt->swindex, what, r);
+			exit(1);
+		}
+		if(v < min)
+			min = v;
+		if(v > max)
+			max = v;
+	}
+	if(n > 0 && (min != ds->min || max != ds->max))
+	{
+		printf("table %d, %s: min and max are %g and %g, not %g and %g\n",
+		       wt->swindex, what, ds->min, ds->max, min, max);
+		exit(1);
+	}
+	/* size is 0 for values mapped straight from an spc file */
+	if(ds->size != 0 && (ds->size < n * wds_elsize(ds)
+	   || ds->size - n * wds_elsize(ds)
+	      > ds->size / 4 + sysconf(_SC_PAGESIZE)))
+	{
+		printf("table %d, %s: %d values in %ld bytes of storage\n",
+		       wt->swindex, what, n, (long) ds->size);
+		exit(1);
+	}
+}
+
+int
+main(int argc, char **argv)
+{
+	WaveFile *wf;
+	WvTable *wt;
+	WaveVar *dv;
+	double begin = -DBL_MAX, end = DBL_MAX, iv;
+	int range = 0, opts = 0, elsize = 0;
+	int c, t, i, j, r;
+	char what[64];
+
+	progname = argv[0];
+	while((c = getopt(argc, argv, "rb:e:i48x:")) != EOF)
+	{
+		switch(c)
+		{
+		case 'r':
+			range = 1;
+			break;
+		case 'b':
+			begin = atof(optarg);
+			break;
+		case 'e':
+			end = atof(optarg);
+			break;
+		case 'i':
+			opts |= WF_USE_INDEX;
+			break;
+		case '4':
+			opts |= WF_STORE_F32;
+			break;
+		case '8':
+			opts |= WF_STORE_F64;
+			break;
+		case 'x':
+			elsize = atoi(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	if(optind >= argc || argc - optind > 2)
+		usage();
+
+	if(range || opts)
+		wf = wf_read_opts(argv[optind], argv[optind + 1],
+		                  range ? begin : -DBL_MAX,
+		                  range ? end : DBL_MAX, opts);
+	else
+		wf = wf_read(argv[optind], argv[optind + 1]);
+	if(wf == NULL)
+	{
+		printf("%s: can't read\n", argv[optind]);
+		exit(1);
+	}
+
+	for(t = 0; t < wf->wf_ntables; t++)
+	{
+		wt = wf_wtable(wf, t);
+		check_dset(wt, wt->iv->wds, "independent variable", 8);
+		for(i = 0; i < wf->wf_ndv; i++)
+		{
+			dv = &wt->dv[i];
+			for(j = 0; j < dv->wv_ncols; j++)
+			{
+				snprintf(what, sizeof(what), "column %d of %s", j,
+				         dv->wv_name);
+				check_dset(wt, &dv->wds[j], what, elsize);
+			}
+		}
+		for(r = 0; r < wt->nvalues; r++)
+		{
+			iv = wds_get_point(wt->iv->wds, r);
+			if(iv < begin || iv > end)
+				continue;
+			if(wf->ss->nsweepparam > 0)
+				printf("%.17g ", wt->swval);
+			printf("%.17g", iv);
+			for(i = 0; i < wf->wf_ndv; i++)
+			{
+				dv = &wt->dv[i];
+				for(j = 0; j < dv->wv_ncols; j++)
+					printf(" %.17g", wds_get_point(&dv->wds[j], r));
+			}
+			printf("\n");
+		}
+	}
+	wf_free(wf);
+	exit(0);
+}
@@ -0,0 +1,62 @@
+/*
+ * wfglib.h - the parts of glib that wavefile.c uses beyond those in
+ * src/glib.h, so that the tests can build it without glib.  It is
+ * included ahead of everything else with -include.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#ifndef WFGLIB_H
+#define WFGLIB_H
+
+#include <assert.h>
+#include <float.h>
+#include <stdlib.h>
+
+typedef void *gpointer;
+typedef void (*GFunc) (gpointer data, gpointer user_data);
+
+typedef struct {
+	gpointer *pdata;
+	unsigned int len;
+} GPtrArray;
+
+#define g_assert(expr)	assert(expr)
+#define G_MAXDOUBLE	DBL_MAX
+#define g_ptr_array_index(array, i)	((array)->pdata[i])
+
+static inline GPtrArray *
+g_ptr_array_new(void)
+{
+	return calloc(1, sizeof(GPtrArray));
+}
+
+static inline void
+g_ptr_array_add(GPtrArray *array, gpointer data)
+{
+	array->pdata = realloc(array->pdata, (array->len + 1) * sizeof(gpointer));
+	array->pdata[array->len++] = data;
+}
+
+static inline void
+g_ptr_array_free(GPtrArray *array, int free_segment)
+{
+	if(free_segment)
+		free(array->pdata);
+	free(array);
+}
+
+#endif /* WFGLIB_H */